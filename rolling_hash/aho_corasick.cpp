@@ -0,0 +1,186 @@
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include "aho_corasick.h"
+
+using namespace std;
+
+void AhoCorasickMatcher::add(const byte *literal, int len)
+{
+    assert(len > 0);
+    _literals.push_back(vector<byte>(literal, literal + len));
+    if (len > _max_len) {
+        _max_len = len;
+    }
+}
+
+static bool compare_hit_offset(const LiteralHit &a, const LiteralHit &b)
+{
+    return a._offset < b._offset;
+}
+
+/*
+ * Build the trie of the literals then fill in the missing transitions from the failure
+ *  links in breadth first order so that each state's failure state is complete before it
+ *  is used.
+ */
+void AhoCorasickMatcher::build()
+{
+    // Byte classes. Bytes that are not in any literal share class 0 unless every byte is used
+    bool used[256] = { false };
+    int num_used = 0;
+    for (vector<vector<byte> >::const_iterator it = _literals.begin(); it != _literals.end(); it++) {
+        for (vector<byte>::const_iterator b = it->begin(); b != it->end(); b++) {
+            if (!used[*b]) {
+                used[*b] = true;
+                num_used++;
+            }
+        }
+    }
+    _num_classes = num_used < 256 ? 1 : 0;
+    for (int c = 0; c < 256; c++) {
+        _classes[c] = used[c] ? (byte)_num_classes++ : 0;
+    }
+
+    // The trie. 0 is the root and no state has the root as a child so 0 means no child
+    vector<int> next(_num_classes, 0);
+    vector<vector<int> > ends(1);
+    for (int i = 0; i < (int)_literals.size(); i++) {
+        int s = 0;
+        for (vector<byte>::const_iterator b = _literals[i].begin(); b != _literals[i].end(); b++) {
+            int c = _classes[*b];
+            if (!next[s * _num_classes + c]) {
+                next[s * _num_classes + c] = (int)ends.size();
+                next.resize(next.size() + _num_classes, 0);
+                ends.push_back(vector<int>());
+            }
+            s = next[s * _num_classes + c];
+        }
+        ends[s].push_back(i);
+    }
+    int num_states = (int)ends.size();
+
+    // Failure links and the full transition function
+    vector<int> fail(num_states, 0);
+    vector<int> queue;
+    queue.reserve(num_states);
+    queue.push_back(0);
+    for (size_t q = 0; q < queue.size(); q++) {
+        int s = queue[q];
+        for (int c = 0; c < _num_classes; c++) {
+            int t = next[s * _num_classes + c];
+            if (t) {
+                fail[t] = s ? next[fail[s] * _num_classes + c] : 0;
+                ends[t].insert(ends[t].end(), ends[fail[t]].begin(), ends[fail[t]].end());
+                queue.push_back(t);
+            } else if (s) {
+                next[s * _num_classes + c] = next[fail[s] * _num_classes + c];
+            }
+        }
+    }
+
+    // Renumber the states so that the ones that end literals come last. The root does not
+    //  end a literal so it stays 0
+    vector<int> order;
+    order.reserve(num_states);
+    for (int s = 0; s < num_states; s++) {
+        if (ends[s].empty()) {
+            order.push_back(s);
+        }
+    }
+    _first_output_state = (int)order.size();
+    for (int s = 0; s < num_states; s++) {
+        if (!ends[s].empty()) {
+            order.push_back(s);
+        }
+    }
+    vector<int> renumber(num_states);
+    for (int s = 0; s < num_states; s++) {
+        renumber[order[s]] = s;
+    }
+
+    _output_starts.assign(num_states - _first_output_state + 1, 0);
+    _outputs.clear();
+    for (int s = _first_output_state; s < num_states; s++) {
+        _output_starts[s - _first_output_state] = (unsigned int)_outputs.size();
+        _outputs.insert(_outputs.end(), ends[order[s]].begin(), ends[order[s]].end());
+    }
+    _output_starts[num_states - _first_output_state] = (unsigned int)_outputs.size();
+
+    assert((size_t)num_states * _num_classes <= 0xffffffff);
+    _delta.resize(next.size());
+    for (int s = 0; s < num_states; s++) {
+        for (int c = 0; c < _num_classes; c++) {
+            _delta[renumber[s] * _num_classes + c] = (unsigned int)(renumber[next[s * _num_classes + c]] * _num_classes);
+        }
+    }
+}
+
+/*
+ * Append the literals that end at data[i] in state s, which must be an output state, and 
+ *  start before end to hits
+ */
+void AhoCorasickMatcher::add_hits(unsigned int s, size_t i, size_t end, vector<LiteralHit> &hits) const
+{
+    unsigned int k = s / _num_classes - _first_output_state;
+    for (unsigned int j = _output_starts[k]; j < _output_starts[k + 1]; j++) {
+        size_t start = i + 1 - _literals[_outputs[j]].size();
+        if (start < end) {
+            hits.push_back(LiteralHit(start, _outputs[j]));
+        }
+    }
+}
+
+/*
+ * The DFA is one dependent load per byte so it is latency bound. Long ranges are split in
+ *  two and the two halves are run as independent chains in the same loop.
+ */
+void AhoCorasickMatcher::scan(const byte *data, size_t numchars, size_t begin, size_t end, vector<LiteralHit> &hits) const
+{
+    if (begin >= end || _literals.empty()) {
+        return;
+    }
+    size_t num_hits = hits.size();
+
+    // The tables are copied to locals so that the compiler knows hits.push_back() does not
+    //  change them
+    const unsigned int *delta = &_delta[0];
+    const byte *classes = _classes;
+    const unsigned int first_output = (unsigned int)(_first_output_state * _num_classes);
+
+    // Each DFA starts at the start of its half so every literal it finds starts in that half
+    //  or later. Literals that start before the end of a half can end up to _max_len - 1 
+    //  bytes after it
+    size_t mid = end - begin >= MIN_SPLIT_LEN ? begin + (end - begin) / 2 : end;
+    size_t stop1 = mid - 1 + _max_len < numchars ? mid - 1 + _max_len : numchars;
+    size_t stop2 = end - 1 + _max_len < numchars ? end - 1 + _max_len : numchars;
+    unsigned int s1 = 0, s2 = 0;
+    size_t i = begin, j = mid;
+    if (mid < end) {
+        for (; i < stop1 && j < stop2; i++, j++) {
+            s1 = delta[s1 + classes[data[i]]];
+            s2 = delta[s2 + classes[data[j]]];
+            if (s1 >= first_output) {
+                add_hits(s1, i, mid, hits);
+            }
+            if (s2 >= first_output) {
+                add_hits(s2, j, end, hits);
+            }
+        }
+    }
+    for (; i < stop1; i++) {
+        s1 = delta[s1 + classes[data[i]]];
+        if (s1 >= first_output) {
+            add_hits(s1, i, mid, hits);
+        }
+    }
+    for (; mid < end && j < stop2; j++) {
+        s2 = delta[s2 + classes[data[j]]];
+        if (s2 >= first_output) {
+            add_hits(s2, j, end, hits);
+        }
+    }
+
+    // Hits were found in order of their ends
+    stable_sort(hits.begin() + num_hits, hits.end(), compare_hit_offset);
+}
@@ -0,0 +1,53 @@
+#ifndef _AHO_CORASICK_H_
+#define _AHO_CORASICK_H_
+
+#include <vector>
+#include "literal_matcher.h"
+
+/*
+ * Aho-Corasick multi-literal matcher compiled to a DFA.
+ *
+ * To keep the transition table small the bytes are mapped to classes: each byte that occurs
+ *  in a literal gets its own class and all the other bytes share class 0. The table is
+ *  num_states x num_classes entries, so a set of text literals over ~40 distinct bytes costs
+ *  40 entries per state instead of 256.
+ *
+ * Transitions are stored premultiplied by num_classes and the states that end a literal are
+ *  numbered last, so the inner loop is one load and one compare per byte.
+ */
+class AhoCorasickMatcher : public LiteralMatcher
+{
+    // scan() runs two DFAs on the halves of ranges at least this long
+    enum { MIN_SPLIT_LEN = 256 };
+
+    // The literals
+    std::vector<std::vector<byte> > _literals;
+    // Length of longest literal
+    int _max_len;
+    // Byte to class
+    byte _classes[256];
+    int _num_classes;
+    // _delta[state * _num_classes + class] is the next state * _num_classes
+    std::vector<unsigned int> _delta;
+    // States from this one on end at least one literal
+    int _first_output_state;
+    // Literals that end at each output state, including by suffix, in CSR form. The literals
+    //  for state s are _outputs[_output_starts[k].._output_starts[k+1]) where
+    //  k = s - _first_output_state
+    std::vector<unsigned int> _output_starts;
+    std::vector<int> _outputs;
+
+    void add_hits(unsigned int s, size_t i, size_t end, std::vector<LiteralHit> &hits) const;
+
+public:
+    AhoCorasickMatcher() : _max_len(0), _num_classes(0), _first_output_state(0) {}
+
+    virtual void add(const byte *literal, int len);
+    virtual void build();
+    virtual void scan(const byte *data, size_t numchars, size_t begin, size_t end, std::vector<LiteralHit> &hits) const;
+    virtual const char *get_name() const { return "aho-corasick"; }
+
+    int get_num_states() const { return _num_classes ? (int)(_delta.size() / _num_classes) : 0; }
+};
+
+#endif // _AHO_CORASICK_H_
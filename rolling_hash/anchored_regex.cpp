@@ -0,0 +1,911 @@
+#include <memory.h>
+#include <cassert>
+#include <utility>
+#include <vector>
+#include <string>
+#include "anchored_regex.h"
+
+using namespace std;
+
+/*
+ * Anchored regex engine. See anchored_regex.h for the supported syntax.
+ *
+ *  Pattern -> parse tree (RegexNode) -> Pike VM program (RegexInst)
+ *
+ *  The parse tree is also used to compute the min/max match widths and the literals that
+ *  occur at fixed offsets in every match. The fastregex module hashes on those literals.
+ */
+
+// Largest count allowed in {m,n}
+static const int MAX_REPEAT = 1000;
+
+// Largest number of instructions in a program. Repetitions are expanded in the program and 
+//  nested ones multiply, e.g. a{1000}{1000} is a million instructions, so MAX_REPEAT alone 
+//  does not bound the size
+static const int MAX_PROGRAM_SIZE = 1 << 16;
+
+// Number of bytes in a 256 bit byte class
+static const int CLASS_SIZE = 256 / 8;
+
+enum RegexNodeType
+{
+    NODE_EMPTY,
+    NODE_BYTE,
+    NODE_CLASS,
+    NODE_CONCAT,
+    NODE_ALT,
+    NODE_REPEAT,
+    NODE_GROUP
+};
+
+struct RegexNode
+{
+    RegexNodeType _type;
+    // NODE_BYTE
+    byte _byte;
+    // NODE_CLASS. Bit b is set if byte b is in the class
+    byte _bits[CLASS_SIZE];
+    // NODE_CONCAT, NODE_ALT: all children. NODE_REPEAT, NODE_GROUP: 1 child
+    vector<RegexNode *> _children;
+    // NODE_REPEAT. _max is -1 for unbounded
+    int _min, _max;
+    bool _greedy;
+    // NODE_GROUP. Capture group number, 0 for non-capturing
+    int _group;
+
+    RegexNode(RegexNodeType type) : _type(type), _byte(0), _min(0), _max(0), _greedy(true), _group(0)
+    {
+        memset(_bits, 0, sizeof(_bits));
+    }
+
+    ~RegexNode()
+    {
+        for (vector<RegexNode *>::iterator it = _children.begin(); it != _children.end(); it++) {
+            delete *it;
+        }
+    }
+};
+
+static void class_set(byte *bits, int b)       { bits[b >> 3] |= (byte)(1 << (b & 7)); }
+static bool class_test(const byte *bits, int b) { return (bits[b >> 3] & (1 << (b & 7))) != 0; }
+
+/*
+ * Return the number of bytes in a class and the value of the last one found
+ */
+static int class_count(const byte *bits, int *last)
+{
+    int count = 0;
+    for (int b = 0; b < 256; b++) {
+        if (class_test(bits, b)) {
+            *last = b;
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Add the other case of each ASCII letter in a class
+ */
+static void class_add_cases(byte *bits)
+{
+    for (int b = 'a'; b <= 'z'; b++) {
+        if (class_test(bits, b) || class_test(bits, b - 'a' + 'A')) {
+            class_set(bits, b);
+            class_set(bits, b - 'a' + 'A');
+        }
+    }
+}
+
+/*
+ * Recursive descent parser for regex patterns.
+ */
+class RegexParser
+{
+    const byte *_pattern;
+    const int _len;
+    int _pos;
+    int _num_groups;
+    // Set by (?i). Letters match either case from there to the end of the pattern
+    bool _ignore_case;
+    string _error;
+
+    bool at_end() const { return _pos >= _len; }
+    int peek() const { return at_end() ? -1 : _pattern[_pos]; }
+
+    RegexNode *fail(const string &msg)
+    {
+        if (_error.empty()) {
+            _error = msg;
+        }
+        return 0;
+    }
+
+    static int hex_value(int c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    /*
+     * Parse an escape sequence. _pos is just after the backslash.
+     * Returns: true on success. On return either *value is the escaped byte or
+     *  bits has been filled in with a class (\d, \w etc) and *value is -1
+     */
+    bool parse_escape(int *value, byte *bits)
+    {
+        if (at_end()) {
+            fail("trailing backslash");
+            return false;
+        }
+        int c = _pattern[_pos++];
+        *value = -1;
+        switch (c) {
+        case 'n': *value = '\n'; return true;
+        case 'r': *value = '\r'; return true;
+        case 't': *value = '\t'; return true;
+        case 'f': *value = '\f'; return true;
+        case 'v': *value = '\v'; return true;
+        case 'e': *value = 0x1b; return true;
+        case '0': *value = 0;    return true;
+        case 'x': {
+            int hi = hex_value(peek());
+            int lo = _pos + 1 < _len ? hex_value(_pattern[_pos + 1]) : -1;
+            if (hi < 0 || lo < 0) {
+                fail("bad \\x escape");
+                return false;
+            }
+            _pos += 2;
+            *value = hi * 16 + lo;
+            return true;
+        }
+        case 'd': case 'D': case 'w': case 'W': case 's': case 'S': {
+            byte set[CLASS_SIZE];
+            memset(set, 0, sizeof(set));
+            int lc = c | 0x20;
+            for (int b = 0; b < 256; b++) {
+                bool in = (lc == 'd' && b >= '0' && b <= '9')
+                       || (lc == 'w' && ((b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b == '_'))
+                       || (lc == 's' && (b == ' ' || (b >= '\t' && b <= '\r')));
+                if (in != (c != lc)) {
+                    class_set(set, b);
+                }
+            }
+            for (int i = 0; i < CLASS_SIZE; i++) {
+                bits[i] |= set[i];
+            }
+            return true;
+        }
+        default:
+            *value = c;
+            return true;
+        }
+    }
+
+    RegexNode *parse_class()
+    {
+        // _pos is just after the '['
+        RegexNode *node = new RegexNode(NODE_CLASS);
+        bool negate = false;
+        if (peek() == '^') {
+            negate = true;
+            _pos++;
+        }
+        bool first = true;
+        while (!at_end() && (first || peek() != ']')) {
+            first = false;
+            int lo = _pattern[_pos++];
+            if (lo == '\\') {
+                if (!parse_escape(&lo, node->_bits)) {
+                    delete node;
+                    return 0;
+                }
+                if (lo < 0) {
+                    continue;   // \d etc
+                }
+            }
+            int hi = lo;
+            if (peek() == '-' && _pos + 1 < _len && _pattern[_pos + 1] != ']') {
+                _pos++;
+                hi = _pattern[_pos++];
+                if (hi == '\\') {
+                    byte dummy[CLASS_SIZE];
+                    memset(dummy, 0, sizeof(dummy));
+                    if (!parse_escape(&hi, dummy) || hi < 0) {
+                        delete node;
+                        return fail("bad range in class");
+                    }
+                }
+                if (hi < lo) {
+                    delete node;
+                    return fail("bad range in class");
+                }
+            }
+            for (int b = lo; b <= hi; b++) {
+                class_set(node->_bits, b);
+            }
+        }
+        if (at_end()) {
+            delete node;
+            return fail("missing ]");
+        }
+        _pos++;
+        if (_ignore_case) {
+            class_add_cases(node->_bits);
+        }
+        if (negate) {
+            for (int i = 0; i < CLASS_SIZE; i++) {
+                node->_bits[i] = (byte)~node->_bits[i];
+            }
+        }
+        return node;
+    }
+
+    /*
+     * Node that matches byte c, or either case of it after (?i)
+     */
+    RegexNode *make_byte(int c)
+    {
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        if (_ignore_case && letter) {
+            RegexNode *node = new RegexNode(NODE_CLASS);
+            class_set(node->_bits, c);
+            class_add_cases(node->_bits);
+            return node;
+        }
+        RegexNode *node = new RegexNode(NODE_BYTE);
+        node->_byte = (byte)c;
+        return node;
+    }
+
+    RegexNode *parse_atom()
+    {
+        int c = _pattern[_pos++];
+        switch (c) {
+        case '(': {
+            int group = 0;
+            if (peek() == '?' && _pos + 2 < _len && _pattern[_pos + 1] == 'i' && _pattern[_pos + 2] == ')') {
+                _pos += 3;
+                _ignore_case = true;
+                return new RegexNode(NODE_EMPTY);
+            }
+            if (peek() == '?') {
+                if (_pos + 1 >= _len || _pattern[_pos + 1] != ':') {
+                    return fail("unsupported (? construct");
+                }
+                _pos += 2;
+            } else {
+                group = ++_num_groups;
+            }
+            RegexNode *child = parse_alt();
+            if (!child) {
+                return 0;
+            }
+            if (peek() != ')') {
+                delete child;
+                return fail("missing )");
+            }
+            _pos++;
+            RegexNode *node = new RegexNode(NODE_GROUP);
+            node->_group = group;
+            node->_children.push_back(child);
+            return node;
+        }
+        case '[':
+            return parse_class();
+        case '.': {
+            RegexNode *node = new RegexNode(NODE_CLASS);
+            memset(node->_bits, 0xff, sizeof(node->_bits));
+            return node;
+        }
+        case '*': case '+': case '?':
+            return fail("nothing to repeat");
+        case '\\': {
+            RegexNode *node = new RegexNode(NODE_CLASS);
+            int value;
+            if (!parse_escape(&value, node->_bits)) {
+                delete node;
+                return 0;
+            }
+            if (value >= 0) {
+                delete node;
+                return make_byte(value);
+            }
+            if (_ignore_case) {
+                class_add_cases(node->_bits);
+            }
+            return node;
+        }
+        default:
+            return make_byte(c);
+        }
+    }
+
+    /*
+     * Parse a decimal number. Returns -1 if there is none
+     */
+    int parse_number()
+    {
+        int n = -1;
+        while (!at_end() && peek() >= '0' && peek() <= '9') {
+            n = (n < 0 ? 0 : n) * 10 + (_pattern[_pos++] - '0');
+            if (n > MAX_REPEAT) {
+                n = MAX_REPEAT + 1;
+            }
+        }
+        return n;
+    }
+
+    /*
+     * Try to parse {m}, {m,} or {m,n}. If it is not a valid quantifier then _pos is left
+     *  unchanged and false is returned so the '{' is treated as a literal.
+     */
+    bool parse_braces(int *min, int *max)
+    {
+        int save = _pos;
+        _pos++;
+        *min = parse_number();
+        *max = *min;
+        if (peek() == ',') {
+            _pos++;
+            *max = parse_number();
+        }
+        if (*min < 0 || peek() != '}') {
+            _pos = save;
+            return false;
+        }
+        _pos++;
+        return true;
+    }
+
+    RegexNode *parse_repeat()
+    {
+        RegexNode *node = parse_atom();
+        while (node && !at_end()) {
+            int c = peek();
+            int min, max;
+            if (c == '*') {
+                min = 0; max = -1; _pos++;
+            } else if (c == '+') {
+                min = 1; max = -1; _pos++;
+            } else if (c == '?') {
+                min = 0; max = 1; _pos++;
+            } else if (c == '{' && parse_braces(&min, &max)) {
+                if (min > MAX_REPEAT || max > MAX_REPEAT || (max >= 0 && max < min)) {
+                    delete node;
+                    return fail("bad repetition count");
+                }
+            } else {
+                break;
+            }
+            RegexNode *repeat = new RegexNode(NODE_REPEAT);
+            repeat->_min = min;
+            repeat->_max = max;
+            if (peek() == '?') {
+                repeat->_greedy = false;
+                _pos++;
+            }
+            repeat->_children.push_back(node);
+            node = repeat;
+        }
+        return node;
+    }
+
+    RegexNode *parse_concat()
+    {
+        RegexNode *node = new RegexNode(NODE_CONCAT);
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            RegexNode *child = parse_repeat();
+            if (!child) {
+                delete node;
+                return 0;
+            }
+            node->_children.push_back(child);
+        }
+        return node;
+    }
+
+    RegexNode *parse_alt()
+    {
+        RegexNode *node = parse_concat();
+        if (!node || peek() != '|') {
+            return node;
+        }
+        RegexNode *alt = new RegexNode(NODE_ALT);
+        alt->_children.push_back(node);
+        while (peek() == '|') {
+            _pos++;
+            RegexNode *child = parse_concat();
+            if (!child) {
+                delete alt;
+                return 0;
+            }
+            alt->_children.push_back(child);
+        }
+        return alt;
+    }
+
+public:
+    RegexParser(int len, const byte *pattern) : _pattern(pattern), _len(len), _pos(0), _num_groups(0), _ignore_case(false) {}
+
+    RegexNode *parse()
+    {
+        RegexNode *node = parse_alt();
+        if (node && !at_end()) {
+            delete node;
+            return fail("unmatched )");
+        }
+        return node;
+    }
+
+    int get_num_groups() const { return _num_groups; }
+    const string &get_error() const { return _error; }
+};
+
+/*
+ * Number of instructions that Regex::compile() emits for node, or MAX_PROGRAM_SIZE + 1 if 
+ *  it is more than MAX_PROGRAM_SIZE. The widths and fixed items of a node that fits are no
+ *  bigger than this
+ */
+static long long get_program_size(const RegexNode *node)
+{
+    long long size = 0;
+    switch (node->_type) {
+    case NODE_EMPTY:
+        break;
+    case NODE_BYTE:
+    case NODE_CLASS:
+        size = 1;
+        break;
+    case NODE_GROUP:
+        size = get_program_size(node->_children[0]) + (node->_group ? 2 : 0);
+        break;
+    case NODE_CONCAT:
+    case NODE_ALT:
+        for (vector<RegexNode *>::const_iterator it = node->_children.begin(); it != node->_children.end() && size <= MAX_PROGRAM_SIZE; it++) {
+            size += get_program_size(*it);
+        }
+        if (node->_type == NODE_ALT) {
+            // A SPLIT and a JMP for each alternative but the last
+            size += 2 * ((long long)node->_children.size() - 1);
+        }
+        break;
+    case NODE_REPEAT: {
+        long long child = get_program_size(node->_children[0]);
+        size = node->_min * child;
+        if (node->_max < 0) {
+            size += child + 2;
+        } else {
+            size += (node->_max - node->_min) * (child + 1);
+        }
+        break;
+    }
+    }
+    return size <= MAX_PROGRAM_SIZE ? size : MAX_PROGRAM_SIZE + 1;
+}
+
+/*
+ * Compute the shortest and longest match widths of node. *max is -1 for unbounded.
+ */
+static void get_widths(const RegexNode *node, int *min, int *max)
+{
+    switch (node->_type) {
+    case NODE_EMPTY:
+        *min = *max = 0;
+        return;
+    case NODE_BYTE:
+    case NODE_CLASS:
+        *min = *max = 1;
+        return;
+    case NODE_GROUP:
+        get_widths(node->_children[0], min, max);
+        return;
+    case NODE_CONCAT:
+        *min = *max = 0;
+        for (vector<RegexNode *>::const_iterator it = node->_children.begin(); it != node->_children.end(); it++) {
+            int cmin, cmax;
+            get_widths(*it, &cmin, &cmax);
+            *min += cmin;
+            *max = (*max < 0 || cmax < 0) ? -1 : *max + cmax;
+        }
+        return;
+    case NODE_ALT:
+        for (int i = 0; i < (int)node->_children.size(); i++) {
+            int cmin, cmax;
+            get_widths(node->_children[i], &cmin, &cmax);
+            if (i == 0) {
+                *min = cmin;
+                *max = cmax;
+            } else {
+                *min = cmin < *min ? cmin : *min;
+                *max = (*max < 0 || cmax < 0) ? -1 : (cmax > *max ? cmax : *max);
+            }
+        }
+        return;
+    case NODE_REPEAT: {
+        int cmin, cmax;
+        get_widths(node->_children[0], &cmin, &cmax);
+        *min = cmin * node->_min;
+        *max = (cmax < 0 || node->_max < 0) ? -1 : cmax * node->_max;
+        return;
+    }
+    }
+}
+
+/*
+ * An element of the fixed-offset prefix of a regex: a known byte (>= 0) or -width for a
+ *  run of width unknown bytes
+ */
+typedef vector<int> FixedItems;
+
+/*
+ * Return the known byte that a class matches: its only byte or, with a byte_map, the byte 
+ *  that all of its bytes and no others map to. Mapped through byte_map.
+ * Returns: -1 if there is none
+ */
+static int get_class_byte(const byte *bits, const byte *byte_map)
+{
+    int last = 0;
+    if (class_count(bits, &last) == 1) {
+        return byte_map ? byte_map[last] : last;
+    }
+    if (!byte_map) {
+        return -1;
+    }
+    int mapped = byte_map[last];
+    for (int b = 0; b < 256; b++) {
+        if (class_test(bits, b) != (byte_map[b] == mapped)) {
+            return -1;
+        }
+    }
+    return mapped;
+}
+
+/*
+ * Append the fixed-offset items of node, mapped through byte_map if it is given, to items.
+ * Returns: true if everything after node is still at a fixed offset
+ */
+static bool get_fixed_items(const RegexNode *node, const byte *byte_map, FixedItems &items)
+{
+    switch (node->_type) {
+    case NODE_EMPTY:
+        return true;
+    case NODE_BYTE:
+        items.push_back(byte_map ? byte_map[node->_byte] : node->_byte);
+        return true;
+    case NODE_CLASS:
+        items.push_back(get_class_byte(node->_bits, byte_map));
+        return true;
+    case NODE_GROUP:
+        return get_fixed_items(node->_children[0], byte_map, items);
+    case NODE_CONCAT:
+        for (vector<RegexNode *>::const_iterator it = node->_children.begin(); it != node->_children.end(); it++) {
+            if (!get_fixed_items(*it, byte_map, items)) {
+                return false;
+            }
+        }
+        return true;
+    case NODE_ALT: {
+        int min, max;
+        get_widths(node, &min, &max);
+        if (min != max) {
+            return false;
+        }
+        // A run of no bytes, e.g. (?:|), must not split or pad the literals around it
+        if (min > 0) {
+            items.push_back(-min);
+        }
+        return true;
+    }
+    case NODE_REPEAT: {
+        const RegexNode *child = node->_children[0];
+        int cmin, cmax;
+        get_widths(child, &cmin, &cmax);
+        if (cmin != cmax) {
+            // Only the first repetition starts at a fixed offset
+            if (node->_min > 0) {
+                get_fixed_items(child, byte_map, items);
+            }
+            return false;
+        }
+        FixedItems child_items;
+        if (get_fixed_items(child, byte_map, child_items)) {
+            for (int i = 0; i < node->_min; i++) {
+                items.insert(items.end(), child_items.begin(), child_items.end());
+            }
+        } else if (cmin > 0 && node->_min > 0) {
+            // The child is a fixed width but has a variable repeat of nothing in it, e.g.
+            //  (?:a(?:){0,2}b), so its bytes are skipped rather than split up
+            items.push_back(-cmin * node->_min);
+        }
+        if (node->_max != node->_min) {
+            return false;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+/*
+ * Pike VM instructions
+ */
+enum RegexOp
+{
+    OP_BYTE,        // Match byte _arg
+    OP_CLASS,       // Match byte in class _arg
+    OP_SPLIT,       // Continue at _x (preferred) and _y
+    OP_JMP,         // Continue at _x
+    OP_SAVE,        // Save position in capture slot _arg
+    OP_MATCH        // Success
+};
+
+struct RegexInst
+{
+    int _op;
+    int _arg;
+    int _x, _y;
+};
+
+Regex::Regex() : _num_groups(0), _min_width(0), _max_width(0) {}
+
+Regex::~Regex() {}
+
+int Regex::emit(int op)
+{
+    RegexInst inst;
+    inst._op = op;
+    inst._arg = inst._x = inst._y = 0;
+    _program.push_back(inst);
+    return (int)_program.size() - 1;
+}
+
+int Regex::add_class(const byte *bits)
+{
+    int num_classes = (int)_classes.size() / CLASS_SIZE;
+    for (int i = 0; i < num_classes; i++) {
+        if (!memcmp(&_classes[i * CLASS_SIZE], bits, CLASS_SIZE)) {
+            return i;
+        }
+    }
+    _classes.insert(_classes.end(), bits, bits + CLASS_SIZE);
+    return num_classes;
+}
+
+void Regex::compile(const RegexNode *node)
+{
+    switch (node->_type) {
+    case NODE_EMPTY:
+        break;
+    case NODE_BYTE:
+        _program[emit(OP_BYTE)]._arg = node->_byte;
+        break;
+    case NODE_CLASS:
+        _program[emit(OP_CLASS)]._arg = add_class(node->_bits);
+        break;
+    case NODE_GROUP:
+        if (node->_group) {
+            _program[emit(OP_SAVE)]._arg = 2 * (node->_group - 1);
+        }
+        compile(node->_children[0]);
+        if (node->_group) {
+            _program[emit(OP_SAVE)]._arg = 2 * (node->_group - 1) + 1;
+        }
+        break;
+    case NODE_CONCAT:
+        for (vector<RegexNode *>::const_iterator it = node->_children.begin(); it != node->_children.end(); it++) {
+            compile(*it);
+        }
+        break;
+    case NODE_ALT: {
+        vector<int> jumps;
+        int num = (int)node->_children.size();
+        for (int i = 0; i < num; i++) {
+            if (i < num - 1) {
+                int split = emit(OP_SPLIT);
+                _program[split]._x = split + 1;
+                compile(node->_children[i]);
+                jumps.push_back(emit(OP_JMP));
+                _program[split]._y = (int)_program.size();
+            } else {
+                compile(node->_children[i]);
+            }
+        }
+        for (vector<int>::iterator it = jumps.begin(); it != jumps.end(); it++) {
+            _program[*it]._x = (int)_program.size();
+        }
+        break;
+    }
+    case NODE_REPEAT: {
+        const RegexNode *child = node->_children[0];
+        for (int i = 0; i < node->_min; i++) {
+            compile(child);
+        }
+        if (node->_max < 0) {
+            // child*
+            int split = emit(OP_SPLIT);
+            compile(child);
+            _program[emit(OP_JMP)]._x = split;
+            int body = split + 1, out = (int)_program.size();
+            _program[split]._x = node->_greedy ? body : out;
+            _program[split]._y = node->_greedy ? out : body;
+        } else {
+            // (child(child(child)?)?)?
+            vector<int> splits;
+            for (int i = node->_min; i < node->_max; i++) {
+                splits.push_back(emit(OP_SPLIT));
+                compile(child);
+            }
+            int out = (int)_program.size();
+            for (vector<int>::iterator it = splits.begin(); it != splits.end(); it++) {
+                int body = *it + 1;
+                _program[*it]._x = node->_greedy ? body : out;
+                _program[*it]._y = node->_greedy ? out : body;
+            }
+        }
+        break;
+    }
+    }
+}
+
+Regex *Regex::compile(int len, const byte *pattern, string *error, const byte *byte_map)
+{
+    RegexParser parser(len, pattern);
+    RegexNode *node = parser.parse();
+    if (!node) {
+        if (error) {
+            *error = parser.get_error();
+        }
+        return 0;
+    }
+    long long program_size = get_program_size(node);
+    if (program_size > MAX_PROGRAM_SIZE) {
+        if (error) {
+            *error = "pattern too large";
+        }
+        delete node;
+        return 0;
+    }
+
+    Regex *regex = new Regex();
+    regex->_pattern = vector<byte>(pattern, pattern + len);
+    regex->_num_groups = parser.get_num_groups();
+    get_widths(node, &regex->_min_width, &regex->_max_width);
+
+    // Split the fixed-offset prefix into runs of known bytes
+    FixedItems items;
+    get_fixed_items(node, byte_map, items);
+    int offset = 0;
+    for (int i = 0; i < (int)items.size(); i++) {
+        if (items[i] >= 0) {
+            if (i == 0 || items[i - 1] < 0) {
+                regex->_literals.push_back(RegexLiteral(offset));
+            }
+            regex->_literals.back()._bytes.push_back((byte)items[i]);
+            offset++;
+        } else {
+            offset += -items[i];
+        }
+    }
+
+    regex->_program.reserve((size_t)program_size + 1);
+    regex->compile(node);
+    regex->emit(OP_MATCH);
+    assert(regex->_program.size() == (size_t)program_size + 1);
+    delete node;
+    return regex;
+}
+
+/*
+ * A Pike VM thread list. Thread i is at instruction _pcs[i] and its capture slots are 
+ *  _caps[i * num_slots..(i + 1) * num_slots)
+ */
+struct RegexThreadList
+{
+    vector<int> _pcs;
+    vector<long long> _caps;
+    // _marks[pc] == pos if pc is already on the list for position pos
+    vector<size_t> _marks;
+
+    void clear()
+    {
+        _pcs.clear();
+        _caps.clear();
+    }
+};
+
+/*
+ * The thread lists of match_at(). Every filter hit runs a regex, so they are kept for each 
+ *  thread rather than allocated for each match
+ */
+struct RegexScratch
+{
+    RegexThreadList _current, _next;
+};
+
+static thread_local RegexScratch _scratch;
+
+/*
+ * Add thread pc to list, following JMP, SPLIT and SAVE instructions. caps are the thread's
+ *  num_slots capture slots. SAVE sets a slot while the instructions after it are added and 
+ *  then puts it back, so caps are only copied for the threads put on the list
+ */
+static void add_thread(const vector<RegexInst> &program, RegexThreadList &list, int pc, size_t pos,
+                       long long *caps, int num_slots)
+{
+    if (list._marks[pc] == pos) {
+        return;
+    }
+    list._marks[pc] = pos;
+    const RegexInst &inst = program[pc];
+    switch (inst._op) {
+    case OP_JMP:
+        add_thread(program, list, inst._x, pos, caps, num_slots);
+        break;
+    case OP_SPLIT:
+        add_thread(program, list, inst._x, pos, caps, num_slots);
+        add_thread(program, list, inst._y, pos, caps, num_slots);
+        break;
+    case OP_SAVE: {
+        long long saved = caps[inst._arg];
+        caps[inst._arg] = (long long)pos;
+        add_thread(program, list, pc + 1, pos, caps, num_slots);
+        caps[inst._arg] = saved;
+        break;
+    }
+    default:
+        list._pcs.push_back(pc);
+        list._caps.insert(list._caps.end(), caps, caps + num_slots);
+    }
+}
+
+bool Regex::match_at(size_t len, const byte *data, size_t offset, RegexResults *results) const
+{
+    results->_matched = false;
+    results->_offset = offset;
+    results->_len = 0;
+    results->_stream_offset = (long long)offset;
+    results->_groups.assign(2 * _num_groups, -1);
+    if (offset > len || len - offset < (size_t)_min_width) {
+        return false;
+    }
+
+    int num_insts = (int)_program.size();
+    int num_slots = 2 * _num_groups;
+    RegexThreadList &clist = _scratch._current, &nlist = _scratch._next;
+    clist.clear();
+    nlist.clear();
+    // Marks are positions so they never need to be cleared between steps
+    clist._marks.assign(num_insts, (size_t)-1);
+    nlist._marks.assign(num_insts, (size_t)-1);
+    add_thread(_program, clist, 0, offset, results->_groups.data(), num_slots);
+
+    for (size_t pos = offset; !clist._pcs.empty(); pos++) {
+        nlist.clear();
+        for (int i = 0; i < (int)clist._pcs.size(); i++) {
+            int pc = clist._pcs[i];
+            long long *thread_caps = clist._caps.data() + (size_t)i * num_slots;
+            const RegexInst &inst = _program[pc];
+            if (inst._op == OP_MATCH) {
+                // Higher priority threads have been processed. Lower ones are cut off.
+                results->_matched = true;
+                results->_len = pos - offset;
+                results->_groups.assign(thread_caps, thread_caps + num_slots);
+                break;
+            }
+            if (pos >= len) {
+                continue;
+            }
+            int c = data[pos];
+            bool ok = inst._op == OP_BYTE ? c == inst._arg
+                                          : class_test(&_classes[inst._arg * CLASS_SIZE], c);
+            if (ok) {
+                add_thread(_program, nlist, pc + 1, pos + 1, thread_caps, num_slots);
+            }
+        }
+        swap(clist, nlist);
+    }
+    return results->_matched;
+}
@@ -0,0 +1,131 @@
+#ifndef _ANCHORED_REGEX_H_
+#define _ANCHORED_REGEX_H_
+
+/*
+ * A small regular expression engine for the fastregex verification stage.
+ *
+ * The rolling hash tells us where a regex's static string is in the input, and therefore
+ *  where the regex must start. So all matching here is anchored: a Regex is only ever
+ *  asked "does this pattern match starting at exactly this offset?"
+ *
+ * Patterns are byte strings (binary data is the norm). Supported syntax
+ *      literals            abc, \. \* \\ etc
+ *      any byte            .
+ *      classes             [abc] [a-z] [^\x00-\x1f]
+ *      escapes             \xHH \n \r \t \e \0 \d \D \w \W \s \S
+ *      groups              ( )  (?: )
+ *      alternation         a|b
+ *      repetition          * + ? {m} {m,} {m,n} and lazy forms *? +? ?? {m,n}?
+ *      case insensitive    (?i) makes ASCII letters in the rest of the pattern match either case
+ *
+ * Matching uses a Pike VM so verification time is linear in the length of input examined.
+ *  Among alternatives the leftmost one wins (Perl semantics), not the longest.
+ */
+#include <stddef.h>
+#include <vector>
+#include <string>
+
+typedef unsigned char byte;
+
+/*
+ * A run of bytes that must occur in every match of a regex at a fixed offset from the
+ *  start of the match.
+ */
+struct RegexLiteral
+{
+    // Offset of the literal from the start of the match
+    int _offset;
+    // The literal bytes
+    std::vector<byte> _bytes;
+
+    RegexLiteral(int offset) : _offset(offset) {}
+    int get_len() const { return (int)_bytes.size(); }
+};
+
+/*
+ * Results of applying a Regex at an offset in some input.
+ */
+class RegexResults
+{
+public:
+    // Did the regex match?
+    bool _matched;
+    // Offset of start of match in input
+    size_t _offset;
+    // Length of the match
+    size_t _len;
+    // Offset of start of match in the whole stream when the input is part of a stream. 
+    //  Same as _offset otherwise
+    long long _stream_offset;
+    // _groups[2*i], _groups[2*i+1] are the start and end offsets of capture group i+1.
+    //  -1 if the group did not participate in the match
+    std::vector<long long> _groups;
+
+    RegexResults() : _matched(false), _offset(0), _len(0), _stream_offset(0) {}
+    int get_num_groups() const { return (int)_groups.size() / 2; }
+};
+
+struct RegexNode;
+struct RegexInst;
+
+class Regex
+{
+    // Pattern this regex was compiled from
+    std::vector<byte> _pattern;
+    // Compiled program for the Pike VM
+    std::vector<RegexInst> _program;
+    // Byte classes referenced by the program. 32 bytes (256 bits) each
+    std::vector<byte> _classes;
+    // Number of capture groups
+    int _num_groups;
+    // Shortest and longest possible matches. _max_width is -1 if unbounded
+    int _min_width, _max_width;
+    // Literals that occur at fixed offsets in every match
+    std::vector<RegexLiteral> _literals;
+
+    Regex();
+    void compile(const RegexNode *node);
+    int emit(int op);
+    int add_class(const byte *bits);
+
+public:
+    ~Regex();
+
+    /*
+     * Compile pattern into a Regex.
+     * Params:
+     *  byte_map: if given then the literals are of the bytes mapped through it. A class that is
+     *      exactly the bytes that byte_map maps to one byte, e.g. [Aa] when upper case maps to 
+     *      lower case, is then a known byte. Matching is not affected
+     * Returns: The compiled Regex or 0 if the pattern is not valid or its expanded 
+     *  repetitions are too large. If error is non-null then a description of the problem is
+     *  written to it.
+     */
+    static Regex *compile(int len, const byte *pattern, std::string *error = 0, const byte *byte_map = 0);
+
+    /*
+     * Match the regex at exactly offset in data[0..len)
+     * Params:
+     *  len: length of data
+     *  data: input
+     *  offset: offset in data where the match must start
+     *  results: filled in with the match details
+     * Returns: true if there is a match
+     * The Pike VM's thread lists are kept for the calling thread, so once they have grown
+     *  verifying a match does not allocate
+     */
+    bool match_at(size_t len, const byte *data, size_t offset, RegexResults *results) const;
+
+    int get_num_groups() const { return _num_groups; }
+    int get_min_width() const { return _min_width; }
+    int get_max_width() const { return _max_width; }
+    const std::vector<byte> &get_pattern() const { return _pattern; }
+
+    /*
+     * Literals that occur at fixed offsets from the start of every match, in order of offset.
+     *  Mapped through the byte_map passed to compile()
+     */
+    const std::vector<RegexLiteral> &get_literals() const { return _literals; }
+};
+
+#endif // _ANCHORED_REGEX_H_
@@ -0,0 +1,287 @@
+/*
+ * Tests of the anchored regex engine: syntax, matching, captures, widths and the literals
+ *  that the fastregex prefilter hashes on
+ */
+#include <string.h>
+#include <string>
+#include <vector>
+#include "anchored_regex.h"
+#include "rough_plan.h"
+#include "unit_test.h"
+
+using namespace std;
+
+static Regex *compile_string(const char *pattern, string *error = 0, const byte *byte_map = 0)
+{
+    return Regex::compile((int)strlen(pattern), (const byte *)pattern, error, byte_map);
+}
+
+/*
+ * pattern is matched at offset in input. len is the length of the match or -1 for no match
+ */
+struct MatchCase
+{
+    const char *_pattern;
+    const char *_input;
+    int _offset;
+    int _len;
+};
+
+static const MatchCase MATCH_CASES[] = {
+    // Literals and anchoring
+    { "abc", "abc", 0, 3 },
+    { "abc", "abd", 0, -1 },
+    { "abc", "xabc", 1, 3 },
+    { "abc", "xabc", 0, -1 },
+    { "abc", "ab", 0, -1 },
+    // Escapes
+    { "a\\.b", "a.b", 0, 3 },
+    { "a\\.b", "axb", 0, -1 },
+    { "\\x41\\x62", "Ab", 0, 2 },
+    { "a\\tb\\n", "a\tb\n", 0, 4 },
+    { "\\e", "\x1b", 0, 1 },
+    { "\\d\\d", "42", 0, 2 },
+    { "\\d", "x", 0, -1 },
+    { "\\D", "x", 0, 1 },
+    { "\\w+", "ab_9 ", 0, 4 },
+    { "\\W", "_", 0, -1 },
+    { "\\s\\S", " x", 0, 2 },
+    // Any byte and classes
+    { "a.c", "a\nc", 0, 3 },
+    { "[abc]+", "cabd", 0, 3 },
+    { "[a-c]+", "abcd", 0, 3 },
+    { "[^a-c]+", "xyza", 0, 3 },
+    { "[^\\x00-\\x1f]+", "ab\x01", 0, 2 },
+    { "[]a]+", "]a]b", 0, 3 },
+    { "[a\\-z]+", "a-zb", 0, 3 },
+    { "[\\d_]+", "1_2x", 0, 3 },
+    // Groups and alternation. The leftmost alternative wins
+    { "(ab)+", "ababa", 0, 4 },
+    { "(?:ab)+c", "ababc", 0, 5 },
+    { "a|ab", "ab", 0, 1 },
+    { "ab|a", "ab", 0, 2 },
+    { "x(a|bc|d)y", "xbcy", 0, 4 },
+    { "x(a|bc|d)y", "xey", 0, -1 },
+    { "abcde(?:|)fgh", "abcdefgh", 0, 8 },
+    { "ab(|)cd", "abcd", 0, 4 },
+    // Repetition
+    { "a*", "aaab", 0, 3 },
+    { "a*", "b", 0, 0 },
+    { "a+", "b", 0, -1 },
+    { "a?b", "ab", 0, 2 },
+    { "a?b", "b", 0, 1 },
+    { "a{3}", "aaaa", 0, 3 },
+    { "a{3}", "aa", 0, -1 },
+    { "a{2,}", "aaaaa", 0, 5 },
+    { "a{2,3}", "aaaa", 0, 3 },
+    { "a{2,3}?", "aaaa", 0, 2 },
+    { "a*?b", "aab", 0, 3 },
+    { "a+?", "aaa", 0, 1 },
+    { "a??", "a", 0, 0 },
+    // Braces that are not a quantifier are literal
+    { "a{,3}", "a{,3}", 0, 5 },
+    { "a{x}", "a{x}", 0, 4 },
+    // Nested repetition
+    { "a{2}{3}", "aaaaaaa", 0, 6 },
+    { "(?:a{2}){3}", "aaaaa", 0, -1 },
+    { "(ab{2}){2}", "abbabbab", 0, 6 },
+    { "(a|b){2}{2}", "abbac", 0, 4 },
+    { "(?:a+)+b", "aaab", 0, 4 },
+    { "(?:a*)*b", "b", 0, 1 },
+    { "((a)|b)*c", "abac", 0, 4 },
+    // Fixed width children that contain a variable repeat of nothing
+    { "x(?:()?){3}abcde", "xabcde", 0, 6 },
+    { "abcde(?:(?:){0,3}){2}", "abcdef", 0, 5 },
+    { "(?:(?:){1,2}){2}abcdef", "abcdef", 0, 6 },
+    { "ab(?:c(?:){0,2}d){2}efg", "abcdcdefg", 0, 9 },
+    // Case insensitivity from (?i) to the end of the pattern
+    { "(?i)hello", "HeLLo", 0, 5 },
+    { "(?i)[a-c]+", "AbCd", 0, 3 },
+    { "(?i)\\x41", "a", 0, 1 },
+    { "ab(?i)cd", "abCD", 0, 4 },
+    { "ab(?i)cd", "ABcd", 0, -1 },
+};
+
+static void test_match_cases()
+{
+    int num_cases = (int)(sizeof(MATCH_CASES) / sizeof(MATCH_CASES[0]));
+    for (int i = 0; i < num_cases; i++) {
+        const MatchCase &c = MATCH_CASES[i];
+        unit_note(string("pattern ") + c._pattern + " on " + c._input);
+        string error;
+        Regex *regex = compile_string(c._pattern, &error);
+        if (!CHECK(regex != 0)) {
+            continue;
+        }
+        RegexResults results;
+        bool matched = regex->match_at(strlen(c._input), (const byte *)c._input, c._offset, &results);
+        CHECK(matched == (c._len >= 0));
+        CHECK(results._matched == matched);
+        if (matched) {
+            CHECK(results._offset == (size_t)c._offset);
+            CHECK(results._len == (size_t)c._len);
+        }
+        delete regex;
+    }
+}
+
+static void test_binary_input()
+{
+    unit_note("binary input");
+    Regex *regex = compile_string("a\\0b\\xff");
+    const byte input[] = { 'a', 0, 'b', 0xff };
+    RegexResults results;
+    CHECK(regex && regex->match_at(sizeof(input), input, 0, &results) && results._len == 4);
+    // Offsets past the end never match
+    CHECK(regex && !regex->match_at(sizeof(input), input, sizeof(input) + 1, &results));
+    delete regex;
+}
+
+static void test_captures()
+{
+    unit_note("captures");
+    Regex *regex = compile_string("(a)(b)?(c)");
+    RegexResults results;
+    CHECK(regex && regex->get_num_groups() == 3);
+    CHECK(regex && regex->match_at(2, (const byte *)"ac", 0, &results));
+    CHECK(results.get_num_groups() == 3);
+    if (results.get_num_groups() == 3) {
+        CHECK(results._groups[0] == 0 && results._groups[1] == 1);
+        CHECK(results._groups[2] == -1 && results._groups[3] == -1);
+        CHECK(results._groups[4] == 1 && results._groups[5] == 2);
+    }
+    delete regex;
+
+    regex = compile_string("x(a|bc|d)y");
+    CHECK(regex && regex->match_at(5, (const byte *)"_xbcy", 1, &results));
+    CHECK(results._groups.size() == 2 && results._groups[0] == 2 && results._groups[1] == 4);
+    delete regex;
+
+    // The last iteration of a repeated group is captured
+    regex = compile_string("(ab)+");
+    CHECK(regex && regex->match_at(6, (const byte *)"ababab", 0, &results));
+    CHECK(results._groups.size() == 2 && results._groups[0] == 4 && results._groups[1] == 6);
+    delete regex;
+}
+
+static void test_widths()
+{
+    struct WidthCase { const char *_pattern; int _min, _max; };
+    static const WidthCase cases[] = {
+        { "abc", 3, 3 },
+        { "ab{2,5}c", 4, 7 },
+        { "a*b", 1, -1 },
+        { "(a|bcd)", 1, 3 },
+        { "(?:ab){2}{3}", 12, 12 },
+        { "(?i)x?", 0, 1 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        unit_note(string("widths of ") + cases[i]._pattern);
+        Regex *regex = compile_string(cases[i]._pattern);
+        CHECK(regex && regex->get_min_width() == cases[i]._min && regex->get_max_width() == cases[i]._max);
+        delete regex;
+    }
+}
+
+/*
+ * Literals of pattern as "offset:bytes offset:bytes"
+ */
+static string get_literals(const char *pattern, const byte *byte_map = 0)
+{
+    Regex *regex = compile_string(pattern, 0, byte_map);
+    if (!regex) {
+        return "invalid";
+    }
+    string s;
+    const vector<RegexLiteral> &literals = regex->get_literals();
+    for (vector<RegexLiteral>::const_iterator it = literals.begin(); it != literals.end(); it++) {
+        if (!s.empty()) {
+            s += " ";
+        }
+        s += to_string(it->_offset) + ":" + string(it->_bytes.begin(), it->_bytes.end());
+    }
+    delete regex;
+    return s;
+}
+
+static void test_literals()
+{
+    unit_note("literals");
+    CHECK(get_literals("abcdef") == "0:abcdef");
+    CHECK(get_literals("abc.{2}defgh") == "0:abc 5:defgh");
+    CHECK(get_literals("ab(c|d)efghi") == "0:ab 3:efghi");
+    CHECK(get_literals("x{3}yz") == "0:xxxyz");
+    CHECK(get_literals("(?:ab){2}cd") == "0:ababcd");
+    // Only the first repetition of a variable width repeat is at a fixed offset
+    CHECK(get_literals("abc+def") == "0:abc");
+    CHECK(get_literals("(?:xy+)+z") == "0:xy");
+    CHECK(get_literals("a*bcdef") == "");
+    CHECK(get_literals("[Aa]bcde") == "1:bcde");
+    // Zero width alternations are not bytes
+    CHECK(get_literals("abcde(?:|)fgh") == "0:abcdefgh");
+    CHECK(get_literals("ab(|)cd(?:|)e") == "0:abcde");
+    CHECK(get_literals("ab(x|y)cd(|)efghi") == "0:ab 3:cdefghi");
+    CHECK(get_literals("x(?:()?){3}abcde") == "0:xabcde");
+    CHECK(get_literals("abcde(?:(?:){0,3}){2}") == "0:abcde");
+    CHECK(get_literals("(?:(?:){1,2}){2}abcdef") == "0:abcdef");
+    CHECK(get_literals("ab(?:c(?:){0,2}d){2}efg") == "0:ab 6:efg");
+
+    // With a byte_map, (?i) letters and classes that are exactly one byte's variants are
+    //  known bytes
+    const byte *fold = fastregex_get_case_fold_map();
+    CHECK(get_literals("(?i)Hello", fold) == "0:hello");
+    CHECK(get_literals("[Aa]bcde", fold) == "0:abcde");
+    CHECK(get_literals("[Ab]bcde", fold) == "1:bcde");
+    CHECK(get_literals("XYZ(?i)w", fold) == "0:xyzw");
+}
+
+static void test_errors()
+{
+    static const char *bad[] = {
+        "(", "(a", "a)", "[a", "*a", "a|+", "a{5,3}", "a{1001}", "\\x4", "\\", "(?x)", "[z-a]",
+        // Nested repetitions that expand to too many instructions
+        "a{1000}{1000}", "a{1000}{1000}{1000}", "(?:a{100}|b){100}{100}", "(?:(?:a{1000}){1000}){1000}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        unit_note(string("invalid pattern ") + bad[i]);
+        string error;
+        Regex *regex = compile_string(bad[i], &error);
+        CHECK(regex == 0);
+        CHECK(!error.empty());
+        delete regex;
+    }
+}
+
+static void test_large_programs()
+{
+    // Big but within the limit
+    unit_note("large programs");
+    Regex *regex = compile_string("a{1000}{60}b");
+    CHECK(regex != 0);
+    string input(60000, 'a');
+    input += "b";
+    RegexResults results;
+    CHECK(regex && regex->match_at(input.size(), (const byte *)input.data(), 0, &results) && results._len == input.size());
+    CHECK(regex && !regex->match_at(input.size() - 2, (const byte *)input.data(), 0, &results));
+    delete regex;
+
+    // Results are reused between regexes with different numbers of groups
+    regex = compile_string("[^x]{0,1000}(y)(z)?");
+    CHECK(regex && regex->match_at(5, (const byte *)"abcyz", 0, &results));
+    CHECK(results._len == 5 && results._groups.size() == 4 && results._groups[0] == 3 && results._groups[3] == 5);
+    delete regex;
+    regex = compile_string("ab");
+    CHECK(regex && regex->match_at(2, (const byte *)"ab", 0, &results) && results._groups.empty());
+    delete regex;
+}
+
+void test_anchored_regex()
+{
+    test_match_cases();
+    test_binary_input();
+    test_captures();
+    test_widths();
+    test_literals();
+    test_errors();
+    test_large_programs();
+}
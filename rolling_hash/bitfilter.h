@@ -0,0 +1,79 @@
+#ifndef _BITFILTER_H_
+#define _BITFILTER_H_
+
+#include <vector>
+#include "characterhash.h"
+
+/*
+ * A "needs action" table with one bit per hash value.
+ *
+ * For the default 19 bit hash this is 64 KB so it stays in L2 cache while the rolling hash
+ *  runs over the input. The bits are stored in 64 bit words so that the number of set bits
+ *  below a given hash value (its rank) can be computed with a popcount. The rank is what
+ *  indexes the action table.
+ */
+class BitFilter
+{
+    std::vector<uint64> _words;
+    // _ranks[i] is number of bits set in _words[0..i)
+    std::vector<uint32> _ranks;
+    const int _wordsize;
+
+public:
+    BitFilter(int wordsize) :
+        _words((((size_t)1 << wordsize) + 63) / 64, 0),
+        _ranks(_words.size() + 1, 0),
+        _wordsize(wordsize)
+    {}
+
+    int get_wordsize() const { return _wordsize; }
+    const uint64 *get_words() const { return &_words[0]; }
+
+    void set(hashvaluetype h)
+    {
+        _words[h >> 6] |= (uint64)1 << (h & 63);
+    }
+
+    bool test(hashvaluetype h) const
+    {
+        return ((_words[h >> 6] >> (h & 63)) & 1) != 0;
+    }
+
+    /*
+     * Compute the ranks. Must be called after the last set() and before rank()
+     */
+    void build_ranks()
+    {
+        for (size_t i = 0; i < _words.size(); i++) {
+            _ranks[i + 1] = _ranks[i] + popcount(_words[i]);
+        }
+    }
+
+    /*
+     * Return the number of bits set in the filter below h
+     */
+    uint32 rank(hashvaluetype h) const
+    {
+        uint64 below = _words[h >> 6] & (((uint64)1 << (h & 63)) - 1);
+        return _ranks[h >> 6] + popcount(below);
+    }
+
+    /*
+     * Return total number of bits set
+     */
+    uint32 count() const { return _ranks[_words.size()]; }
+
+    static uint32 popcount(uint64 x)
+    {
+#if defined(__GNUC__)
+        return (uint32)__builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return (uint32)((x * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+};
+
+#endif // _BITFILTER_H_
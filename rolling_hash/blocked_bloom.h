@@ -0,0 +1,100 @@
+#ifndef _BLOCKED_BLOOM_H_
+#define _BLOCKED_BLOOM_H_
+
+/*
+ * A cache-line-blocked Bloom filter over 64 bit fingerprints.
+ *
+ * The 1 bit per hash value BitFilter fills up when there are thousands of static strings:
+ *  with 5000 strings in a 19 bit filter 1 offset in 100 is a hit and most of those are
+ *  false. This filter is a second check on the BitFilter hits. It is keyed on a 64 bit
+ *  fingerprint of the static string so its false positive rate depends only on the number
+ *  of bits per key, not on the rolling hash wordsize.
+ *
+ * Each key sets NUM_PROBES bits in one 512 bit block, so a test touches one cache line.
+ */
+#include <string.h>
+#include <vector>
+#include "characterhash.h"
+#include "byteview.h"
+
+class BlockedBloomFilter
+{
+    // 64 byte blocks, 8 words each
+    enum { WORDS_PER_BLOCK = 8 };
+    enum { NUM_PROBES = 8 };
+    enum { BITS_PER_KEY = 16 };
+
+    std::vector<uint64> _words;
+    // Number of blocks - 1. A power of 2 - 1
+    uint64 _block_mask;
+
+    const uint64 *get_block(uint64 fingerprint) const
+    {
+        return &_words[(size_t)((fingerprint >> 32) & _block_mask) * WORDS_PER_BLOCK];
+    }
+
+public:
+    /*
+     * Make a filter big enough for num_keys keys
+     */
+    BlockedBloomFilter(size_t num_keys)
+    {
+        size_t num_blocks = 1;
+        while (num_blocks * WORDS_PER_BLOCK * 64 < num_keys * BITS_PER_KEY) {
+            num_blocks <<= 1;
+        }
+        _words.assign(num_blocks * WORDS_PER_BLOCK, 0);
+        _block_mask = num_blocks - 1;
+    }
+
+    void add(uint64 fingerprint)
+    {
+        uint64 *block = (uint64 *)get_block(fingerprint);
+        // Each probe uses the next 9 bits of the low 32 bits, then of a remix of them
+        uint64 bits = fingerprint;
+        for (int i = 0; i < NUM_PROBES; i++) {
+            uint32 bit = (uint32)(bits & 511);
+            block[bit >> 6] |= (uint64)1 << (bit & 63);
+            bits = i == 2 ? (fingerprint * 0x9e3779b97f4a7c15ULL) >> 16 : bits >> 9;
+        }
+    }
+
+    bool test(uint64 fingerprint) const
+    {
+        const uint64 *block = get_block(fingerprint);
+        uint64 bits = fingerprint;
+        for (int i = 0; i < NUM_PROBES; i++) {
+            uint32 bit = (uint32)(bits & 511);
+            if (!((block[bit >> 6] >> (bit & 63)) & 1)) {
+                return false;
+            }
+            bits = i == 2 ? (fingerprint * 0x9e3779b97f4a7c15ULL) >> 16 : bits >> 9;
+        }
+        return true;
+    }
+
+    /*
+     * 64 bit fingerprint of data[0..len). Strings that are not equal almost never have the same
+     *  fingerprint. Not a rolling hash; it is only computed for BitFilter hits
+     */
+    static uint64 fingerprint(const byte *data, int len)
+    {
+        uint64 h = (uint64)len * 0x9e3779b97f4a7c15ULL;
+        int k = 0;
+        for (; k + 8 <= len; k += 8) {
+            uint64 word;
+            memcpy(&word, data + k, 8);
+            h = (h ^ word) * 0xff51afd7ed558ccdULL;
+            h ^= h >> 32;
+        }
+        uint64 word = 0;
+        memcpy(&word, data + k, len - k);
+        h = (h ^ word) * 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+#endif // _BLOCKED_BLOOM_H_
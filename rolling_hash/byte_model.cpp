@@ -0,0 +1,110 @@
+#include <math.h>
+#include <iostream>
+#include <fstream>
+#include "byte_model.h"
+
+using namespace std;
+
+// First line of a saved model
+static const char *MODEL_HEADER = "fastregex-byte-model 1";
+
+ByteModel::ByteModel() : _unigrams(256), _bigrams(256 * 256), _total(0)
+{
+}
+
+void ByteModel::add(ByteView sample)
+{
+    const byte *data = sample.get_data();
+    size_t len = sample.get_len();
+    for (size_t i = 0; i < len; i++) {
+        _unigrams[data[i]]++;
+    }
+    for (size_t i = 0; i + 1 < len; i++) {
+        _bigrams[data[i] * 256 + data[i + 1]]++;
+    }
+    _total += (long long)len;
+}
+
+double ByteModel::get_log_prob(const byte *s, int len) const
+{
+    if (len <= 0) {
+        return 0.0;
+    }
+    double log_prob = log2((double)(_unigrams[s[0]] + 1) / (double)(_total + 256));
+    for (int i = 1; i < len; i++) {
+        log_prob += log2((double)(_bigrams[s[i - 1] * 256 + s[i]] + 1) / (double)(_unigrams[s[i - 1]] + 256));
+    }
+    return log_prob;
+}
+
+/*
+ * The format is the header line, the total, then a line for each byte and pair of bytes that
+ *  was seen
+ *      u <byte> <count>
+ *      b <byte> <byte> <count>
+ */
+bool ByteModel::save(const string &path) const
+{
+    ofstream f(path.c_str());
+    if (!f) {
+        cerr << "Could not create " << path << endl;
+        return false;
+    }
+    f << MODEL_HEADER << "\n" << _total << "\n";
+    for (int c = 0; c < 256; c++) {
+        if (_unigrams[c]) {
+            f << "u " << c << " " << _unigrams[c] << "\n";
+        }
+    }
+    for (int c = 0; c < 256 * 256; c++) {
+        if (_bigrams[c]) {
+            f << "b " << c / 256 << " " << c % 256 << " " << _bigrams[c] << "\n";
+        }
+    }
+    f.close();
+    if (!f) {
+        cerr << "Could not write " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool ByteModel::load(const string &path)
+{
+    ifstream f(path.c_str());
+    if (!f) {
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+    string header;
+    getline(f, header);
+    vector<long long> unigrams(256), bigrams(256 * 256);
+    long long total = -1;
+    bool ok = header == MODEL_HEADER && (f >> total) && total >= 0;
+    string kind;
+    while (ok && f >> kind) {
+        int a = -1, b = 0;
+        long long count = -1;
+        if (kind == "u") {
+            ok = (f >> a >> count) && a >= 0 && a < 256 && count >= 0;
+            if (ok) {
+                unigrams[a] = count;
+            }
+        } else if (kind == "b") {
+            ok = (f >> a >> b >> count) && a >= 0 && a < 256 && b >= 0 && b < 256 && count >= 0;
+            if (ok) {
+                bigrams[a * 256 + b] = count;
+            }
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        cerr << path << " is not a byte model" << endl;
+        return false;
+    }
+    _unigrams.swap(unigrams);
+    _bigrams.swap(bigrams);
+    _total = total;
+    return true;
+}
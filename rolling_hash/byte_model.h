@@ -0,0 +1,55 @@
+#ifndef _BYTE_MODEL_H_
+#define _BYTE_MODEL_H_
+
+#include <string>
+#include <vector>
+#include "byteview.h"
+
+/*
+ * Byte and bigram frequencies of a sample of the input.
+ *
+ * Used to estimate how often a string occurs in the input so that fastregex_init() can hash
+ *  each regex on its rarest window rather than the first bytes of its longest literal. In
+ *  printer spool data the longest literal is often mostly ESC sequences and padding that
+ *  occur everywhere, so every occurrence of them is a filter hit and a regex run.
+ *
+ * A string s is estimated to start at an offset with probability
+ *  p(s[0]) * p(s[1] | s[0]) * ... * p(s[n-1] | s[n-2])
+ *  with add-one smoothing so bytes not seen in the sample are rare, not impossible.
+ *
+ * The model is built once from a sample and saved with the rules so that it does not have to
+ *  be rebuilt each time the rules are loaded.
+ */
+class ByteModel
+{
+    // Number of times each byte and each pair of bytes occur in the samples
+    std::vector<long long> _unigrams;
+    std::vector<long long> _bigrams;
+    long long _total;
+
+public:
+    ByteModel();
+
+    /*
+     * Count the bytes and bigrams in sample. Can be called on several samples. Bigrams that
+     *  straddle samples are not counted
+     */
+    void add(ByteView sample);
+
+    bool is_empty() const { return _total == 0; }
+
+    /*
+     * Estimated log2 probability that the len bytes at s start at an offset of the input.
+     *  The lower it is the rarer s is
+     */
+    double get_log_prob(const byte *s, int len) const;
+
+    /*
+     * Save the counts as text to path, or load them from a file written by save()
+     * Returns: false and writes a message to cerr if the file could not be written or read
+     */
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+};
+
+#endif // _BYTE_MODEL_H_
@@ -0,0 +1,129 @@
+/*
+ * Tests of ByteModel: the estimates follow the sample, a saved model loads back the same and
+ *  files that are not byte models are rejected without changing the model.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "byte_model.h"
+#include "unit_test.h"
+
+using namespace std;
+
+// Bytes of the sample the model is built from
+static const size_t NUM_SAMPLE_CHARS = 100000;
+
+/*
+ * Random lower case letters with a common phrase in them
+ */
+static vector<byte> make_sample(size_t len)
+{
+    static const char phrase[] = "\x1b&l0O";
+    mt19937 rng(18);
+    vector<byte> sample;
+    sample.reserve(len + sizeof(phrase));
+    while (sample.size() < len) {
+        if (rng() % 20 == 0) {
+            sample.insert(sample.end(), phrase, phrase + sizeof(phrase) - 1);
+        } else {
+            sample.push_back((byte)('a' + rng() % 26));
+        }
+    }
+    sample.resize(len);
+    return sample;
+}
+
+/*
+ * Do a and b give the same estimates for every byte and pair of bytes?
+ */
+static bool same_model(const ByteModel &a, const ByteModel &b)
+{
+    if (a.is_empty() != b.is_empty()) {
+        return false;
+    }
+    for (int c = 0; c < 256 * 256; c++) {
+        byte s[2] = { (byte)(c / 256), (byte)(c % 256) };
+        if (a.get_log_prob(s, 1) != b.get_log_prob(s, 1) || a.get_log_prob(s, 2) != b.get_log_prob(s, 2)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_estimates(const ByteModel &model)
+{
+    unit_note("byte model estimates");
+    const byte *common = (const byte *)"\x1b&l0O";
+    const byte *rare = (const byte *)"qzxjk";
+    const byte *unseen = (const byte *)"\x01\x02\x03\x04\x05";
+    CHECK(!model.is_empty());
+    CHECK(model.get_log_prob(common, 5) < 0.0);
+    CHECK(model.get_log_prob(common, 5) > model.get_log_prob(rare, 5));
+    CHECK(model.get_log_prob(rare, 5) > model.get_log_prob(unseen, 5));
+    CHECK(model.get_log_prob(common, 0) == 0.0);
+    CHECK(model.get_log_prob(common, 3) > model.get_log_prob(common, 5));
+    CHECK(ByteModel().is_empty());
+}
+
+static void test_save_load(const ByteModel &model)
+{
+    string path = unit_temp_path("byte_model");
+    unit_note("byte model save and load");
+    CHECK(model.save(path));
+    ByteModel loaded;
+    CHECK(loaded.load(path));
+    CHECK(same_model(model, loaded));
+
+    unit_note("empty byte model save and load");
+    ByteModel empty;
+    CHECK(empty.save(path));
+    CHECK(loaded.load(path));
+    CHECK(loaded.is_empty() && same_model(empty, loaded));
+
+    unit_note("byte model load of a missing file");
+    remove(path.c_str());
+    CHECK(!loaded.load(path));
+    CHECK(!loaded.save(unit_temp_path("missing") + "/byte_model"));
+}
+
+/*
+ * Files that are not byte models fail to load and leave the model as it was
+ */
+static void test_corrupt_files(const ByteModel &model)
+{
+    static const char *files[] = {
+        "",
+        "fastregex-byte-model 2\n10\n",
+        "fastregex-byte-model 1\n",
+        "fastregex-byte-model 1\n-1\n",
+        "fastregex-byte-model 1\n10\nu 97\n",
+        "fastregex-byte-model 1\n10\nu 256 3\n",
+        "fastregex-byte-model 1\n10\nu 97 -3\n",
+        "fastregex-byte-model 1\n10\nb 97 98\n",
+        "fastregex-byte-model 1\n10\nb 97 -1 3\n",
+        "fastregex-byte-model 1\n10\nu 97 3\nx 1 2\n",
+        "fastregex-byte-model 1\n10\nu 97 3\nb 97 98 1\ngarbage",
+    };
+    string path = unit_temp_path("byte_model");
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        unit_note("byte model load of corrupt file " + to_string(i));
+        CHECK(unit_write_file(path, ByteView((const byte *)files[i], strlen(files[i]))));
+        ByteModel loaded = model;
+        CHECK(!loaded.load(path));
+        CHECK(same_model(model, loaded));
+    }
+    remove(path.c_str());
+}
+
+void test_byte_model()
+{
+    vector<byte> sample = make_sample(NUM_SAMPLE_CHARS);
+    ByteModel model;
+    model.add(ByteView(&sample[0], sample.size() / 2));
+    model.add(ByteView(&sample[0] + sample.size() / 2, sample.size() - sample.size() / 2));
+    test_estimates(model);
+    test_save_load(model);
+    test_corrupt_files(model);
+}
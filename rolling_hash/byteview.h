@@ -0,0 +1,38 @@
+#ifndef _BYTEVIEW_H_
+#define _BYTEVIEW_H_
+
+#include <stddef.h>
+#include <cassert>
+
+typedef unsigned char byte;
+
+/*
+ * A non-owning view of some bytes. 
+ *
+ * This is what is passed around when processing input so that the input is never copied. 
+ *  The bytes must outlive the view.
+ */
+class ByteView
+{
+    const byte *_data;
+    size_t _len;
+public:
+    ByteView() : _data(0), _len(0) {}
+    ByteView(const byte *data, size_t len) : _data(data), _len(len) {}
+
+    size_t get_len() const  { return _len; }
+    const byte *get_data() const { return _data; }
+    bool empty() const { return _len == 0; }
+    byte operator[](size_t i) const { return _data[i]; }
+
+    /*
+     * Return the view of len bytes starting at offset. len is truncated to fit in this view
+     */
+    ByteView sub(size_t offset, size_t len) const 
+    {
+        assert(offset <= _len);
+        return ByteView(_data + offset, len < _len - offset ? len : _len - offset);
+    }
+};
+
+#endif // _BYTEVIEW_H_
@@ -26,17 +26,31 @@ public:
 };
 
 
+/*
+ * A random hash value for each byte.
+ *
+ * If byte_map is given then byte k gets the value of byte byte_map[k], so bytes that map to
+ *  the same byte, e.g. upper and lower case letters, hash the same and a rolling hash over 
+ *  them is a hash of the mapped bytes. byte_map[byte_map[k]] must be byte_map[k]. The bytes 
+ *  that map to themselves get the same values as without a map.
+ */
 struct CharacterHash 
 {
     enum { nbrofchars = 1 << (8*sizeof(chartype)) };
     hashvaluetype hashvalues[nbrofchars];
     
-    CharacterHash(uint32 maxval) 
+    CharacterHash(uint32 maxval, const chartype *byte_map = 0) 
     {
         mersenneRNG randomgenerator(maxval);
         for (int k = 0; k < nbrofchars; k++) {
   	    hashvalues[k] = randomgenerator();
         }
+        if (byte_map) {
+            for (int k = 0; k < nbrofchars; k++) {
+                assert(byte_map[byte_map[k]] == byte_map[k]);
+                hashvalues[k] = hashvalues[byte_map[k]];
+            }
+        }
     }
 };
 
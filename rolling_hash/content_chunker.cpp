@@ -0,0 +1,225 @@
+#include <limits.h>
+#include <iostream>
+#include "blocked_bloom.h"
+#include "content_chunker.h"
+
+using namespace std;
+
+// Windows are scanned for boundaries this many at a time. A chunk's first min_size bytes are
+//  skipped when they have not been scanned already, so a smaller block skips more, while each
+//  scan must be long enough for the lanes to be worth starting
+static const size_t CHUNK_SCAN_BLOCK = 1 << 14;
+
+// Normalization level. Before avg_size bytes a boundary needs this many more zero bits than
+//  log2(avg_size), and after it this many fewer
+static const int NORMALIZATION_BITS = 2;
+
+ContentChunker::ContentChunker() :
+    _min_size(0),
+    _avg_size(0),
+    _max_size(0),
+    _window(0),
+    _strict_bits(0),
+    _loose_bits(0),
+    _hash(0),
+    _filter(0),
+    _scanner(0),
+    _buffer_offset(0)
+{
+    init();
+}
+
+ContentChunker::~ContentChunker()
+{
+    delete _scanner;
+    delete _filter;
+    delete _hash;
+}
+
+bool ContentChunker::init(size_t min_size, size_t avg_size, size_t max_size, int window)
+{
+    if (!(min_size >= 1 && min_size <= avg_size && avg_size <= max_size)) {
+        cerr << "Chunk sizes must be 1 <= min_size <= avg_size <= max_size" << endl;
+        return false;
+    }
+    if (max_size > INT_MAX) {
+        cerr << "max_size must be less than 2 GB" << endl;
+        return false;
+    }
+    int bits = 0;
+    while (((size_t)2 << bits) <= avg_size) {
+        bits++;
+    }
+    int strict_bits = bits + NORMALIZATION_BITS;
+    int loose_bits = bits > NORMALIZATION_BITS ? bits - NORMALIZATION_BITS : 1;
+    // The hash is strict_bits wide, so a boundary before avg_size is a hash of zero
+    int wordsize = strict_bits > 8 ? strict_bits : 8;
+    if (wordsize > 30) {
+        cerr << "avg_size must be less than 256 MB" << endl;
+        return false;
+    }
+    if (window < 1 || window > 1024) {
+        cerr << "window must be in [1, 1024]" << endl;
+        return false;
+    }
+
+    delete _scanner;
+    delete _filter;
+    delete _hash;
+    _min_size = min_size;
+    _avg_size = avg_size;
+    _max_size = max_size;
+    _window = window;
+    _strict_bits = strict_bits;
+    _loose_bits = loose_bits;
+    _hash = new KarpRabinHash(window, wordsize);
+    _filter = new BitFilter(wordsize);
+    for (hashvaluetype h = 0; h < ((hashvaluetype)1 << (wordsize - loose_bits)); h++) {
+        _filter->set(h);
+    }
+    _filter->build_ranks();
+    _scanner = new MultiLaneScanner;
+    _scanner->add_window(*_hash, *_filter);
+    clear();
+    return true;
+}
+
+void ContentChunker::clear()
+{
+    _buffer.clear();
+    _buffer_offset = 0;
+    _stream = BoundaryScan();
+    _stream._scan_pos = _min_size;
+}
+
+/*
+ * Move the offsets down when the first offset bytes of the data have been dropped
+ */
+void ContentChunker::BoundaryScan::shift(size_t offset)
+{
+    _chunk_start -= offset;
+    _scan_pos -= offset;
+    _scanned_to = _scanned_to > offset ? _scanned_to - offset : 0;
+    vector<ScanCandidate> candidates;
+    for (size_t i = _next_candidate; i < _candidates.size(); i++) {
+        if (_candidates[i]._offset >= offset) {
+            candidates.push_back(_candidates[i]);
+            candidates.back()._offset -= offset;
+        }
+    }
+    _candidates.swap(candidates);
+    _next_candidate = 0;
+}
+
+/*
+ * Find the end of the chunk that starts at data[scan._chunk_start]
+ * Returns: the offset after the last byte of the chunk, or 0 if it does not end in
+ *  data[0..len) and at_end is false
+ */
+size_t ContentChunker::find_end(const byte *data, size_t len, bool at_end, BoundaryScan &scan) const
+{
+    size_t n = (size_t)_window;
+    size_t start = scan._chunk_start;
+    size_t limit = start + _max_size;
+    size_t avg_end = start + _avg_size;
+    size_t last = limit < len ? limit : len;
+    int shift = _hash->_wordsize - _strict_bits;
+
+    // A chunk can end after offset e if the window data[e - n, e) is a boundary
+    for (;;) {
+        while (scan._next_candidate < scan._candidates.size()) {
+            const ScanCandidate &candidate = scan._candidates[scan._next_candidate];
+            size_t end = candidate._offset + n;
+            if (end > last) {
+                // Kept for the next chunk
+                break;
+            }
+            scan._next_candidate++;
+            if (end >= scan._scan_pos && (end >= avg_end || (candidate._hash >> shift) == 0)) {
+                scan._scan_pos = end;
+                return end;
+            }
+        }
+        if (scan._next_candidate < scan._candidates.size()) {
+            break;
+        }
+        // Scan the next block of windows, skipping those that end in the first _min_size 
+        //  bytes of the chunk
+        size_t from = scan._scan_pos > n ? scan._scan_pos - n : 0;
+        from = from > scan._scanned_to ? from : scan._scanned_to;
+        if (from + n > last) {
+            break;
+        }
+        size_t to = from + CHUNK_SCAN_BLOCK < len - n + 1 ? from + CHUNK_SCAN_BLOCK : len - n + 1;
+        scan._candidates.clear();
+        scan._next_candidate = 0;
+        _scanner->scan(data, len, from, to, scan._candidates);
+        scan._scanned_to = to;
+    }
+    // Every end up to last has been checked. The first possible end may be later still
+    if (scan._scan_pos < last + 1) {
+        scan._scan_pos = last + 1;
+    }
+
+    if (limit <= len) {
+        return limit;
+    }
+    return at_end && len > start ? len : 0;
+}
+
+/*
+ * Append the chunks that end in data[0..len) to chunks
+ * Params:
+ *  at_end: data is the end of the stream so the last chunk ends at len
+ *  base: stream offset of data[0]
+ */
+void ContentChunker::cut(const byte *data, size_t len, bool at_end, long long base, BoundaryScan &scan,
+                         vector<ContentChunk> &chunks) const
+{
+    while (scan._chunk_start < len) {
+        size_t end = find_end(data, len, at_end, scan);
+        if (end == 0) {
+            break;
+        }
+        ContentChunk chunk;
+        chunk._offset = base + (long long)scan._chunk_start;
+        chunk._len = end - scan._chunk_start;
+        chunk._fingerprint = BlockedBloomFilter::fingerprint(data + scan._chunk_start, (int)chunk._len);
+        chunks.push_back(chunk);
+        scan._chunk_start = end;
+        scan._scan_pos = end + _min_size;
+    }
+}
+
+void ContentChunker::feed(ByteView data, vector<ContentChunk> &chunks)
+{
+    if (data.empty()) {
+        return;
+    }
+    _buffer.insert(_buffer.end(), data.get_data(), data.get_data() + data.get_len());
+    cut(&_buffer[0], _buffer.size(), false, _buffer_offset, _stream, chunks);
+
+    // Drop the bytes before the window of the current chunk's first possible end. Only when
+    //  they are at least half the buffer, so each byte is moved O(1) times
+    size_t keep = _stream._chunk_start > (size_t)_window ? _stream._chunk_start - (size_t)_window : 0;
+    if (keep > 0 && keep >= _buffer.size() / 2) {
+        _buffer.erase(_buffer.begin(), _buffer.begin() + keep);
+        _buffer_offset += (long long)keep;
+        _stream.shift(keep);
+    }
+}
+
+void ContentChunker::finish(vector<ContentChunk> &chunks)
+{
+    if (!_buffer.empty()) {
+        cut(&_buffer[0], _buffer.size(), true, _buffer_offset, _stream, chunks);
+    }
+    clear();
+}
+
+void ContentChunker::chunk(ByteView data, vector<ContentChunk> &chunks)
+{
+    BoundaryScan scan;
+    scan._scan_pos = _min_size;
+    cut(data.get_data(), data.get_len(), true, 0, scan, chunks);
+}
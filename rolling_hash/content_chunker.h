@@ -0,0 +1,140 @@
+#ifndef _CONTENT_CHUNKER_H_
+#define _CONTENT_CHUNKER_H_
+
+#include <vector>
+#include "byteview.h"
+#include "rabinkarphash.h"
+#include "bitfilter.h"
+#include "multilane_scanner.h"
+
+/*
+ * A chunk found by ContentChunker
+ */
+struct ContentChunk
+{
+    // Offset of the chunk in the stream
+    long long _offset;
+    size_t _len;
+    // 64 bit fingerprint of the chunk's bytes. Equal chunks have equal fingerprints and
+    //  different chunks almost never do
+    uint64 _fingerprint;
+
+    ContentChunk() : _offset(0), _len(0), _fingerprint(0) {}
+};
+
+/*
+ * Content-defined chunking with a rolling hash.
+ *
+ * A chunk ends after a window of _window bytes whose KarpRabinHash has its top bits all
+ *  zero, so the chunk boundaries depend only on the bytes near them. Inserting or deleting
+ *  bytes in a file only changes the chunks around the edit and the other chunks keep their
+ *  fingerprints, so near-identical files share most of their chunks and can be deduplicated
+ *  by fingerprint.
+ *
+ * Chunks are at least min_size and at most max_size bytes, except the last one of a stream.
+ *  The sizes are normalized as in FastCDC: before avg_size bytes a boundary needs 2 more zero
+ *  bits than log2(avg_size) and after it 2 fewer, so the chunk sizes cluster around avg_size
+ *  rather than spreading out exponentially. No boundary is looked for in the first min_size
+ *  bytes of a chunk.
+ *
+ * The boundary test is a MultiLaneScanner over a BitFilter of the hash values with the
+ *  looser number of top zero bits, so it is rolled 8 lanes at a time with AVX2 and the
+ *  stricter test is only applied to the candidates.
+ *
+ *      ContentChunker chunker;
+ *      chunker.init(2048, 8192, 65536);
+ *      vector<ContentChunk> chunks;
+ *      while (read data)
+ *          chunker.feed(data, chunks);     // appends the chunks that have ended
+ *      chunker.finish(chunks);             // appends the last chunk
+ *
+ * The boundaries are the same however the stream is split into feed() calls, and the same
+ *  on every run as the character hashes come from a fixed seed.
+ */
+class ContentChunker
+{
+public:
+    enum { DEFAULT_MIN_SIZE = 2 << 10 };
+    enum { DEFAULT_AVG_SIZE = 8 << 10 };
+    enum { DEFAULT_MAX_SIZE = 64 << 10 };
+    enum { DEFAULT_WINDOW = 48 };
+
+private:
+    size_t _min_size, _avg_size, _max_size;
+    int _window;
+    // Number of top zero bits a boundary needs before and after _avg_size bytes
+    int _strict_bits, _loose_bits;
+
+    KarpRabinHash *_hash;
+    BitFilter *_filter;
+    MultiLaneScanner *_scanner;
+
+    /*
+     * Where the search for boundaries in some data has got to. The boundaries passing the
+     *  loose test depend only on the bytes, so they are found a block at a time and kept 
+     *  for the following chunks rather than rescanned
+     */
+    struct BoundaryScan
+    {
+        // Start of the current chunk
+        size_t _chunk_start;
+        // Ends of the current chunk before this have been checked
+        size_t _scan_pos;
+        // Windows starting before this have been scanned. Candidates that have not been
+        //  used are _candidates[_next_candidate..]
+        size_t _scanned_to;
+        std::vector<ScanCandidate> _candidates;
+        size_t _next_candidate;
+
+        BoundaryScan() : _chunk_start(0), _scan_pos(0), _scanned_to(0), _next_candidate(0) {}
+        void shift(size_t offset);
+    };
+
+    // Bytes of the stream that are still needed: the current chunk and the _window bytes
+    //  before it
+    std::vector<byte> _buffer;
+    // Stream offset of _buffer[0]
+    long long _buffer_offset;
+    BoundaryScan _stream;
+
+    ContentChunker(const ContentChunker &);
+    ContentChunker &operator=(const ContentChunker &);
+
+    size_t find_end(const byte *data, size_t len, bool at_end, BoundaryScan &scan) const;
+    void cut(const byte *data, size_t len, bool at_end, long long base, BoundaryScan &scan,
+             std::vector<ContentChunk> &chunks) const;
+    void clear();
+
+public:
+    ContentChunker();
+    ~ContentChunker();
+
+    /*
+     * Set the chunk sizes and the length of the rolling hash window, and start a new stream
+     * Returns: false and writes a message to cerr if the sizes are out of order or out of range
+     */
+    bool init(size_t min_size = DEFAULT_MIN_SIZE, size_t avg_size = DEFAULT_AVG_SIZE,
+              size_t max_size = DEFAULT_MAX_SIZE, int window = DEFAULT_WINDOW);
+
+    /*
+     * Process the next bytes of the stream and append the chunks that end in them to chunks.
+     *  data only needs to stay valid for the duration of the call
+     */
+    void feed(ByteView data, std::vector<ContentChunk> &chunks);
+
+    /*
+     * Append the last chunk of the stream, if any, and start a new stream
+     */
+    void finish(std::vector<ContentChunk> &chunks);
+
+    /*
+     * Append all the chunks of data, as a stream of its own. Does not copy data
+     */
+    void chunk(ByteView data, std::vector<ContentChunk> &chunks);
+
+    size_t get_min_size() const { return _min_size; }
+    size_t get_avg_size() const { return _avg_size; }
+    size_t get_max_size() const { return _max_size; }
+};
+
+#endif // _CONTENT_CHUNKER_H_
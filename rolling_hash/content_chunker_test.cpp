@@ -0,0 +1,233 @@
+/*
+ * Tests of ContentChunker: the chunks are the same however the stream is fed, respect the
+ *  size limits and tile the stream, and an edit only changes the chunks around it.
+ */
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "content_chunker.h"
+#include "unit_test.h"
+
+using namespace std;
+
+// Bytes of generated input
+static const size_t NUM_TEST_CHARS = 1 << 20;
+
+// Bytes of the input that is fed a byte at a time
+static const size_t NUM_BYTE_AT_A_TIME_CHARS = 1 << 18;
+
+/*
+ * Random bytes with long runs of zeros, which have no boundaries and are cut at the maximum
+ *  size
+ */
+static vector<byte> make_input(size_t len)
+{
+    mt19937 rng(5);
+    vector<byte> input;
+    input.reserve(len);
+    while (input.size() < len) {
+        if (rng() % 300000 == 0) {
+            input.insert(input.end(), 100000, 0);
+        } else {
+            input.push_back((byte)rng());
+        }
+    }
+    input.resize(len);
+    return input;
+}
+
+static bool same_chunks(const vector<ContentChunk> &a, const vector<ContentChunk> &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i]._offset != b[i]._offset || a[i]._len != b[i]._len || a[i]._fingerprint != b[i]._fingerprint) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Feed input in pieces of piece_size bytes, or random sizes if it is 0
+ */
+static vector<ContentChunk> feed_chunks(ContentChunker &chunker, ByteView input, size_t piece_size)
+{
+    mt19937 rng(6);
+    vector<ContentChunk> chunks;
+    for (size_t pos = 0; pos < input.get_len(); ) {
+        size_t len = piece_size ? piece_size : rng() % 20000;
+        len = len < input.get_len() - pos ? len : input.get_len() - pos;
+        chunker.feed(input.sub(pos, len), chunks);
+        pos += len;
+    }
+    chunker.finish(chunks);
+    return chunks;
+}
+
+/*
+ * Do the chunks tile input and are they within the size limits?
+ */
+static void check_sizes(const ContentChunker &chunker, const vector<ContentChunk> &chunks, size_t len)
+{
+    long long offset = 0;
+    bool contiguous = true, in_limits = true;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        contiguous = contiguous && chunks[i]._offset == offset && chunks[i]._len > 0;
+        bool last = i + 1 == chunks.size();
+        in_limits = in_limits && chunks[i]._len <= chunker.get_max_size() && (last || chunks[i]._len >= chunker.get_min_size());
+        offset += chunks[i]._len;
+    }
+    CHECK(contiguous);
+    CHECK(in_limits);
+    CHECK(offset == (long long)len);
+}
+
+struct ChunkerConfig
+{
+    size_t _min_size, _avg_size, _max_size;
+    int _window;
+};
+
+static void test_configs(ByteView input)
+{
+    static const ChunkerConfig configs[] = {
+        { ContentChunker::DEFAULT_MIN_SIZE, ContentChunker::DEFAULT_AVG_SIZE, ContentChunker::DEFAULT_MAX_SIZE, ContentChunker::DEFAULT_WINDOW },
+        { 64, 256, 1024, 16 },
+        // Every chunk is the same size
+        { 1000, 1000, 1000, 8 },
+        { 1, 2, 4096, 1 },
+    };
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        const ChunkerConfig &config = configs[i];
+        string name = "chunker " + to_string(config._min_size) + "/" + to_string(config._avg_size) + "/" +
+                      to_string(config._max_size) + " window " + to_string(config._window);
+        ContentChunker chunker;
+        unit_note(name + ": init");
+        if (!CHECK(chunker.init(config._min_size, config._avg_size, config._max_size, config._window))) {
+            continue;
+        }
+        unit_note(name + ": chunk");
+        vector<ContentChunk> expected;
+        chunker.chunk(input, expected);
+        check_sizes(chunker, expected, input.get_len());
+        if (config._min_size == config._max_size) {
+            CHECK(expected.size() == (input.get_len() + config._max_size - 1) / config._max_size);
+        }
+
+        static const size_t piece_sizes[] = { 7, 4093, 65536, 0 };
+        for (size_t j = 0; j < sizeof(piece_sizes) / sizeof(piece_sizes[0]); j++) {
+            unit_note(name + ": feed in pieces of " + (piece_sizes[j] ? to_string(piece_sizes[j]) : string("random")) + " bytes");
+            CHECK(same_chunks(feed_chunks(chunker, input, piece_sizes[j]), expected));
+        }
+
+        ByteView prefix = input.sub(0, NUM_BYTE_AT_A_TIME_CHARS);
+        unit_note(name + ": feed a byte at a time");
+        vector<ContentChunk> prefix_chunks;
+        chunker.chunk(prefix, prefix_chunks);
+        check_sizes(chunker, prefix_chunks, prefix.get_len());
+        CHECK(same_chunks(feed_chunks(chunker, prefix, 1), prefix_chunks));
+    }
+}
+
+/*
+ * Equal bytes give equal fingerprints and an empty stream has no chunks
+ */
+static void test_fingerprints()
+{
+    unit_note("chunker fingerprints");
+    ContentChunker chunker;
+    CHECK(chunker.init());
+    vector<byte> zeros(10 * ContentChunker::DEFAULT_MAX_SIZE, 0);
+    vector<ContentChunk> chunks;
+    chunker.chunk(ByteView(&zeros[0], zeros.size()), chunks);
+    CHECK(chunks.size() == 10);
+    bool same = true;
+    for (size_t i = 1; i < chunks.size(); i++) {
+        same = same && chunks[i]._fingerprint == chunks[0]._fingerprint;
+    }
+    CHECK(same);
+    zeros[5] = 1;
+    vector<ContentChunk> changed;
+    chunker.chunk(ByteView(&zeros[0], zeros.size()), changed);
+    CHECK(changed.size() == 10 && changed[0]._fingerprint != chunks[0]._fingerprint && changed[1]._fingerprint == chunks[1]._fingerprint);
+
+    unit_note("chunker empty stream");
+    chunks.clear();
+    chunker.feed(ByteView(), chunks);
+    chunker.finish(chunks);
+    chunker.chunk(ByteView(), chunks);
+    CHECK(chunks.empty());
+}
+
+/*
+ * A byte inserted in the middle of input only changes the chunks next to it
+ */
+static void test_insert(ByteView input)
+{
+    ContentChunker chunker;
+    CHECK(chunker.init(64, 256, 1024, 16));
+    size_t pos = input.get_len() / 2 + 12345;
+    vector<byte> edited(input.get_data(), input.get_data() + input.get_len());
+    edited.insert(edited.begin() + pos, (byte)'x');
+
+    vector<ContentChunk> before, after;
+    chunker.chunk(input, before);
+    chunker.chunk(ByteView(&edited[0], edited.size()), after);
+    check_sizes(chunker, after, edited.size());
+
+    // Every chunk that ends more than a window before the insert is unchanged, and the same
+    //  chunks follow it a byte later, apart from the few that the window and minimum size
+    //  carry the change into
+    unit_note("chunker insert: chunks before the insert");
+    size_t num_before = 0;
+    bool same_before = true;
+    for (size_t i = 0; i < before.size() && before[i]._offset + (long long)before[i]._len + 16 < (long long)pos; i++) {
+        same_before = same_before && i < after.size() && after[i]._offset == before[i]._offset &&
+                      after[i]._len == before[i]._len && after[i]._fingerprint == before[i]._fingerprint;
+        num_before++;
+    }
+    CHECK(same_before);
+    CHECK(num_before > before.size() / 3);
+
+    unit_note("chunker insert: changed chunks");
+    set<uint64> fingerprints;
+    for (vector<ContentChunk>::const_iterator it = before.begin(); it != before.end(); it++) {
+        fingerprints.insert(it->_fingerprint);
+    }
+    int num_new = 0;
+    bool shifted = true;
+    for (vector<ContentChunk>::const_iterator it = after.begin(); it != after.end(); it++) {
+        if (!fingerprints.count(it->_fingerprint)) {
+            num_new++;
+            shifted = shifted && it->_offset + (long long)it->_len + 16 >= (long long)pos && it->_offset <= (long long)pos + 4096;
+        }
+    }
+    CHECK(num_new >= 1 && num_new <= 3);
+    CHECK(shifted);
+    CHECK(after.size() + 3 >= before.size() && after.size() <= before.size() + 3);
+}
+
+static void test_init_errors()
+{
+    unit_note("chunker init errors");
+    ContentChunker chunker;
+    CHECK(!chunker.init(0, 8, 16));
+    CHECK(!chunker.init(16, 8, 32));
+    CHECK(!chunker.init(8, 32, 16));
+    CHECK(!chunker.init(8, 16, 32, 0));
+    CHECK(!chunker.init(8, 16, 32, 2000));
+    CHECK(chunker.init(8, 16, 32, 4));
+}
+
+void test_content_chunker()
+{
+    vector<byte> data = make_input(NUM_TEST_CHARS);
+    ByteView input(&data[0], data.size());
+    test_configs(input);
+    test_fingerprints();
+    test_insert(input);
+    test_init_errors();
+}
@@ -0,0 +1,482 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include <iostream>
+#include <algorithm>
+#include "byteview.h"
+#include "mapped_file.h"
+#include "rough_plan.h"
+#include "corpus_scan.h"
+
+using namespace std;
+
+// Smallest chunk a file is split into. Below this the chunks' overlaps and task overheads
+//  cost more than is gained
+static const long long MIN_CORPUS_CHUNK = 1 << 16;
+
+// Path of the file the current thread is scanning
+static thread_local const string *_current_path = 0;
+
+/*
+ * What get_file_info() found at a path
+ */
+struct CorpusPathInfo
+{
+    bool _is_dir;
+    // The path is a symbolic link, or on Windows any reparse point such as a junction
+    bool _is_link;
+    long long _size;
+    // Identity of the file or directory the path leads to if _has_id. Paths that lead to the
+    //  same one through links have the same identity
+    bool _has_id;
+    unsigned long long _device, _inode;
+};
+
+#ifdef _WIN32
+
+/*
+ * Is path a directory or a link, and if not how big is it? Windows can't tell where a link
+ *  leads without opening it, so the identity is not set
+ * Returns: false if path does not exist
+ */
+static bool get_file_info(const string &path, CorpusPathInfo *info)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    info->_is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    info->_is_link = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    info->_size = ((long long)data.nFileSizeHigh << 32) | (long long)data.nFileSizeLow;
+    info->_has_id = false;
+    info->_device = info->_inode = 0;
+    return true;
+}
+
+/*
+ * Get the names of the entries of the directory at path, without . and ..
+ */
+static bool list_directory(const string &path, vector<string> &names)
+{
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        string name = data.cFileName;
+        if (name != "." && name != "..") {
+            names.push_back(name);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+    return true;
+}
+
+static const char PATH_SEPARATOR = '\\';
+
+#else
+
+static bool get_file_info(const string &path, CorpusPathInfo *info)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) < 0) {
+        return false;
+    }
+    info->_is_link = S_ISLNK(st.st_mode);
+    if (info->_is_link && stat(path.c_str(), &st) < 0) {
+        return false;
+    }
+    info->_is_dir = S_ISDIR(st.st_mode);
+    info->_size = (long long)st.st_size;
+    info->_has_id = true;
+    info->_device = (unsigned long long)st.st_dev;
+    info->_inode = (unsigned long long)st.st_ino;
+    return true;
+}
+
+static bool list_directory(const string &path, vector<string> &names)
+{
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        return false;
+    }
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+        string name = entry->d_name;
+        if (name != "." && name != "..") {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+static const char PATH_SEPARATOR = '/';
+
+#endif
+
+CorpusScanner::CorpusScanner(const FastRegex &engine, const CorpusScanOptions &options) :
+    _engine(engine),
+    _options(options),
+    _next_file(0),
+    _open_files(0),
+    _files_active(0),
+    _tasks_queued(0),
+    _stop(false)
+{
+    if (_options._num_threads <= 0) {
+        _options._num_threads = (int)thread::hardware_concurrency();
+        if (_options._num_threads <= 0) {
+            _options._num_threads = 1;
+        }
+    }
+    if (_options._max_open_files < 1) {
+        _options._max_open_files = 1;
+    }
+    if (_options._max_resident_bytes > 0 && _options._chunk_size > _options._max_resident_bytes / _options._num_threads) {
+        _options._chunk_size = _options._max_resident_bytes / _options._num_threads;
+    }
+    if (_options._chunk_size < MIN_CORPUS_CHUNK) {
+        _options._chunk_size = MIN_CORPUS_CHUNK;
+    }
+}
+
+CorpusScanner::~CorpusScanner()
+{
+    for (vector<CorpusFile *>::iterator it = _files.begin(); it != _files.end(); it++) {
+        delete (*it)->_mapped;
+        delete *it;
+    }
+}
+
+bool CorpusScanner::mark_visited(const CorpusPathInfo &info)
+{
+    return !info._has_id || _visited.insert(make_pair(info._device, info._inode)).second;
+}
+
+bool CorpusScanner::add_file(const string &path)
+{
+    CorpusPathInfo info;
+    if (!get_file_info(path, &info)) {
+        cerr << "Could not find " << path << endl;
+        return false;
+    }
+    if (info._is_dir) {
+        cerr << path << " is a directory" << endl;
+        return false;
+    }
+    if (!mark_visited(info)) {
+        return true;
+    }
+    CorpusFile *file = new CorpusFile;
+    file->_result._path = path;
+    file->_result._size = info._size;
+    _files.push_back(file);
+    return true;
+}
+
+bool CorpusScanner::add_directory(const string &path)
+{
+    CorpusPathInfo info;
+    vector<string> names;
+    if (!get_file_info(path, &info) || !info._is_dir || !list_directory(path, names)) {
+        cerr << "Could not read directory " << path << endl;
+        return false;
+    }
+    if (!mark_visited(info)) {
+        return true;
+    }
+    // Sorted so the results are in the same order on every run
+    sort(names.begin(), names.end());
+    bool ok = true;
+    for (vector<string>::const_iterator it = names.begin(); it != names.end(); it++) {
+        string child = path + PATH_SEPARATOR + *it;
+        CorpusPathInfo child_info;
+        if (!get_file_info(child, &child_info)) {
+            // e.g. a dangling link
+            continue;
+        }
+        if (child_info._is_link && !child_info._has_id) {
+            // It may lead back up the tree and there is no way to tell
+            continue;
+        }
+        ok = (child_info._is_dir ? add_directory(child) : add_file(child)) && ok;
+    }
+    return ok;
+}
+
+/*
+ * Take the newest task from the worker's own deque
+ */
+bool CorpusScanner::pop_task(int worker, Task *task)
+{
+    Worker *w = _workers[worker];
+    lock_guard<mutex> lock(w->_mutex);
+    if (w->_tasks.empty()) {
+        return false;
+    }
+    *task = w->_tasks.back();
+    w->_tasks.pop_back();
+    _tasks_queued--;
+    return true;
+}
+
+/*
+ * Take the oldest task from another worker's deque. The oldest chunks of a file are the
+ *  furthest from where its owner is working
+ */
+bool CorpusScanner::steal_task(int worker, Task *task)
+{
+    int num_workers = (int)_workers.size();
+    for (int i = 1; i < num_workers; i++) {
+        Worker *w = _workers[(worker + i) % num_workers];
+        lock_guard<mutex> lock(w->_mutex);
+        if (!w->_tasks.empty()) {
+            *task = w->_tasks.front();
+            w->_tasks.pop_front();
+            _tasks_queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CorpusScanner::push_task(int worker, const Task &task)
+{
+    {
+        Worker *w = _workers[worker];
+        lock_guard<mutex> lock(w->_mutex);
+        w->_tasks.push_back(task);
+    }
+    // Counted under _mutex so that a worker about to wait sees it
+    lock_guard<mutex> lock(_mutex);
+    _tasks_queued++;
+    _changed.notify_all();
+}
+
+/*
+ * Start the next files if a file can be opened. A large file is mapped and split into chunks
+ *  that go on the worker's deque, and the first chunk is returned. Otherwise the next small
+ *  files are returned as a batch that holds one open file at a time
+ * Returns: false if there are no files left to start or too many are open
+ */
+bool CorpusScanner::start_files(int worker, Task *task)
+{
+    CorpusFile *file = 0;
+    *task = Task();
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_next_file >= _queue.size() || _open_files >= _options._max_open_files) {
+            return false;
+        }
+        _open_files++;
+        if (_queue[_next_file]->_result._size > _options._chunk_size) {
+            file = _queue[_next_file++];
+            _files_active++;
+        } else {
+            long long batch_bytes = 0;
+            while (_next_file < _queue.size() && (task->_batch.empty() || batch_bytes < _options._batch_size)) {
+                batch_bytes += _queue[_next_file]->_result._size;
+                task->_batch.push_back(_queue[_next_file++]);
+            }
+            _files_active += (int)task->_batch.size();
+            return true;
+        }
+    }
+
+    file->_mapped = new MappedFile;
+    if (!file->_mapped->open(file->_result._path)) {
+        finish_file(file, true, false);
+        return true;
+    }
+    // The size may have changed since add_file()
+    long long size = (long long)file->_mapped->get_view().get_len();
+    file->_result._size = size;
+    long long chunk_size = _options._chunk_size;
+    int num_chunks = (int)((size + chunk_size - 1) / chunk_size);
+    if (num_chunks == 0) {
+        finish_file(file, true, true);
+        return true;
+    }
+    file->_chunks_left = num_chunks;
+    // Pushed last first so that the owner, working from the back, scans the file in order
+    for (int i = num_chunks - 1; i >= 1; i--) {
+        Task chunk;
+        chunk._file = file;
+        chunk._begin = (long long)i * chunk_size;
+        chunk._end = chunk._begin + chunk_size < size ? chunk._begin + chunk_size : size;
+        push_task(worker, chunk);
+    }
+    task->_file = file;
+    task->_begin = 0;
+    task->_end = chunk_size < size ? chunk_size : size;
+    return true;
+}
+
+void CorpusScanner::scan_small_file(CorpusFile *file)
+{
+    MappedFile mapped;
+    if (!mapped.open(file->_result._path)) {
+        finish_file(file, false, false);
+        return;
+    }
+    ByteView view = mapped.get_view();
+    file->_result._size = (long long)view.get_len();
+    long long num_matches = 0;
+    _current_path = &file->_result._path;
+    bool ok = _engine.process_range(view, 0, view.get_len(), &num_matches);
+    _current_path = 0;
+    file->_num_matches = num_matches;
+    if (!ok) {
+        file->_failed = true;
+        _stop = true;
+    }
+    mapped.close();
+    finish_file(file, false, true);
+}
+
+void CorpusScanner::run_task(const Task &task)
+{
+    if (!task._file) {
+        for (vector<CorpusFile *>::const_iterator it = task._batch.begin(); it != task._batch.end() && !_stop; it++) {
+            scan_small_file(*it);
+        }
+        if (!task._batch.empty()) {
+            lock_guard<mutex> lock(_mutex);
+            _open_files--;
+            _changed.notify_all();
+        }
+        return;
+    }
+
+    CorpusFile *file = task._file;
+    if (!_stop) {
+        long long num_matches = 0;
+        _current_path = &file->_result._path;
+        bool ok = _engine.process_range(file->_mapped->get_view(), (size_t)task._begin, (size_t)task._end, &num_matches);
+        _current_path = 0;
+        file->_num_matches += num_matches;
+        if (!ok) {
+            file->_failed = true;
+            _stop = true;
+        }
+        file->_mapped->release((size_t)task._begin, (size_t)(task._end - task._begin));
+    } else {
+        file->_failed = true;
+    }
+    if (--file->_chunks_left == 0) {
+        finish_file(file, true, true);
+    }
+}
+
+/*
+ * Record the result of a file that is done and report it
+ * Params:
+ *  close: the file holds an open file slot of its own, i.e. it was split into chunks
+ *  opened: the file could be opened
+ */
+void CorpusScanner::finish_file(CorpusFile *file, bool close, bool opened)
+{
+    if (close) {
+        delete file->_mapped;
+        file->_mapped = 0;
+    }
+    file->_result._num_matches = file->_num_matches;
+    file->_result._ok = opened && !file->_failed;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (close) {
+            _open_files--;
+        }
+        _files_active--;
+        _changed.notify_all();
+    }
+    if (_options._file_fn) {
+        _options._file_fn(file->_result, _options._file_context);
+    }
+}
+
+void CorpusScanner::work(int worker)
+{
+    Task task;
+    while (!_stop) {
+        if (pop_task(worker, &task) || steal_task(worker, &task) || start_files(worker, &task)) {
+            run_task(task);
+            continue;
+        }
+        unique_lock<mutex> lock(_mutex);
+        bool can_start = _next_file < _queue.size() && _open_files < _options._max_open_files;
+        if (_tasks_queued > 0 || can_start || _stop) {
+            continue;
+        }
+        if (_next_file >= _queue.size() && _files_active == 0) {
+            break;
+        }
+        _changed.wait(lock);
+    }
+    // Wake the workers waiting for tasks that will never come
+    lock_guard<mutex> lock(_mutex);
+    _changed.notify_all();
+}
+
+bool CorpusScanner::run()
+{
+    _queue.clear();
+    for (vector<CorpusFile *>::iterator it = _files.begin(); it != _files.end(); it++) {
+        CorpusFile *file = *it;
+        file->_result._num_matches = 0;
+        file->_result._ok = false;
+        file->_num_matches = 0;
+        file->_failed = false;
+        _queue.push_back(file);
+    }
+    // Largest first so that the big files are not left for the end with one core busy
+    stable_sort(_queue.begin(), _queue.end(), compare_size_desc);
+    _next_file = 0;
+    _open_files = 0;
+    _files_active = 0;
+    _tasks_queued = 0;
+    _stop = false;
+
+    for (int i = 0; i < _options._num_threads; i++) {
+        _workers.push_back(new Worker);
+    }
+    vector<thread> threads;
+    for (int i = 1; i < _options._num_threads; i++) {
+        threads.push_back(thread(work_thread, this, i));
+    }
+    work(0);
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+
+    // If an action function stopped the scan, the chunks left on the deques are dropped
+    for (vector<Worker *>::iterator it = _workers.begin(); it != _workers.end(); it++) {
+        delete *it;
+    }
+    _workers.clear();
+    bool ok = !_stop;
+    for (vector<CorpusFile *>::iterator it = _files.begin(); it != _files.end(); it++) {
+        delete (*it)->_mapped;
+        (*it)->_mapped = 0;
+        ok = ok && (*it)->_result._ok;
+    }
+    return ok;
+}
+
+vector<CorpusFileResult> CorpusScanner::get_results() const
+{
+    vector<CorpusFileResult> results;
+    for (vector<CorpusFile *>::const_iterator it = _files.begin(); it != _files.end(); it++) {
+        results.push_back((*it)->_result);
+    }
+    return results;
+}
+
+const string *CorpusScanner::get_current_path()
+{
+    return _current_path;
+}
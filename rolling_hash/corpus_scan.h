@@ -0,0 +1,200 @@
+#ifndef _CORPUS_SCAN_H_
+#define _CORPUS_SCAN_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class FastRegex;
+class MappedFile;
+struct CorpusPathInfo;
+
+/*
+ * The outcome of scanning one file of a corpus
+ */
+struct CorpusFileResult
+{
+    std::string _path;
+    long long _size;
+    // Number of matches found in the file
+    long long _num_matches;
+    // Was the whole file scanned? False if it could not be opened or the scan was stopped
+    //  because an action function returned false
+    bool _ok;
+
+    CorpusFileResult() : _size(0), _num_matches(0), _ok(false) {}
+};
+
+/*
+ * Called once for each file as soon as it has been scanned, from whichever worker thread
+ *  finished it, so it must be thread-safe
+ */
+typedef void (*CorpusFileFn)(const CorpusFileResult &result, void *context);
+
+/*
+ * Settings for CorpusScanner
+ */
+struct CorpusScanOptions
+{
+    enum { DEFAULT_MAX_OPEN_FILES = 64 };
+    enum { DEFAULT_CHUNK_SIZE = 16 << 20 };
+    enum { DEFAULT_BATCH_SIZE = 4 << 20 };
+
+    // Number of worker threads. 0 for one per core
+    int _num_threads;
+    // Maximum number of files open at once
+    int _max_open_files;
+    // Maximum bytes of the files being scanned that are resident at once. 0 for no limit.
+    //  Each worker scans at most _chunk_size bytes at a time and drops their pages when it is
+    //  done, so the chunk size is reduced to _max_resident_bytes / _num_threads if needed
+    long long _max_resident_bytes;
+    // Files bigger than this are split into chunks of this size that are scanned in parallel
+    long long _chunk_size;
+    // Smaller files are scanned in batches of up to this many bytes by one worker, so that
+    //  a directory of thousands of tiny files is not thousands of tasks
+    long long _batch_size;
+    // Per file callback, or 0
+    CorpusFileFn _file_fn;
+    void *_file_context;
+
+    CorpusScanOptions() :
+        _num_threads(0),
+        _max_open_files(DEFAULT_MAX_OPEN_FILES),
+        _max_resident_bytes(0),
+        _chunk_size(DEFAULT_CHUNK_SIZE),
+        _batch_size(DEFAULT_BATCH_SIZE),
+        _file_fn(0),
+        _file_context(0)
+    {}
+};
+
+/*
+ * Scans a corpus of files with a FastRegex engine using all the cores.
+ *
+ * Files are scanned largest first. A file bigger than the chunk size is memory mapped and
+ *  split into chunk tasks with FastRegex::process_range(). Smaller files are grouped into
+ *  batch tasks that scan one file after another. Each worker pushes the chunks of the files
+ *  it opens onto its own deque and takes tasks from the back of it, and a worker with nothing
+ *  to do steals from the front of another worker's deque, so one GB file is spread over all
+ *  the cores while KB files keep them busy at the end.
+ *
+ * The action functions are called from the worker threads, so they must be thread-safe.
+ *  Matches are in offset order within a chunk but the chunks of a file and the files are
+ *  scanned in no particular order. The offsets passed to action functions are offsets in the
+ *  file, and get_current_path() says which file that is.
+ *
+ *      CorpusScanner scanner(engine);
+ *      scanner.add_directory("spool");
+ *      scanner.run();
+ *      for each result in scanner.get_results() ...
+ */
+class CorpusScanner
+{
+    // A file of the corpus and how far its scan has got
+    struct CorpusFile
+    {
+        CorpusFileResult _result;
+        // Set while the file is split into chunks
+        MappedFile *_mapped;
+        std::atomic<int> _chunks_left;
+        std::atomic<long long> _num_matches;
+        std::atomic<bool> _failed;
+
+        CorpusFile() : _mapped(0), _chunks_left(0), _num_matches(0), _failed(false) {}
+    };
+
+    // A chunk of a split file, or a batch of small files if _file is 0
+    struct Task
+    {
+        CorpusFile *_file;
+        long long _begin, _end;
+        std::vector<CorpusFile *> _batch;
+
+        Task() : _file(0), _begin(0), _end(0) {}
+    };
+
+    // A worker's tasks. The owner works from the back and thieves take from the front
+    struct Worker
+    {
+        std::mutex _mutex;
+        std::deque<Task> _tasks;
+    };
+
+    const FastRegex &_engine;
+    CorpusScanOptions _options;
+    std::vector<CorpusFile *> _files;
+    std::vector<Worker *> _workers;
+    // Device and inode of every file and directory added, so that each is added once however
+    //  many links lead to it and links that loop back up a tree are not followed
+    std::set<std::pair<unsigned long long, unsigned long long> > _visited;
+
+    // Protects the fields below
+    std::mutex _mutex;
+    // Signalled when tasks are pushed, a file is closed or the scan ends
+    std::condition_variable _changed;
+    // Files not started yet, in the order they will be started
+    std::vector<CorpusFile *> _queue;
+    size_t _next_file;
+    int _open_files;
+    // Files started and not finished
+    int _files_active;
+    // Total tasks on all the deques
+    std::atomic<long long> _tasks_queued;
+    std::atomic<bool> _stop;
+
+    CorpusScanner(const CorpusScanner &);
+    CorpusScanner &operator=(const CorpusScanner &);
+
+    bool mark_visited(const CorpusPathInfo &info);
+    bool pop_task(int worker, Task *task);
+    bool steal_task(int worker, Task *task);
+    bool start_files(int worker, Task *task);
+    void push_task(int worker, const Task &task);
+    void run_task(const Task &task);
+    void scan_small_file(CorpusFile *file);
+    void finish_file(CorpusFile *file, bool close, bool opened);
+    void work(int worker);
+    static void work_thread(CorpusScanner *scanner, int worker) { scanner->work(worker); }
+    static bool compare_size_desc(const CorpusFile *a, const CorpusFile *b) { return a->_result._size > b->_result._size; }
+
+public:
+    CorpusScanner(const FastRegex &engine, const CorpusScanOptions &options = CorpusScanOptions());
+    ~CorpusScanner();
+
+    /*
+     * Add a file, or every file under a directory and its subdirectories, to the corpus.
+     *  Symbolic links are followed but a file or directory that has already been added, e.g.
+     *  through another link, is skipped, so a link to a parent directory is not a loop. On
+     *  Windows links and junctions under a directory are skipped as where they lead is not
+     *  known
+     * Returns: false and writes a message to cerr if path does not exist or a directory can't
+     *  be read
+     */
+    bool add_file(const std::string &path);
+    bool add_directory(const std::string &path);
+
+    /*
+     * Scan every file added. Can be run again after adding more files, and rescans them all
+     * Returns: true if every file was scanned and no action function returned false
+     */
+    bool run();
+
+    /*
+     * One result per file in the order they were added
+     */
+    std::vector<CorpusFileResult> get_results() const;
+
+    /*
+     * Path of the file being scanned by the calling thread. For use in action functions.
+     *  0 outside a scan
+     */
+    static const std::string *get_current_path();
+};
+
+#endif // _CORPUS_SCAN_H_
@@ -0,0 +1,310 @@
+/*
+ * Tests of CorpusScanner and the pieces it is built on, FastRegex::process_range() and
+ *  MappedFile::release().
+ *
+ * A small corpus of files from empty to many chunks long is written to a scratch directory
+ *  and the per file match counts of run() are checked against process() on each file, for
+ *  several thread counts, open file limits and chunk sizes.
+ */
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+#include "corpus_scan.h"
+#include "mapped_file.h"
+#include "rough_plan.h"
+#include "unit_test.h"
+
+using namespace std;
+
+#ifdef _WIN32
+static const string PATH_SEPARATOR = "\\";
+#else
+static const string PATH_SEPARATOR = "/";
+#endif
+
+static const char *PATTERNS[] = {
+    "needle",
+    "order #[0-9]+",
+    "abc.{2}defgh",
+};
+static const int NUM_PATTERNS = (int)(sizeof(PATTERNS) / sizeof(PATTERNS[0]));
+
+// Sizes of the files of the corpus. The largest are split into many chunks of the smallest
+//  chunk size
+static const size_t FILE_SIZES[] = { 0, 5, 100, 4096, 70000, 300000, 1 << 20 };
+static const int NUM_FILES = (int)(sizeof(FILE_SIZES) / sizeof(FILE_SIZES[0]));
+
+// Matches found by the action function, and after how many it stops the scan, or -1
+static atomic<long long> _num_matches(0);
+static atomic<long long> _stop_after(-1);
+static atomic<bool> _path_ok(true);
+
+static bool count_action(ByteView, const RegexResults *, size_t)
+{
+    if (!CorpusScanner::get_current_path()) {
+        _path_ok = false;
+    }
+    long long n = ++_num_matches;
+    return _stop_after < 0 || n < _stop_after;
+}
+
+static atomic<int> _num_file_fn_calls(0);
+
+static void count_file_fn(const CorpusFileResult &, void *)
+{
+    _num_file_fn_calls++;
+}
+
+static bool make_directory(const string &path)
+{
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0;
+#else
+    return mkdir(path.c_str(), 0777) == 0;
+#endif
+}
+
+static void remove_directory(const string &path)
+{
+#ifdef _WIN32
+    _rmdir(path.c_str());
+#else
+    rmdir(path.c_str());
+#endif
+}
+
+/*
+ * Random letters with matches and near misses in them
+ */
+static vector<byte> make_file(size_t len, unsigned seed)
+{
+    static const char *snippets[] = { "needle", "needl", "order #42", "order #", "abcXYdefgh", "abcdefgh" };
+    static const char alphabet[] = "abcdefghnor #0123456789\n";
+    mt19937 rng(seed);
+    vector<byte> data;
+    data.reserve(len + 16);
+    while (data.size() < len) {
+        if (rng() % 50 == 0) {
+            const char *snippet = snippets[rng() % (sizeof(snippets) / sizeof(snippets[0]))];
+            data.insert(data.end(), snippet, snippet + strlen(snippet));
+        } else {
+            data.push_back((byte)alphabet[rng() % (sizeof(alphabet) - 1)]);
+        }
+    }
+    data.resize(len);
+    return data;
+}
+
+/*
+ * Number of matches process() finds in data
+ */
+static long long count_matches(const FastRegex &engine, const vector<byte> &data)
+{
+    _num_matches = 0;
+    engine.process(ByteView(data.empty() ? 0 : &data[0], data.size()));
+    return _num_matches;
+}
+
+struct ScanConfig
+{
+    int _num_threads;
+    int _max_open_files;
+    long long _chunk_size;
+    long long _batch_size;
+};
+
+static void test_configs(const FastRegex &engine, const string &dir, const vector<string> &paths, const vector<long long> &expected)
+{
+    static const ScanConfig configs[] = {
+        { 1, CorpusScanOptions::DEFAULT_MAX_OPEN_FILES, CorpusScanOptions::DEFAULT_CHUNK_SIZE, CorpusScanOptions::DEFAULT_BATCH_SIZE },
+        // Chunk size 1 is raised to the minimum, so the big files are many chunks
+        { 1, 1, 1, 1 },
+        { 2, 1, 1, CorpusScanOptions::DEFAULT_BATCH_SIZE },
+        { 3, CorpusScanOptions::DEFAULT_MAX_OPEN_FILES, 1, 1 },
+        { 4, 1, 1, 10000 },
+        { 4, 2, CorpusScanOptions::DEFAULT_CHUNK_SIZE, CorpusScanOptions::DEFAULT_BATCH_SIZE },
+    };
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        const ScanConfig &config = configs[i];
+        unit_note("corpus scan with " + to_string(config._num_threads) + " threads, " + to_string(config._max_open_files) +
+                  " open files, chunk size " + to_string(config._chunk_size) + ", batch size " + to_string(config._batch_size));
+        CorpusScanOptions options;
+        options._num_threads = config._num_threads;
+        options._max_open_files = config._max_open_files;
+        options._chunk_size = config._chunk_size;
+        options._batch_size = config._batch_size;
+        options._file_fn = count_file_fn;
+        CorpusScanner scanner(engine, options);
+        CHECK(scanner.add_directory(dir));
+        _num_matches = 0;
+        _num_file_fn_calls = 0;
+        _path_ok = true;
+        CHECK(scanner.run());
+        CHECK(_path_ok);
+        CHECK(_num_file_fn_calls == NUM_FILES);
+        vector<CorpusFileResult> results = scanner.get_results();
+        if (!CHECK(results.size() == paths.size())) {
+            continue;
+        }
+        long long total = 0;
+        bool same = true;
+        for (size_t j = 0; j < results.size(); j++) {
+            same = same && results[j]._path == paths[j] && results[j]._ok && results[j]._num_matches == expected[j] &&
+                   results[j]._size == (long long)FILE_SIZES[j];
+            total += expected[j];
+        }
+        CHECK(same);
+        CHECK(_num_matches == total);
+    }
+}
+
+static void test_stop_and_rerun(const FastRegex &engine, const string &dir, const vector<long long> &expected)
+{
+    unit_note("corpus scan stopped by an action function");
+    CorpusScanOptions options;
+    options._num_threads = 2;
+    options._chunk_size = 1;
+    CorpusScanner scanner(engine, options);
+    CHECK(scanner.add_directory(dir));
+    _stop_after = 10;
+    CHECK(!scanner.run());
+    _stop_after = -1;
+    vector<CorpusFileResult> results = scanner.get_results();
+    bool any_failed = false;
+    for (size_t j = 0; j < results.size(); j++) {
+        any_failed = any_failed || !results[j]._ok;
+    }
+    CHECK(any_failed);
+
+    // Running again rescans every file from the start
+    for (int run = 0; run < 2; run++) {
+        unit_note("corpus scan run again, run " + to_string(run));
+        _num_matches = 0;
+        CHECK(scanner.run());
+        results = scanner.get_results();
+        bool same = results.size() == expected.size();
+        for (size_t j = 0; same && j < results.size(); j++) {
+            same = results[j]._ok && results[j]._num_matches == expected[j];
+        }
+        CHECK(same);
+    }
+
+    // A file added after a run is scanned with the others by the next one
+    unit_note("corpus scan after adding a file");
+    CHECK(!scanner.add_file(dir + PATH_SEPARATOR + "missing"));
+    CHECK(!scanner.add_directory(dir + PATH_SEPARATOR + "missing"));
+    CHECK(!scanner.add_file(dir));
+    string extra = unit_temp_path("corpus_extra");
+    vector<byte> data = make_file(200000, 99);
+    CHECK(unit_write_file(extra, ByteView(&data[0], data.size())));
+    CHECK(scanner.add_file(extra));
+    // Adding the same file again is ignored
+    CHECK(scanner.add_file(extra));
+    long long extra_matches = count_matches(engine, data);
+    CHECK(scanner.run());
+    results = scanner.get_results();
+    CHECK(results.size() == expected.size() + 1 && results.back()._path == extra && results.back()._num_matches == extra_matches);
+    remove(extra.c_str());
+}
+
+#ifndef _WIN32
+
+/*
+ * Links to a parent directory and to a file of the corpus are not followed twice
+ */
+static void test_links(const FastRegex &engine, const string &dir, const vector<string> &paths)
+{
+    unit_note("corpus scan with symbolic links");
+    string loop = dir + "/sub/loop";
+    string file_link = dir + "/sub/link";
+    CHECK(symlink("..", loop.c_str()) == 0);
+    CHECK(symlink("../f0", file_link.c_str()) == 0);
+    CorpusScanner scanner(engine);
+    CHECK(scanner.add_directory(dir));
+    CHECK(scanner.get_results().size() == paths.size());
+    CHECK(scanner.run());
+    unlink(loop.c_str());
+    unlink(file_link.c_str());
+}
+
+#endif
+
+/*
+ * Released ranges read back the same, and release() ignores ranges past the end
+ */
+static void test_release(const string &path, const vector<byte> &data)
+{
+    unit_note("MappedFile::release");
+    MappedFile mapped;
+    if (!CHECK(mapped.open(path))) {
+        return;
+    }
+    ByteView view = mapped.get_view();
+    CHECK(view.get_len() == data.size());
+    mapped.release(12345, 70000);
+    mapped.release(0, 1);
+    mapped.release(data.size() - 1, 100);
+    mapped.release(data.size(), 100);
+    mapped.release(data.size() + 5000, 1);
+    CHECK(memcmp(view.get_data(), &data[0], data.size()) == 0);
+    mapped.release(0, data.size());
+    CHECK(memcmp(view.get_data(), &data[0], data.size()) == 0);
+}
+
+void test_corpus_scan()
+{
+    vector<RegexActionParams> params;
+    for (int i = 0; i < NUM_PATTERNS; i++) {
+        RegexActionParams p = { BinString((int)strlen(PATTERNS[i]), (const byte *)PATTERNS[i]), count_action };
+        params.push_back(p);
+    }
+    vector<RegexActionParams *> params_list;
+    for (vector<RegexActionParams>::iterator it = params.begin(); it != params.end(); it++) {
+        params_list.push_back(&*it);
+    }
+    FastRegex engine;
+    if (!CHECK(engine.init(params_list))) {
+        return;
+    }
+
+    // The files are f0 .. f<n-1>, with the last two in a subdirectory. add_directory() sorts
+    //  the names so the results are in this order
+    string dir = unit_temp_path("corpus");
+    string sub = dir + PATH_SEPARATOR + "sub";
+    make_directory(dir);
+    make_directory(sub);
+    vector<string> paths;
+    vector<long long> expected;
+    vector<byte> largest;
+    for (int i = 0; i < NUM_FILES; i++) {
+        string path = (i < NUM_FILES - 2 ? dir : sub) + PATH_SEPARATOR + "f" + to_string(i);
+        vector<byte> data = make_file(FILE_SIZES[i], i + 1);
+        CHECK(unit_write_file(path, ByteView(data.empty() ? 0 : &data[0], data.size())));
+        paths.push_back(path);
+        expected.push_back(count_matches(engine, data));
+        largest = data;
+    }
+    CHECK(expected.back() > 0);
+
+    test_configs(engine, dir, paths, expected);
+    test_stop_and_rerun(engine, dir, expected);
+#ifndef _WIN32
+    test_links(engine, dir, paths);
+#endif
+    test_release(paths.back(), largest);
+
+    for (vector<string>::const_iterator it = paths.begin(); it != paths.end(); it++) {
+        remove(it->c_str());
+    }
+    remove_directory(sub);
+    remove_directory(dir);
+}
@@ -1,7 +1,9 @@
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include "timer.h"
 #include "rabinkarphash.h"
+#include "rollinghash.h"
 
 
 using namespace std;
@@ -70,7 +72,7 @@ static byte *make_hash_table(int size, double fraction_on)
  * Exercise the hash function and record its performance
  * 
  * Params:
- *  n:    Length of hash
+ *  hf:   The hash. KarpRabinHash or a RollingHash
  *  data: Test data to run the hash over 
  *  numchars: Number of elements in data
  *  fraction_on: Fraction of the data that should have hash matches
@@ -78,9 +80,10 @@ static byte *make_hash_table(int size, double fraction_on)
  * Returns:
  *  2 element vector: 1st element is duration, 2nd element is number of hashes matched
  */
-static vector<double> exercise_hash(int n, const chartype *data, int numchars, double fraction_on, int numtests)
+template <class Hash>
+static vector<double> exercise_hash(Hash &hf, const chartype *data, int numchars, double fraction_on, int numtests)
 {
-    KarpRabinHash hf = KarpRabinHash(n);
+    const int n = hf._n;
     int table_size = 1 << hf._wordsize;
     cout << "       n=" << hf._n << endl;  
     cout << "wordsize=" << hf._wordsize << " (" << table_size << ")" << endl;
@@ -99,6 +102,7 @@ static vector<double> exercise_hash(int n, const chartype *data, int numchars, d
 
     for (int times = 0; times < numtests; times++) {
         // Prime the first n hash values
+        hf._hashvalue = 0;
         for (int k = 0; k < n; k++) {
 	    hf.eat(data[k]);
 	}
@@ -133,8 +137,9 @@ static vector<double> exercise_hash(int n, const chartype *data, int numchars, d
     cout << "min hash=" << min_hashval << endl;
     cout << "max hash=" << max_hashval << endl;
 #endif
-    int expected_hits = (int)((double)numchars * fraction_on);
-    double hit_ratio = (double)num_hits/((double)numchars * fraction_on);
+    // Every one of the numtests passes over the data counts its hits
+    double expected_hits = (double)numtests * (double)numchars * fraction_on;
+    double hit_ratio = (double)num_hits / expected_hits;
     int hit_bins = 0;
     for (int i = 0; i < table_size; i++) {
         if (count_table[i]) {
@@ -142,7 +147,6 @@ static vector<double> exercise_hash(int n, const chartype *data, int numchars, d
         }
     }
     cout << "hit_bins=" << hit_bins << endl;
-    // !@#$ Why are we getting 5x the expected hit have
     cout << "num_hits=" << num_hits << " (expected " << expected_hits << ")  " << hit_ratio << " x expected" << endl;
     cout << "    time=" << duration << endl;
     cout << "hash/sec=" << num_hashes / duration << endl;
@@ -153,6 +157,46 @@ static vector<double> exercise_hash(int n, const chartype *data, int numchars, d
     return retval;
 }
 
+/*
+ * Runs exercise_hash() with a RollingHash specialized for the window length N
+ */
+struct ExerciseFixedHash
+{
+    const chartype *_data;
+    int _numchars;
+    double _fraction_on;
+    int _numtests;
+    vector<double> _retval;
+
+    ExerciseFixedHash(const chartype *data, int numchars, double fraction_on, int numtests) :
+        _data(data),
+        _numchars(numchars),
+        _fraction_on(fraction_on),
+        _numtests(numtests)
+    {}
+
+    template <int N> void run()
+    {
+        RollingHash<KarpRabinFamily, N, WORDSIZE> hf;
+        _retval = exercise_hash(hf, _data, _numchars, _fraction_on, _numtests);
+    }
+};
+
+/*
+ * Exercise the Karp-Rabin hash of length n. Uses the compile time specialized hash if there 
+ *  is one for n
+ */
+static vector<double> exercise_hash(int n, const chartype *data, int numchars, double fraction_on, int numtests)
+{
+    ExerciseFixedHash fixed(data, numchars, fraction_on, numtests);
+    if (dispatch_rolling_hash_len(n, fixed)) {
+        cout << "    (specialized for n=" << n << ")" << endl;
+        return fixed._retval;
+    }
+    KarpRabinHash hf = KarpRabinHash(n, WORDSIZE);
+    return exercise_hash(hf, data, numchars, fraction_on, numtests);
+}
+
 static void test()
 {
     int numtests = 5;
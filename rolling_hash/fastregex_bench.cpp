@@ -0,0 +1,261 @@
+/*
+ * Benchmark of the fastregex backends.
+ *
+ * Runs fastregex_process() over some input with each backend in FastRegexOptions::Backend
+ *  and reports the throughput, the number of static string hits, the number of regexes
+ *  run and the number of matches, then the fastest backend for each pattern set. The
+ *  backend BACKEND_AUTO would choose is marked with a *.
+ *
+ * The input is the files given on the command line or, if there are none, random words of
+ *  lower case letters separated by spaces.
+ * The pattern sets are the lines of the file given with -p or, if there is none, sets of
+ *  4 to 4096 words from the input's vocabulary plus a set of regexes.
+ *
+ * Build: make fastregex_bench, or
+ *        g++ -std=c++11 -O2 -mavx2 -mssse3 fastregex_bench.cpp rough_plan.cpp multilane_scanner.cpp
+ *          aho_corasick.cpp teddy.cpp anchored_regex.cpp mapped_file.cpp read_ahead.cpp byte_model.cpp
+ *          corpus_scan.cpp content_chunker.cpp file_sketch.cpp -lpthread -o fastregex_bench
+ * Run:   fastregex_bench [-p patterns] [file...]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include "rough_plan.h"
+#include "teddy.h"
+
+using namespace std;
+
+// Number of bytes of generated input
+static const int NUM_TEST_CHARS = 1 << 24;
+
+// Number of distinct words in the generated input
+static const int NUM_WORDS = 20000;
+
+// Number of times each backend is run. The fastest run is reported
+static const int NUM_RUNS = 3;
+
+static long long _num_matches = 0;
+
+static bool count_match(ByteView, const RegexResults *, size_t)
+{
+    _num_matches++;
+    return true;
+}
+
+struct PatternSet
+{
+    string _name;
+    vector<string> _patterns;
+};
+
+static string make_word(int len)
+{
+    string word;
+    for (int i = 0; i < len; i++) {
+        word += (char)('a' + rand() % 26);
+    }
+    return word;
+}
+
+/*
+ * Make NUM_TEST_CHARS of random words from a vocabulary of NUM_WORDS words
+ */
+static vector<byte> make_input(vector<string> &vocabulary)
+{
+    srand(1);
+    for (int i = 0; i < NUM_WORDS; i++) {
+        vocabulary.push_back(make_word(3 + rand() % 8));
+    }
+    vector<byte> input;
+    input.reserve(NUM_TEST_CHARS);
+    while (input.size() < (size_t)NUM_TEST_CHARS) {
+        const string &word = vocabulary[rand() % NUM_WORDS];
+        input.insert(input.end(), word.begin(), word.end());
+        input.push_back(' ');
+    }
+    input.resize(NUM_TEST_CHARS);
+    return input;
+}
+
+/*
+ * Make pattern sets of num_patterns words from vocabulary that are long enough to hash on
+ */
+static PatternSet make_literal_set(const vector<string> &vocabulary, int num_patterns)
+{
+    PatternSet set;
+    char name[64];
+    sprintf(name, "%d literals", num_patterns);
+    set._name = name;
+    for (int i = 0; (int)set._patterns.size() < num_patterns && i < (int)vocabulary.size(); i++) {
+        if (vocabulary[i].size() >= 5) {
+            set._patterns.push_back(vocabulary[i]);
+        }
+    }
+    return set;
+}
+
+static PatternSet make_regex_set(const vector<string> &vocabulary, int num_patterns)
+{
+    PatternSet set;
+    char name[64];
+    sprintf(name, "%d regexes", num_patterns);
+    set._name = name;
+    for (int i = 0; (int)set._patterns.size() < num_patterns && i < (int)vocabulary.size(); i++) {
+        if (vocabulary[i].size() >= 5) {
+            set._patterns.push_back(vocabulary[i] + " [a-z]+");
+        }
+    }
+    return set;
+}
+
+static vector<byte> read_file(const char *path)
+{
+    ifstream f(path, ios::binary);
+    return vector<byte>(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+}
+
+static vector<string> read_lines(const char *path)
+{
+    vector<string> lines;
+    ifstream f(path);
+    string line;
+    while (getline(f, line)) {
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+static const char *BACKEND_NAMES[] = { "auto", "rolling-hash", "aho-corasick", "teddy" };
+
+/*
+ * Run patterns over input with backend
+ * Returns: throughput in MB/s or a negative number if fastregex_init() failed
+ */
+static double run_backend(const PatternSet &set, ByteView input, FastRegexOptions::Backend backend, string *chosen)
+{
+    vector<RegexActionParams> params;
+    for (vector<string>::const_iterator it = set._patterns.begin(); it != set._patterns.end(); it++) {
+        RegexActionParams p = { BinString((int)it->size(), (const byte *)it->c_str()), count_match };
+        params.push_back(p);
+    }
+    vector<RegexActionParams *> params_list;
+    for (vector<RegexActionParams>::iterator it = params.begin(); it != params.end(); it++) {
+        params_list.push_back(&*it);
+    }
+
+    FastRegexOptions options;
+    options._backend = backend;
+    if (!fastregex_init(params_list, options)) {
+        fastregex_term();
+        return -1.0;
+    }
+    *chosen = fastregex_get_backend_name();
+    double best_time = -1.0;
+    for (int run = 0; run < NUM_RUNS; run++) {
+        _num_matches = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fastregex_process(input);
+        double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (best_time < 0.0 || time < best_time) {
+            best_time = time;
+        }
+    }
+    long long num_matches = _num_matches;
+    fastregex_term();
+
+    // Count the hits and verifications in a separate run as collecting stats slows it down
+    options._collect_stats = true;
+    fastregex_init(params_list, options);
+    fastregex_process(input);
+    FastRegexStats stats = fastregex_get_stats();
+    fastregex_term();
+
+    double mbps = (double)input.get_len() / best_time / 1.0e6;
+    printf("    %-14s %9.1f MB/s %10lld hits %10lld verified %10lld matches\n",
+           BACKEND_NAMES[backend], mbps, stats._filter_hits, stats._num_verified, num_matches);
+    return mbps;
+}
+
+static void bench_set(const PatternSet &set, ByteView input)
+{
+    printf("%s\n", set._name.c_str());
+    string auto_choice;
+    run_backend(set, input, FastRegexOptions::BACKEND_AUTO, &auto_choice);
+
+    int best = -1;
+    double best_mbps = 0.0;
+    for (int backend = FastRegexOptions::BACKEND_ROLLING_HASH; backend <= FastRegexOptions::BACKEND_TEDDY; backend++) {
+        // Teddy degrades to checking every literal in a bucket at most offsets on big sets
+        if (backend == FastRegexOptions::BACKEND_TEDDY && set._patterns.size() > (size_t)TeddyMatcher::MAX_LITERALS) {
+            continue;
+        }
+        string chosen;
+        double mbps = run_backend(set, input, (FastRegexOptions::Backend)backend, &chosen);
+        if (mbps > best_mbps) {
+            best_mbps = mbps;
+            best = backend;
+        }
+    }
+    if (best >= 0) {
+        printf("  fastest: %s, auto chose %s%s\n", BACKEND_NAMES[best], auto_choice.c_str(),
+               auto_choice == BACKEND_NAMES[best] ? " *" : "");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *patterns_path = 0;
+    vector<const char *> input_paths;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            patterns_path = argv[++i];
+        } else {
+            input_paths.push_back(argv[i]);
+        }
+    }
+
+    vector<string> vocabulary;
+    vector<byte> input;
+    if (input_paths.empty()) {
+        input = make_input(vocabulary);
+    } else {
+        for (vector<const char *>::const_iterator it = input_paths.begin(); it != input_paths.end(); it++) {
+            vector<byte> data = read_file(*it);
+            input.insert(input.end(), data.begin(), data.end());
+        }
+    }
+    if (input.empty()) {
+        fprintf(stderr, "No input\n");
+        return 1;
+    }
+    printf("%d bytes of input\n", (int)input.size());
+    ByteView view(&input[0], input.size());
+
+    vector<PatternSet> sets;
+    if (patterns_path) {
+        PatternSet set;
+        set._name = patterns_path;
+        set._patterns = read_lines(patterns_path);
+        sets.push_back(set);
+    } else if (!vocabulary.empty()) {
+        for (int n = 4; n <= 4096; n *= 4) {
+            sets.push_back(make_literal_set(vocabulary, n));
+        }
+        sets.push_back(make_regex_set(vocabulary, 64));
+    } else {
+        fprintf(stderr, "Patterns must be given with -p when input files are given\n");
+        return 1;
+    }
+
+    for (vector<PatternSet>::const_iterator it = sets.begin(); it != sets.end(); it++) {
+        bench_set(*it, view);
+    }
+    return 0;
+}
@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <math.h>
+#include <mutex>
+#include <thread>
+#include "bitfilter.h"
+#include "mapped_file.h"
+#include "file_sketch.h"
+
+using namespace std;
+
+// Value of an empty bin of the b-bit signature while it is being built
+static const uint64 EMPTY_BIN = ~(uint64)0;
+
+// Pairs whose b-bit signatures estimate a similarity this many standard errors below the
+//  threshold are still rescored with the bottom-k sketches
+static const double SIGNATURE_MARGIN = 3.0;
+
+/*
+ * Mix a hash value to 64 bits (the splitmix64 finalizer). A bijection, so distinct q-gram
+ *  hashes stay distinct, and the order of the results is unrelated to the order of the inputs
+ */
+static inline uint64 mix_hash(uint64 z)
+{
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Run job.run(i) for each i in [0, num_tasks) on up to num_threads threads. Each thread takes
+ *  the next i as soon as it is done with the last, so uneven tasks are balanced
+ */
+template<class Job> static void run_worker(Job *job, atomic<size_t> *next, size_t num_tasks)
+{
+    for (size_t i = (*next)++; i < num_tasks; i = (*next)++) {
+        job->run(i);
+    }
+}
+
+template<class Job> static void run_tasks(Job &job, size_t num_tasks, int num_threads)
+{
+    if (num_threads <= 0) {
+        num_threads = (int)thread::hardware_concurrency();
+        if (num_threads <= 0) {
+            num_threads = 1;
+        }
+    }
+    if ((size_t)num_threads > num_tasks) {
+        num_threads = (int)num_tasks;
+    }
+    atomic<size_t> next(0);
+    vector<thread> threads;
+    for (int i = 1; i < num_threads; i++) {
+        threads.push_back(thread(run_worker<Job>, &job, &next, num_tasks));
+    }
+    run_worker(&job, &next, num_tasks);
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+}
+
+FileSketcher::FileSketcher() :
+    _q(0),
+    _k(0),
+    _b(0),
+    _bin_bits(0),
+    _field_mask(0),
+    _hash(0)
+{
+    init();
+}
+
+FileSketcher::~FileSketcher()
+{
+    delete _hash;
+}
+
+bool FileSketcher::init(int q, int k, int b)
+{
+    if (q < 1 || q > 1024) {
+        cerr << "q must be in [1, 1024]" << endl;
+        return false;
+    }
+    int bin_bits = 0;
+    while ((1 << bin_bits) < k && bin_bits < 16) {
+        bin_bits++;
+    }
+    if (k != (1 << bin_bits) || k < 64) {
+        cerr << "k must be a power of 2 in [64, 65536]" << endl;
+        return false;
+    }
+    if (b != 1 && b != 2 && b != 4 && b != 8 && b != 16) {
+        cerr << "b must be 1, 2, 4, 8 or 16" << endl;
+        return false;
+    }
+
+    delete _hash;
+    _q = q;
+    _k = k;
+    _b = b;
+    _bin_bits = bin_bits;
+    // The lowest bit of each b-bit field
+    _field_mask = 0;
+    for (int i = 0; i < 64; i += b) {
+        _field_mask |= (uint64)1 << i;
+    }
+    _hash = new KarpRabinHash(q, 30);
+    return true;
+}
+
+void FileSketcher::sketch(ByteView data, FileSketch &sketch) const
+{
+    sketch._num_qgrams = 0;
+    sketch._bottom_k.clear();
+    sketch._signature.assign((size_t)_k * _b / 64, 0);
+    size_t n = (size_t)_q;
+    if (data.get_len() < n) {
+        return;
+    }
+
+    const byte *d = data.get_data();
+    size_t len = data.get_len();
+    const hashvaluetype *char_hashes = _hash->get_char_hashes();
+    const hashvaluetype B = KarpRabinHash::get_B();
+    const hashvaluetype BtoN = _hash->get_BtoN();
+    const hashvaluetype mask = _hash->get_mask();
+    int bin_shift = 64 - _bin_bits;
+
+    vector<uint64> bins(_k, EMPTY_BIN);
+    vector<uint64> &kept = sketch._bottom_k;
+    kept.reserve(_k + 1);
+    // Only a value below the k-th smallest so far can change the bottom-k sketch
+    uint64 kth = EMPTY_BIN;
+
+    hashvaluetype h = 0;
+    for (size_t i = 0; i < n; i++) {
+        h = (B * h + char_hashes[d[i]]) & mask;
+    }
+    for (size_t i = n;; i++) {
+        uint64 x = mix_hash(h);
+        uint64 &bin = bins[x >> bin_shift];
+        if (x < bin) {
+            bin = x;
+        }
+        if (x < kth) {
+            vector<uint64>::iterator it = lower_bound(kept.begin(), kept.end(), x);
+            if (it == kept.end() || *it != x) {
+                kept.insert(it, x);
+                if (kept.size() > (size_t)_k) {
+                    kept.pop_back();
+                }
+                if (kept.size() == (size_t)_k) {
+                    kth = kept.back();
+                }
+            }
+        }
+        if (i == len) {
+            break;
+        }
+        h = (B * h + char_hashes[d[i]] - BtoN * char_hashes[d[i - n]]) & mask;
+    }
+    sketch._num_qgrams = (long long)(len - n + 1);
+
+    // An empty bin takes the value of the next non-empty bin, remixed with the distance to
+    //  it so that neighbouring empty bins do not all agree. Some bin is not empty
+    int k = _k;
+    int next_full = k - 1;
+    while (bins[next_full] == EMPTY_BIN) {
+        next_full--;
+    }
+    int per_word = 64 / _b;
+    uint64 field = ((uint64)1 << _b) - 1;
+    for (int i = k - 1; i >= 0; i--) {
+        uint64 value;
+        if (bins[i] != EMPTY_BIN) {
+            next_full = i;
+            value = bins[i];
+        } else {
+            int distance = next_full > i ? next_full - i : next_full + k - i;
+            value = mix_hash(bins[next_full] + (uint64)distance);
+        }
+        sketch._signature[i / per_word] |= (value & field) << ((i % per_word) * _b);
+    }
+}
+
+bool FileSketcher::sketch_file(const string &path, FileSketch &sketch) const
+{
+    sketch._name = path;
+    MappedFile mapped;
+    if (!mapped.open(path)) {
+        this->sketch(ByteView(), sketch);
+        return false;
+    }
+    this->sketch(mapped.get_view(), sketch);
+    return true;
+}
+
+/*
+ * Sketches one file per task for sketch_files()
+ */
+struct SketchFilesJob
+{
+    const FileSketcher *_sketcher;
+    const vector<string> *_paths;
+    vector<FileSketch> *_sketches;
+    atomic<bool> _failed;
+
+    SketchFilesJob() : _sketcher(0), _paths(0), _sketches(0), _failed(false) {}
+
+    void run(size_t i)
+    {
+        if (!_sketcher->sketch_file((*_paths)[i], (*_sketches)[i])) {
+            _failed = true;
+        }
+    }
+};
+
+bool FileSketcher::sketch_files(const vector<string> &paths, vector<FileSketch> &sketches, int num_threads) const
+{
+    sketches.clear();
+    sketches.resize(paths.size());
+    SketchFilesJob job;
+    job._sketcher = this;
+    job._paths = &paths;
+    job._sketches = &sketches;
+    run_tasks(job, paths.size(), num_threads);
+    return !job._failed;
+}
+
+double FileSketcher::estimate_bottom_k(const FileSketch &a, const FileSketch &b) const
+{
+    if (a._bottom_k.empty() || b._bottom_k.empty()) {
+        return 0;
+    }
+    // The k smallest values of A | B are a sample of it, and the fraction of them that are
+    //  in both sketches estimates the fraction of A | B that is in A & B
+    vector<uint64>::const_iterator ia = a._bottom_k.begin(), ib = b._bottom_k.begin();
+    int count = 0, both = 0;
+    while (count < _k && (ia != a._bottom_k.end() || ib != b._bottom_k.end())) {
+        if (ib == b._bottom_k.end() || (ia != a._bottom_k.end() && *ia < *ib)) {
+            ia++;
+        } else if (ia == a._bottom_k.end() || *ib < *ia) {
+            ib++;
+        } else {
+            both++;
+            ia++;
+            ib++;
+        }
+        count++;
+    }
+    return (double)both / count;
+}
+
+/*
+ * Number of the k bins of two b-bit signatures that differ
+ */
+static int count_differences(const uint64 *a, const uint64 *b, size_t num_words, int bits, uint64 field_mask)
+{
+    int differences = 0;
+    for (size_t i = 0; i < num_words; i++) {
+        uint64 x = a[i] ^ b[i];
+        // Fold each field's bits down to its lowest bit
+        uint64 y = x;
+        for (int s = 1; s < bits; s++) {
+            y |= x >> s;
+        }
+        differences += (int)BitFilter::popcount(y & field_mask);
+    }
+    return differences;
+}
+
+/*
+ * Jaccard similarity from the fraction of equal bins of two b-bit signatures. Bins of
+ *  unrelated files still agree 1 time in 2^b by chance
+ */
+static double signature_similarity(int differences, int k, int b)
+{
+    double chance = 1.0 / (double)((uint64)1 << b);
+    double equal = (double)(k - differences) / k;
+    double similarity = (equal - chance) / (1 - chance);
+    return similarity < 0 ? 0 : similarity;
+}
+
+double FileSketcher::estimate_signature(const FileSketch &a, const FileSketch &b) const
+{
+    if (a._num_qgrams == 0 || b._num_qgrams == 0) {
+        return 0;
+    }
+    int differences = count_differences(&a._signature[0], &b._signature[0], a._signature.size(), _b, _field_mask);
+    return signature_similarity(differences, _k, _b);
+}
+
+/*
+ * Compares one sketch with all the later ones per task for find_similar()
+ */
+struct FindSimilarJob
+{
+    const FileSketcher *_sketcher;
+    const vector<FileSketch> *_sketches;
+    double _threshold;
+    // Pairs with more differing bins than this are not rescored
+    int _max_differences;
+    uint64 _field_mask;
+
+    mutex _mutex;
+    vector<SketchPair> _pairs;
+
+    void run(size_t i)
+    {
+        const vector<FileSketch> &sketches = *_sketches;
+        const FileSketch &a = sketches[i];
+        if (a._num_qgrams == 0) {
+            return;
+        }
+        size_t num_words = a._signature.size();
+        int b = _sketcher->get_b();
+        vector<SketchPair> found;
+        for (size_t j = i + 1; j < sketches.size(); j++) {
+            const FileSketch &other = sketches[j];
+            if (other._num_qgrams == 0) {
+                continue;
+            }
+            if (count_differences(&a._signature[0], &other._signature[0], num_words, b, _field_mask) > _max_differences) {
+                continue;
+            }
+            double similarity = _sketcher->estimate_bottom_k(a, other);
+            if (similarity >= _threshold) {
+                SketchPair pair;
+                pair._a = (int)i;
+                pair._b = (int)j;
+                pair._similarity = similarity;
+                found.push_back(pair);
+            }
+        }
+        if (!found.empty()) {
+            lock_guard<mutex> lock(_mutex);
+            _pairs.insert(_pairs.end(), found.begin(), found.end());
+        }
+    }
+};
+
+static bool compare_pairs(const SketchPair &x, const SketchPair &y)
+{
+    return x._a != y._a ? x._a < y._a : x._b < y._b;
+}
+
+void FileSketcher::find_similar(const vector<FileSketch> &sketches, double threshold, vector<SketchPair> &pairs,
+                                int num_threads) const
+{
+    // A signature's fraction of equal bins has a standard error of at most 0.5 / sqrt(k), so
+    //  a similarity of at least threshold - margin on the signatures is a candidate
+    double chance = 1.0 / (double)((uint64)1 << _b);
+    double margin = SIGNATURE_MARGIN * 0.5 / sqrt((double)_k) / (1 - chance);
+    double min_equal = (threshold - margin) * (1 - chance) + chance;
+    int max_differences = min_equal <= 0 ? _k : (int)floor(_k * (1 - min_equal));
+
+    FindSimilarJob job;
+    job._sketcher = this;
+    job._sketches = &sketches;
+    job._threshold = threshold;
+    job._max_differences = max_differences;
+    job._field_mask = _field_mask;
+    run_tasks(job, sketches.size(), num_threads);
+
+    pairs.swap(job._pairs);
+    sort(pairs.begin(), pairs.end(), compare_pairs);
+}
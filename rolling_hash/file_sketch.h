@@ -0,0 +1,129 @@
+#ifndef _FILE_SKETCH_H_
+#define _FILE_SKETCH_H_
+
+#include <string>
+#include <vector>
+#include "byteview.h"
+#include "rabinkarphash.h"
+
+/*
+ * MinHash sketches of the q-grams of a file
+ *  _bottom_k is the k smallest distinct hash values of the q-grams in increasing order, or
+ *      all of them if there are fewer than k
+ *  _signature is a one permutation b-bit MinHash: the hash values are split into k bins by
+ *      their top bits and the low b bits of the smallest value in each bin are packed 64/b
+ *      to a word. Empty bins borrow from the next non-empty bin
+ */
+struct FileSketch
+{
+    std::string _name;
+    // Number of q-grams hashed. 0 if the file is shorter than q
+    long long _num_qgrams;
+    std::vector<uint64> _bottom_k;
+    std::vector<uint64> _signature;
+
+    FileSketch() : _num_qgrams(0) {}
+};
+
+/*
+ * A pair of sketches found by FileSketcher::find_similar()
+ */
+struct SketchPair
+{
+    // Indexes of the sketches, _a < _b
+    int _a, _b;
+    // Estimated Jaccard similarity of their sets of q-grams
+    double _similarity;
+};
+
+/*
+ * Sketches files so that similar ones can be grouped without comparing their contents.
+ *
+ * The Jaccard similarity of two files' sets of q-grams, |A & B| / |A | B|, is estimated from
+ *  their sketches. Files made by the same printer driver or from the same template share most
+ *  of their q-grams so they score high, while unrelated files score near 0.
+ *
+ * The q-grams are hashed with a KarpRabinHash rolled over the file. Its 30 bit value is mixed
+ *  to 64 bits so that the order of the hash values is random, and only values that beat the
+ *  current k-th smallest or the minimum of their bin are looked at again, so sketching costs
+ *  about as much as one rolling hash pass.
+ *
+ * estimate_bottom_k() uses the bottom-k sketches and is the more accurate, with a standard
+ *  error of about sqrt(J(1-J)/k). estimate_signature() compares the b-bit signatures, which
+ *  are k*b bits instead of k*64, a few popcounts per pair, so find_similar() uses it to
+ *  compare every pair of thousands of files and then rescores the pairs it keeps with the
+ *  bottom-k sketches.
+ */
+class FileSketcher
+{
+public:
+    enum { DEFAULT_Q = 8 };
+    enum { DEFAULT_K = 256 };
+    enum { DEFAULT_B = 2 };
+
+private:
+    // q-gram length, sketch size and bits per bin of the b-bit signature
+    int _q, _k, _b;
+    // Number of top bits of a hash value that give its bin
+    int _bin_bits;
+    // The lowest bit of each b-bit field of a signature word
+    uint64 _field_mask;
+    KarpRabinHash *_hash;
+
+    FileSketcher(const FileSketcher &);
+    FileSketcher &operator=(const FileSketcher &);
+
+public:
+    FileSketcher();
+    ~FileSketcher();
+
+    /*
+     * Set the q-gram length, the number of hash values kept and the bits kept per bin of the
+     *  b-bit signature
+     * Returns: false and writes a message to cerr if k is not a power of 2 from 64 to 2^16,
+     *  b is not 1, 2, 4, 8 or 16, or q is out of range
+     */
+    bool init(int q = DEFAULT_Q, int k = DEFAULT_K, int b = DEFAULT_B);
+
+    int get_q() const { return _q; }
+    int get_k() const { return _k; }
+    int get_b() const { return _b; }
+
+    /*
+     * Sketch data
+     */
+    void sketch(ByteView data, FileSketch &sketch) const;
+
+    /*
+     * Sketch the file at path. sketch._name is set to path
+     * Returns: false if the file could not be read
+     */
+    bool sketch_file(const std::string &path, FileSketch &sketch) const;
+
+    /*
+     * Sketch the files at paths on num_threads threads, 0 for one per core. sketches[i] is
+     *  the sketch of paths[i]
+     * Returns: false if any file could not be read. Its sketch is empty
+     */
+    bool sketch_files(const std::vector<std::string> &paths, std::vector<FileSketch> &sketches, int num_threads = 0) const;
+
+    /*
+     * Estimated Jaccard similarity of the files a and b were made from. a and b must come
+     *  from sketchers with the same settings. Files with no q-grams have similarity 0
+     */
+    double estimate_bottom_k(const FileSketch &a, const FileSketch &b) const;
+    double estimate_signature(const FileSketch &a, const FileSketch &b) const;
+
+    /*
+     * Find all the pairs of sketches whose estimated similarity is at least threshold.
+     *  Every pair's b-bit signatures are compared on num_threads threads, 0 for one per core.
+     *  The pairs whose signatures are within the signatures' error of threshold are then
+     *  rescored with estimate_bottom_k() and kept if that is at least threshold
+     * Params:
+     *  pairs: set to the pairs found, in order of _a then _b
+     */
+    void find_similar(const std::vector<FileSketch> &sketches, double threshold, std::vector<SketchPair> &pairs,
+                      int num_threads = 0) const;
+};
+
+#endif // _FILE_SKETCH_H_
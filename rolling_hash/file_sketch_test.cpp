@@ -0,0 +1,247 @@
+/*
+ * Tests of FileSketcher: the estimates are checked against the exact Jaccard similarity of
+ *  the q-gram sets of generated inputs, and find_similar() and sketch_files() against the
+ *  pairs and files they were given.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "file_sketch.h"
+#include "unit_test.h"
+
+using namespace std;
+
+// Length of the generated inputs
+static const size_t NUM_TEST_CHARS = 60000;
+
+/*
+ * Exact Jaccard similarity of the sets of q-grams of a and b
+ */
+static double get_jaccard(const vector<byte> &a, const vector<byte> &b, int q)
+{
+    set<string> qa, qb;
+    for (size_t i = 0; i + q <= a.size(); i++) {
+        qa.insert(string(a.begin() + i, a.begin() + i + q));
+    }
+    for (size_t i = 0; i + q <= b.size(); i++) {
+        qb.insert(string(b.begin() + i, b.begin() + i + q));
+    }
+    if (qa.empty() || qb.empty()) {
+        return 0.0;
+    }
+    size_t both = 0;
+    for (set<string>::const_iterator it = qa.begin(); it != qa.end(); it++) {
+        both += qb.count(*it);
+    }
+    return (double)both / (double)(qa.size() + qb.size() - both);
+}
+
+static vector<byte> make_random(size_t len, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<byte> data(len);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (byte)rng();
+    }
+    return data;
+}
+
+/*
+ * A copy of data shifted by shift bytes, so it shares len - shift bytes with it, with
+ *  num_edits random bytes changed
+ */
+static vector<byte> make_variant(const vector<byte> &data, size_t shift, int num_edits, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<byte> variant(data.begin() + shift, data.end());
+    vector<byte> tail = make_random(shift, seed + 1000);
+    variant.insert(variant.end(), tail.begin(), tail.end());
+    for (int i = 0; i < num_edits; i++) {
+        variant[rng() % variant.size()] = (byte)rng();
+    }
+    return variant;
+}
+
+static ByteView get_view(const vector<byte> &data)
+{
+    return ByteView(data.empty() ? 0 : &data[0], data.size());
+}
+
+struct SketcherConfig
+{
+    int _q, _k, _b;
+    // Allowed error of the estimates, about 4 standard errors
+    double _bottom_k_error, _signature_error;
+};
+
+static void test_estimates()
+{
+    static const SketcherConfig configs[] = {
+        { FileSketcher::DEFAULT_Q, FileSketcher::DEFAULT_K, FileSketcher::DEFAULT_B, 0.13, 0.2 },
+        { 5, 1024, 4, 0.065, 0.08 },
+        { 16, 4096, 1, 0.035, 0.1 },
+    };
+    vector<byte> base = make_random(NUM_TEST_CHARS, 1);
+    // Shifts and edits that give similarities from 0 to 1
+    static const size_t shifts[] = { 0, 0, 3000, 10000, 20000, 30000, 45000, 59000 };
+    static const int edits[] = { 0, 100, 0, 50, 0, 10, 0, 0 };
+    vector<vector<byte> > variants;
+    for (size_t i = 0; i < sizeof(shifts) / sizeof(shifts[0]); i++) {
+        variants.push_back(make_variant(base, shifts[i], edits[i], 2 + (unsigned)i));
+    }
+    variants.push_back(make_random(NUM_TEST_CHARS, 99));
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        const SketcherConfig &config = configs[c];
+        FileSketcher sketcher;
+        if (!CHECK(sketcher.init(config._q, config._k, config._b))) {
+            continue;
+        }
+        FileSketch base_sketch;
+        sketcher.sketch(get_view(base), base_sketch);
+        CHECK(base_sketch._num_qgrams == (long long)(base.size() - config._q + 1));
+        CHECK(base_sketch._bottom_k.size() == (size_t)config._k);
+        bool increasing = true;
+        for (size_t i = 1; i < base_sketch._bottom_k.size(); i++) {
+            increasing = increasing && base_sketch._bottom_k[i - 1] < base_sketch._bottom_k[i];
+        }
+        CHECK(increasing);
+
+        for (size_t i = 0; i < variants.size(); i++) {
+            double exact = get_jaccard(base, variants[i], config._q);
+            char note[160];
+            sprintf(note, "sketch q=%d k=%d b=%d, variant %d with similarity %.3f", config._q, config._k, config._b, (int)i, exact);
+            unit_note(note);
+            FileSketch sketch;
+            sketcher.sketch(get_view(variants[i]), sketch);
+            double bottom_k = sketcher.estimate_bottom_k(base_sketch, sketch);
+            double signature = sketcher.estimate_signature(base_sketch, sketch);
+            CHECK(fabs(bottom_k - exact) <= config._bottom_k_error);
+            CHECK(fabs(signature - exact) <= config._signature_error);
+            CHECK(sketcher.estimate_bottom_k(sketch, base_sketch) == bottom_k);
+            if (exact == 1.0) {
+                CHECK(bottom_k == 1.0 && signature == 1.0);
+            }
+        }
+    }
+}
+
+/*
+ * Files shorter than q have no q-grams and are similar to nothing
+ */
+static void test_short_files()
+{
+    unit_note("sketch of files shorter than q");
+    FileSketcher sketcher;
+    CHECK(sketcher.init());
+    vector<byte> data = make_random(FileSketcher::DEFAULT_Q - 1, 3);
+    FileSketch a, b;
+    sketcher.sketch(get_view(data), a);
+    sketcher.sketch(ByteView(), b);
+    CHECK(a._num_qgrams == 0 && a._bottom_k.empty());
+    CHECK(sketcher.estimate_bottom_k(a, a) == 0.0 && sketcher.estimate_signature(a, b) == 0.0);
+
+    // Fewer distinct q-grams than k are all kept
+    data = make_random(100, 4);
+    sketcher.sketch(get_view(data), a);
+    CHECK(a._num_qgrams == 100 - FileSketcher::DEFAULT_Q + 1 && a._bottom_k.size() == (size_t)a._num_qgrams);
+    CHECK(sketcher.estimate_bottom_k(a, a) == 1.0);
+}
+
+static void test_find_similar()
+{
+    FileSketcher sketcher;
+    CHECK(sketcher.init());
+    // Two families of near copies and an unrelated file, interleaved so that the pairs are
+    //  not adjacent: 0, 3 and 5 are one family, 1 and 4 another
+    vector<byte> x = make_random(NUM_TEST_CHARS, 10);
+    vector<byte> y = make_random(NUM_TEST_CHARS, 11);
+    vector<vector<byte> > files;
+    files.push_back(x);
+    files.push_back(y);
+    files.push_back(make_random(NUM_TEST_CHARS, 12));
+    files.push_back(make_variant(x, 1000, 20, 13));
+    files.push_back(make_variant(y, 2000, 0, 14));
+    files.push_back(x);
+    vector<FileSketch> sketches(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        sketcher.sketch(get_view(files[i]), sketches[i]);
+    }
+
+    static const int expected[][2] = { { 0, 3 }, { 0, 5 }, { 1, 4 }, { 3, 5 } };
+    static const int num_threads[] = { 1, 3, 0 };
+    for (size_t t = 0; t < sizeof(num_threads) / sizeof(num_threads[0]); t++) {
+        unit_note("find_similar with " + to_string(num_threads[t]) + " threads");
+        vector<SketchPair> pairs;
+        sketcher.find_similar(sketches, 0.5, pairs, num_threads[t]);
+        bool same = pairs.size() == sizeof(expected) / sizeof(expected[0]);
+        for (size_t i = 0; same && i < pairs.size(); i++) {
+            same = pairs[i]._a == expected[i][0] && pairs[i]._b == expected[i][1] &&
+                   pairs[i]._similarity == sketcher.estimate_bottom_k(sketches[pairs[i]._a], sketches[pairs[i]._b]);
+        }
+        CHECK(same);
+        CHECK(same && pairs[1]._similarity == 1.0);
+    }
+
+    unit_note("find_similar with a threshold above every pair but the copies");
+    vector<SketchPair> pairs;
+    sketcher.find_similar(sketches, 0.99, pairs, 2);
+    CHECK(pairs.size() == 1 && pairs[0]._a == 0 && pairs[0]._b == 5);
+    sketcher.find_similar(vector<FileSketch>(), 0.5, pairs);
+    CHECK(pairs.empty());
+}
+
+static void test_sketch_files()
+{
+    unit_note("sketch_files");
+    FileSketcher sketcher;
+    CHECK(sketcher.init());
+    vector<byte> data = make_random(NUM_TEST_CHARS, 20);
+    string path = unit_temp_path("sketch");
+    CHECK(unit_write_file(path, get_view(data)));
+    FileSketch expected;
+    sketcher.sketch(get_view(data), expected);
+
+    vector<string> paths;
+    paths.push_back(path);
+    paths.push_back(unit_temp_path("sketch_missing"));
+    paths.push_back(path);
+    vector<FileSketch> sketches;
+    CHECK(!sketcher.sketch_files(paths, sketches, 2));
+    CHECK(sketches.size() == 3);
+    if (sketches.size() == 3) {
+        CHECK(sketches[0]._name == path && sketches[0]._bottom_k == expected._bottom_k && sketches[0]._signature == expected._signature);
+        CHECK(sketches[2]._bottom_k == expected._bottom_k);
+        CHECK(sketches[1]._name == paths[1] && sketches[1]._num_qgrams == 0 && sketches[1]._bottom_k.empty());
+        CHECK(sketcher.estimate_bottom_k(sketches[0], sketches[1]) == 0.0);
+    }
+
+    paths.erase(paths.begin() + 1);
+    CHECK(sketcher.sketch_files(paths, sketches));
+    CHECK(sketches.size() == 2 && sketches[1]._signature == expected._signature);
+    remove(path.c_str());
+}
+
+static void test_init_errors()
+{
+    unit_note("sketcher init errors");
+    FileSketcher sketcher;
+    CHECK(!sketcher.init(0));
+    CHECK(!sketcher.init(8, 100));
+    CHECK(!sketcher.init(8, 32));
+    CHECK(!sketcher.init(8, 1 << 17));
+    CHECK(!sketcher.init(8, 256, 3));
+    CHECK(sketcher.init(8, 64, 16));
+}
+
+void test_file_sketch()
+{
+    test_estimates();
+    test_short_files();
+    test_find_similar();
+    test_sketch_files();
+    test_init_errors();
+}
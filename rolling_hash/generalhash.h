@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "characterhash.h"
+#include "gf2poly.h"
 
 using namespace std;
 
@@ -19,22 +20,24 @@ class GeneralHash {
           irreduciblepoly(0), 
           hasher(( 1<<wordsize ) - 1),
           lastbit(static_cast<hashvaluetype>(1)<<wordsize),
-           precomputedshift(precomputationtype==FULLPRECOMP ? (1<<n) : 0){
-    		  if(wordsize == 19) {
-       			 irreduciblepoly = 1 + (1<<2) + (1<<3) + (1<<5) 
-       			 + (1<<6) + (1<<7) + (1<<12) + (1<<16) + (1<<17) 
-       			 + (1<<18) + (1<<19);
-      			} else if (wordsize == 9) {
+           precomputedshift(precomputationtype==FULLPRECOMP ? 256 : 0){
+    		  // There used to be a fixed polynomial for wordsize 19 but it is divisible by
+    		  //  x^2 + x + 1, so 19 now gets a random irreducible polynomial like the others
+    		  if (wordsize == 9) {
         			irreduciblepoly = 1+(1<<2)+(1<<3)+(1<<5)+(1<<9);
       			} else {
-        			cerr << "unsupport wordsize "<<wordsize << endl;
+        			// Any other wordsize gets a random irreducible polynomial
+        			assert(wordsize >= 1 && wordsize < 32);
+        			irreduciblepoly = static_cast<hashvaluetype>(GF2Poly::find_irreducible(wordsize, 25)) | lastbit;
       			}
       		   // in case the precomp is activated at the template level
+      		   // precomputedshift[c] is the hash of c shifted n times, which is what
+      		   //  c contributes when it leaves the window. 256 entries for any n
       		   if(precomputationtype==FULLPRECOMP) {
-      		   	for(hashvaluetype x = 0; x<precomputedshift.size();++x) {
-      		   		hashvaluetype leftover = x << (wordsize-n);
+      		   	for(hashvaluetype c = 0; c<precomputedshift.size();++c) {
+      		   		hashvaluetype leftover = hasher.hashvalues[c];
       		   		fastleftshift(leftover, n);
-      		   		precomputedshift[x]=leftover;
+      		   		precomputedshift[c]=leftover;
       		   	}
       		   }
     }
@@ -48,26 +51,16 @@ class GeneralHash {
       }
     }
     
-    inline void fastleftshiftn(hashvaluetype & x) const {
-      x=
-      // take the last n bits and look-up the result
-      precomputedshift[(x >> (wordsize-n))] 
-      ^
-      // then just shift the first L-n bits
-      ((x << n) & (lastbit -1 ));
-    }
-    
     inline void update(chartype outchar, chartype inchar) {
       _hashvalue <<= 1;
       if(( _hashvalue & lastbit) == lastbit)
           _hashvalue ^= irreduciblepoly;
       //
-      hashvaluetype z (hasher.hashvalues[outchar]);
       // the compiler should optimize away the next if/else
       if(precomputationtype==FULLPRECOMP) { 
-        fastleftshiftn(z);
-        _hashvalue ^= z ^ hasher.hashvalues[inchar];
+        _hashvalue ^= precomputedshift[outchar] ^ hasher.hashvalues[inchar];
       } else { 
+        hashvaluetype z (hasher.hashvalues[outchar]);
         fastleftshift(z,n);
         _hashvalue ^= z ^ hasher.hashvalues[inchar];
       }
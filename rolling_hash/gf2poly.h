@@ -0,0 +1,209 @@
+#ifndef _GF2POLY_H_
+#define _GF2POLY_H_
+
+/*
+ * Arithmetic on polynomials over GF(2) of degree < 64 modulo a polynomial of degree
+ *  1 <= d <= 64, for setting up Rabin fingerprints of any word size.
+ *
+ * A polynomial is stored as the bits of a uint64, bit i being the coefficient of x^i. A
+ *  modulus of degree d is stored without its x^d term, so a degree 64 modulus fits.
+ *
+ * This is only used when hashes are constructed, but constructing a hash with a long window
+ *  needs x^(8n) mod P and finding an irreducible P needs a few thousand multiplications, so
+ *  carry-less multiply (PCLMULQDQ) is used where it is available.
+ */
+#include "characterhash.h"
+#if defined(__PCLMUL__) || (defined(_MSC_VER) && defined(_M_X64))
+#include <wmmintrin.h>
+#define GF2_HAVE_CLMUL 1
+#endif
+
+class GF2Poly
+{
+public:
+    /*
+     * Carry-less product of a and b. Returns the low 64 bits and sets *hi to the high 64 bits
+     */
+    static uint64 clmul(uint64 a, uint64 b, uint64 *hi)
+    {
+#if defined(GF2_HAVE_CLMUL)
+        __m128i p = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)a), _mm_cvtsi64_si128((long long)b), 0);
+        *hi = (uint64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(p, p));
+        return (uint64)_mm_cvtsi128_si64(p);
+#else
+        uint64 lo = 0, h = 0;
+        for (int i = 0; i < 64; i++) {
+            if ((b >> i) & 1) {
+                lo ^= a << i;
+                h ^= i ? a >> (64 - i) : 0;
+            }
+        }
+        *hi = h;
+        return lo;
+#endif
+    }
+
+    /*
+     * a * b mod P where P = x^d + poly and a, b have degree < d
+     */
+    static uint64 mulmod(uint64 a, uint64 b, uint64 poly, int d)
+    {
+        uint64 hi, lo = clmul(a, b, &hi);
+        // Clear the bits of the product from the top down to x^d. Bit i of the 128 bit
+        //  product is x^i = x^(i-d) * poly mod P
+        for (int i = 127; i >= d; i--) {
+            bool set = i >= 64 ? ((hi >> (i - 64)) & 1) != 0 : ((lo >> i) & 1) != 0;
+            if (!set) {
+                continue;
+            }
+            if (i >= 64) {
+                hi ^= (uint64)1 << (i - 64);
+            } else {
+                lo ^= (uint64)1 << i;
+            }
+            xor_shifted(poly, i - d, &lo, &hi);
+        }
+        return lo;
+    }
+
+    /*
+     * x^e mod P
+     */
+    static uint64 xpow(uint64 e, uint64 poly, int d)
+    {
+        uint64 result = 1;
+        uint64 base = reduce_x(poly, d);
+        for (; e; e >>= 1) {
+            if (e & 1) {
+                result = mulmod(result, base, poly, d);
+            }
+            base = mulmod(base, base, poly, d);
+        }
+        return result;
+    }
+
+    /*
+     * Is x^d + poly irreducible? Rabin's test: it is if x^(2^d) = x mod P and
+     *  gcd(x^(2^(d/q)) - x, P) = 1 for every prime q dividing d
+     */
+    static bool is_irreducible(uint64 poly, int d)
+    {
+        if (!(poly & 1)) {
+            return false;
+        }
+        uint64 x = reduce_x(poly, d);
+        if (x2pow(d, poly, d) != x) {
+            return false;
+        }
+        for (int q = 2; q <= d; q++) {
+            if (d % q || !is_prime(q)) {
+                continue;
+            }
+            if (gcd_with_modulus(x2pow(d / q, poly, d) ^ x, poly, d) != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Return a random irreducible polynomial of degree d, without its x^d term. The same seed
+     *  always gives the same polynomial
+     */
+    static uint64 find_irreducible(int d, uint32 seed)
+    {
+        assert(d >= 1 && d <= 64);
+        MTRand rand(seed);
+        uint64 mask = d == 64 ? ~(uint64)0 : ((uint64)1 << d) - 1;
+        for (;;) {
+            uint64 poly = ((((uint64)rand.randInt() << 32) | rand.randInt()) & mask) | 1;
+            if (is_irreducible(poly, d)) {
+                return poly;
+            }
+        }
+    }
+
+private:
+    /*
+     * *lo, *hi ^= poly * x^shift for poly of degree < 64 and shift < 64
+     */
+    static void xor_shifted(uint64 poly, int shift, uint64 *lo, uint64 *hi)
+    {
+        *lo ^= poly << shift;
+        if (shift) {
+            *hi ^= poly >> (64 - shift);
+        }
+    }
+
+    /*
+     * x mod P. Only differs from x when d = 1
+     */
+    static uint64 reduce_x(uint64 poly, int d)
+    {
+        return d > 1 ? 2 : poly;
+    }
+
+    /*
+     * x^(2^k) mod P
+     */
+    static uint64 x2pow(int k, uint64 poly, int d)
+    {
+        uint64 r = reduce_x(poly, d);
+        for (int i = 0; i < k; i++) {
+            r = mulmod(r, r, poly, d);
+        }
+        return r;
+    }
+
+    static int degree(uint64 a)
+    {
+        int deg = -1;
+        for (; a; a >>= 1) {
+            deg++;
+        }
+        return deg;
+    }
+
+    /*
+     * a mod b for b != 0
+     */
+    static uint64 polymod(uint64 a, uint64 b)
+    {
+        int db = degree(b);
+        for (int da = degree(a); da >= db; da = degree(a)) {
+            a ^= b << (da - db);
+        }
+        return a;
+    }
+
+    /*
+     * gcd(a, P) for a of degree < d
+     */
+    static uint64 gcd_with_modulus(uint64 a, uint64 poly, int d)
+    {
+        if (!a) {
+            return 0;
+        }
+        // b = P mod a. x^d mod a is computed as x^(d-1) mod a times x so it fits when d = 64
+        uint64 xd = polymod(polymod((uint64)1 << (d - 1), a) << 1, a);
+        uint64 b = xd ^ polymod(poly, a);
+        while (b) {
+            uint64 r = polymod(a, b);
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+
+    static bool is_prime(int q)
+    {
+        for (int i = 2; i * i <= q; i++) {
+            if (q % i == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // _GF2POLY_H_
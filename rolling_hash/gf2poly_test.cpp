@@ -0,0 +1,131 @@
+/*
+ * Tests of the GF(2) arithmetic in gf2poly.h and the hashes built on it: the irreducibility
+ *  test is checked against the known number of irreducible polynomials of small degrees,
+ *  and RabinFingerprint and GeneralHash are rolled over random data and checked against
+ *  hashing each window from scratch.
+ */
+#include <random>
+#include <string>
+#include <vector>
+#include "generalhash.h"
+#include "gf2poly.h"
+#include "rabinfingerprint.h"
+#include "unit_test.h"
+
+using namespace std;
+
+// Bytes of random data that the hashes are rolled over
+static const size_t NUM_TEST_CHARS = 20000;
+
+static vector<chartype> make_random(size_t len, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<chartype> data(len);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (chartype)rng();
+    }
+    return data;
+}
+
+/*
+ * There are 30 irreducible polynomials of degree 8, 335 of degree 12 and 27594 of degree 19
+ */
+static void test_irreducible_counts()
+{
+    static const int degrees[] = { 8, 12, 19 };
+    static const int expected[] = { 30, 335, 27594 };
+    for (size_t i = 0; i < sizeof(degrees) / sizeof(degrees[0]); i++) {
+        int d = degrees[i];
+        unit_note("irreducible polynomials of degree " + to_string(d));
+        int count = 0;
+        for (uint64 poly = 0; poly < ((uint64)1 << d); poly++) {
+            count += GF2Poly::is_irreducible(poly, d);
+        }
+        CHECK(count == expected[i]);
+        uint64 found = GF2Poly::find_irreducible(d, 7);
+        CHECK(found < ((uint64)1 << d) && GF2Poly::is_irreducible(found, d));
+        CHECK(GF2Poly::find_irreducible(d, 7) == found);
+    }
+
+    unit_note("reducible polynomials");
+    // x^8 + 1 = (x + 1)^8 and x^2 + x + 1 divides x^4 + x^2 + 1
+    CHECK(!GF2Poly::is_irreducible(1, 8));
+    CHECK(!GF2Poly::is_irreducible(0x5, 4));
+    CHECK(GF2Poly::is_irreducible(0x3, 2));
+    // x^64 + x^4 + x^3 + x + 1 is the lightest irreducible polynomial of degree 64
+    CHECK(GF2Poly::is_irreducible(0x1b, 64));
+}
+
+/*
+ * Rolling RabinFingerprint over the data gives the fingerprint of each window
+ */
+static void test_rabin_fingerprint(const vector<chartype> &data)
+{
+    static const int wordsizes[] = { 8, 32, 64 };
+    static const int lens[] = { 1, 8, 64, 1000 };
+    for (size_t w = 0; w < sizeof(wordsizes) / sizeof(wordsizes[0]); w++) {
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+            int n = lens[l];
+            unit_note("RabinFingerprint n=" + to_string(n) + " wordsize=" + to_string(wordsizes[w]));
+            RabinFingerprint hash(n, wordsizes[w]);
+            for (int i = 0; i < n; i++) {
+                hash.eat(data[i]);
+            }
+            bool same = hash._hashvalue == hash.get_hash(&data[0]);
+            bool in_range = true;
+            for (size_t i = n; i < data.size(); i++) {
+                hash.update(data[i - n], data[i]);
+                same = same && hash._hashvalue == hash.get_hash(&data[i - n + 1]);
+                in_range = in_range && (wordsizes[w] == 64 || hash._hashvalue >> wordsizes[w] == 0);
+            }
+            CHECK(same);
+            CHECK(in_range);
+            vector<chartype> window(data.end() - n, data.end());
+            CHECK(hash.hash(window) == hash._hashvalue);
+        }
+    }
+}
+
+/*
+ * GeneralHash with and without the precomputed outgoing byte table rolls to the hash of
+ *  each window, for word sizes that used to be rejected
+ */
+static void test_general_hash(const vector<chartype> &data)
+{
+    static const int wordsizes[] = { 5, 9, 13, 19, 24, 30 };
+    static const int lens[] = { 1, 7, 32, 100 };
+    for (size_t w = 0; w < sizeof(wordsizes) / sizeof(wordsizes[0]); w++) {
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+            int n = lens[l];
+            unit_note("GeneralHash n=" + to_string(n) + " wordsize=" + to_string(wordsizes[w]));
+            GeneralHash<FULLPRECOMP> full(n, wordsizes[w]);
+            GeneralHash<NOPRECOMP> none(n, wordsizes[w]);
+            CHECK(GF2Poly::is_irreducible(full.irreduciblepoly ^ full.lastbit, wordsizes[w]));
+            for (int i = 0; i < n; i++) {
+                full.eat(data[i]);
+                none.eat(data[i]);
+            }
+            bool same = full._hashvalue == none._hashvalue;
+            bool rolled = true;
+            for (size_t i = n; i < data.size(); i++) {
+                full.update(data[i - n], data[i]);
+                none.update(data[i - n], data[i]);
+                same = same && full._hashvalue == none._hashvalue;
+                if (i % 97 == 0) {
+                    vector<chartype> window(data.begin() + (i - n + 1), data.begin() + (i + 1));
+                    rolled = rolled && full._hashvalue == full.hash(window);
+                }
+            }
+            CHECK(same);
+            CHECK(rolled);
+        }
+    }
+}
+
+void test_gf2poly()
+{
+    vector<chartype> data = make_random(NUM_TEST_CHARS, 13);
+    test_irreducible_counts();
+    test_rabin_fingerprint(data);
+    test_general_hash(data);
+}
@@ -0,0 +1,627 @@
+/*
+ * Throughput benchmark of the rolling hashes.
+ *
+ * Each hash family is rolled over some input and every hash value is looked up in a BitFilter,
+ *  which is the inner loop of the fastregex scanner. This is repeated for every combination of
+ *  window length n, table width (wordsize) and hit fraction. The hit fraction is the fraction
+ *  of the filter that is set, by hashing that many n-grams taken from the input as static
+ *  strings, so there are true hits as well as collisions.
+ *
+ * The output is CSV with one line per family, input and setting
+ *      family,input,n,wordsize,hit_fraction,bytes,runs,mbps_mean,mbps_stddev,mbps_min,mbps_max,
+ *      cycles_per_byte,hits,true_hits,false_positives,baseline_mbps,change_pct
+ *  cycles_per_byte is time stamp counter ticks per byte averaged over the runs, nan where there
+ *  is no cycle counter. hits are filter hits per pass over the input, true_hits the ones where
+ *  the n-gram is one of the static strings and false_positives the rest.
+ *
+ * With -b the MB/s are compared with a CSV written by an earlier run. A family and setting
+ *  that got more than -t percent slower is reported on stderr and the exit status is 1, so
+ *  this can be run after a change to catch throughput regressions. The runs are noisy so
+ *  compare runs on the same machine and use several runs.
+ *
+ * The inputs are the files given on the command line or, if there are none, random bytes and
+ *  random lower case letters.
+ *
+ * Build: make hash_bench, or
+ *        g++ -std=c++11 -O2 -mavx2 hash_bench.cpp multilane_scanner.cpp timer.cpp -o hash_bench
+ * Run:   hash_bench [-n 5,16,32] [-w 12,19,24] [-f 0.001,0.01] [-r runs] [-s MB]
+ *          [-h family] [-b baseline.csv] [-t percent] [file...] > results.csv
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <unordered_set>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include "timer.h"
+#include "rabinkarphash.h"
+#include "rollinghash.h"
+#include "generalhash.h"
+#include "mersennehash.h"
+#include "rabinfingerprint.h"
+#include "bitfilter.h"
+#include "multilane_scanner.h"
+
+using namespace std;
+
+// Default sweep
+static const int DEFAULT_NS[] = {5, 16, 32};
+static const int DEFAULT_WORDSIZES[] = {12, 19, 24};
+static const double DEFAULT_HIT_FRACTIONS[] = {0.001, 0.01};
+static const int DEFAULT_RUNS = 5;
+static const int DEFAULT_MB = 4;
+static const double DEFAULT_THRESHOLD = 10.0;
+
+/*
+ * An input and a setting to run each hash family with
+ */
+struct BenchConfig
+{
+    string _input_name;
+    const vector<chartype> *_data;
+    int _n;
+    int _wordsize;
+    double _hit_fraction;
+    int _runs;
+};
+
+/*
+ * Results for one family and config
+ */
+struct BenchResult
+{
+    string _family;
+    double _mbps_mean, _mbps_stddev, _mbps_min, _mbps_max;
+    double _cycles_per_byte;
+    long long _hits, _true_hits;
+};
+
+/*
+ * Wrap the rolling hashes so that the benchmark can be written once. get_hash() returns the
+ *  wordsize bit table index
+ */
+class KarpRabinAdapter
+{
+    KarpRabinHash _hash;
+public:
+    KarpRabinAdapter(int n, int wordsize) : _hash(n, wordsize) {}
+    static const char *get_name() { return "KarpRabinHash"; }
+    static bool supports(int, int wordsize) { return wordsize <= 30; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return _hash._hashvalue; }
+    hashvaluetype get_hash(const chartype *data) const { return _hash.get_hash(data); }
+};
+
+template <int N, int Bits>
+class FixedKarpRabinAdapter
+{
+    RollingHash<KarpRabinFamily, N, Bits> _hash;
+public:
+    FixedKarpRabinAdapter(int, int) {}
+    static const char *get_name() { return "RollingHash<KarpRabin>"; }
+    static bool supports(int, int) { return true; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return _hash._hashvalue; }
+    hashvaluetype get_hash(const chartype *data) const { return _hash.get_hash(data); }
+};
+
+template <int Precomputation>
+class GeneralAdapter
+{
+    GeneralHash<Precomputation> _hash;
+public:
+    GeneralAdapter(int n, int wordsize) : _hash(n, wordsize) {}
+    static const char *get_name() { return Precomputation == FULLPRECOMP ? "GeneralHash<FULLPRECOMP>" : "GeneralHash<NOPRECOMP>"; }
+    static bool supports(int, int wordsize) { return wordsize < 32; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return _hash._hashvalue; }
+    hashvaluetype get_hash(const chartype *data) const
+    {
+        vector<chartype> s(data, data + _hash.n);
+        return _hash.hash(s);
+    }
+};
+
+class MersenneAdapter
+{
+    MersenneKarpRabinHash _hash;
+public:
+    MersenneAdapter(int n, int wordsize) : _hash(n, wordsize) {}
+    static const char *get_name() { return "MersenneKarpRabinHash"; }
+    static bool supports(int, int) { return true; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return _hash.get_folded(); }
+    hashvaluetype get_hash(const chartype *data) const { return MersenneKarpRabinHash::fold(_hash.get_hash(data), _hash._wordsize); }
+};
+
+class RabinAdapter
+{
+    RabinFingerprint _hash;
+public:
+    RabinAdapter(int n, int wordsize) : _hash(n, wordsize) {}
+    static const char *get_name() { return "RabinFingerprint"; }
+    static bool supports(int, int wordsize) { return wordsize >= 8; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return (hashvaluetype)_hash._hashvalue; }
+    hashvaluetype get_hash(const chartype *data) const { return (hashvaluetype)_hash.get_hash(data); }
+};
+
+static vector<chartype> make_random_bytes(int numchars)
+{
+    vector<chartype> data(numchars);
+    srand(1);
+    for (int k = 0; k < numchars; k++) {
+        data[k] = (chartype)rand();
+    }
+    return data;
+}
+
+static vector<chartype> make_random_letters(int numchars)
+{
+    vector<chartype> data(numchars);
+    srand(2);
+    for (int k = 0; k < numchars; k++) {
+        data[k] = (chartype)('a' + rand() % 26);
+    }
+    return data;
+}
+
+static vector<chartype> read_file(const char *path)
+{
+    ifstream f(path, ios::binary);
+    return vector<chartype>(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+}
+
+/*
+ * Take hit_fraction * 2^wordsize n-grams from data at random offsets as static strings
+ */
+static vector<size_t> choose_static_strings(const BenchConfig &config)
+{
+    size_t numchars = config._data->size();
+    double target = config._hit_fraction * (double)(1 << config._wordsize);
+    size_t num_strings = target < 1.0 ? 1 : (size_t)target;
+    vector<size_t> offsets;
+    srand(4);
+    for (size_t i = 0; i < num_strings; i++) {
+        size_t r = ((size_t)rand() << 16) ^ (size_t)rand();
+        offsets.push_back(r % (numchars - config._n + 1));
+    }
+    return offsets;
+}
+
+/*
+ * Set the filter bits of the static strings at offsets in data
+ */
+template <class Hash>
+static void fill_filter(const Hash &hf, const BenchConfig &config, const vector<size_t> &offsets, BitFilter &filter)
+{
+    for (vector<size_t>::const_iterator it = offsets.begin(); it != offsets.end(); it++) {
+        filter.set(hf.get_hash(&(*config._data)[*it]));
+    }
+    filter.build_ranks();
+}
+
+/*
+ * Count the filter hits and the hits that are static strings. Not timed as looking up the
+ *  n-grams costs far more than hashing
+ */
+template <class Hash>
+static void count_true_hits(const BenchConfig &config, const vector<size_t> &offsets, const BitFilter &filter, BenchResult &result)
+{
+    const vector<chartype> &data = *config._data;
+    int n = config._n;
+    unordered_set<string> static_strings;
+    for (vector<size_t>::const_iterator it = offsets.begin(); it != offsets.end(); it++) {
+        static_strings.insert(string(data.begin() + *it, data.begin() + *it + n));
+    }
+    Hash hf(n, config._wordsize);
+    result._hits = 0;
+    result._true_hits = 0;
+    for (int k = 0; k < n; k++) {
+        hf.eat(data[k]);
+    }
+    for (size_t k = 0; k + n <= data.size(); k++) {
+        if (filter.test(hf.get_hash())) {
+            result._hits++;
+            if (static_strings.count(string(data.begin() + k, data.begin() + k + n))) {
+                result._true_hits++;
+            }
+        }
+        if (k + n < data.size()) {
+            hf.update(data[k], data[k + n]);
+        }
+    }
+}
+
+/*
+ * The loop being measured: roll the hash over data and look up every value in filter
+ * Returns: number of hits
+ */
+template <class Hash>
+static long long roll(Hash &hf, const vector<chartype> &data, int n, const BitFilter &filter)
+{
+    long long hits = 0;
+    for (int k = 0; k < n; k++) {
+        hf.eat(data[k]);
+    }
+    hits += filter.test(hf.get_hash());
+    for (size_t k = n; k < data.size(); k++) {
+        hf.update(data[k - n], data[k]);
+        hits += filter.test(hf.get_hash());
+    }
+    return hits;
+}
+
+/*
+ * Turn the times of the runs into a result
+ */
+static void summarize(const BenchConfig &config, const vector<double> &times, const vector<double> &cycles, BenchResult &result)
+{
+    double mb = (double)config._data->size() / 1.0e6;
+    double sum = 0.0, sum2 = 0.0, cycle_sum = 0.0;
+    result._mbps_min = result._mbps_max = mb / times[0];
+    for (size_t i = 0; i < times.size(); i++) {
+        double mbps = mb / times[i];
+        sum += mbps;
+        sum2 += mbps * mbps;
+        cycle_sum += cycles[i];
+        result._mbps_min = mbps < result._mbps_min ? mbps : result._mbps_min;
+        result._mbps_max = mbps > result._mbps_max ? mbps : result._mbps_max;
+    }
+    double runs = (double)times.size();
+    result._mbps_mean = sum / runs;
+    double variance = runs > 1.0 ? (sum2 - sum * sum / runs) / (runs - 1.0) : 0.0;
+    result._mbps_stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+    result._cycles_per_byte = cycle_sum > 0.0 ? cycle_sum / runs / (double)config._data->size() : NAN;
+}
+
+template <class Hash>
+static bool bench_hash(const BenchConfig &config, BenchResult &result)
+{
+    if (!Hash::supports(config._n, config._wordsize)) {
+        return false;
+    }
+    result._family = Hash::get_name();
+    BitFilter filter(config._wordsize);
+    vector<size_t> offsets = choose_static_strings(config);
+    {
+        Hash hf(config._n, config._wordsize);
+        fill_filter(hf, config, offsets, filter);
+    }
+    count_true_hits<Hash>(config, offsets, filter, result);
+
+    vector<double> times, cycles;
+    for (int run = 0; run < config._runs; run++) {
+        Hash hf(config._n, config._wordsize);
+        timer_init();
+        unsigned long long start_cycles = get_cycle_count();
+        long long hits = roll(hf, *config._data, config._n, filter);
+        unsigned long long end_cycles = get_cycle_count();
+        times.push_back(get_elapsed_time());
+        cycles.push_back((double)(end_cycles - start_cycles));
+        if (hits != result._hits) {
+            fprintf(stderr, "%s: %lld hits, expected %lld\n", result._family.c_str(), hits, result._hits);
+            exit(2);
+        }
+    }
+    summarize(config, times, cycles, result);
+    return true;
+}
+
+static const char SCANNER_SCALAR_NAME[] = "MultiLaneScanner-scalar";
+static const char SCANNER_AVX2_NAME[] = "MultiLaneScanner-avx2";
+
+/*
+ * The SIMD scanner that fastregex uses. Same hash values as KarpRabinHash
+ */
+static bool bench_scanner(const BenchConfig &config, bool force_scalar, BenchResult &result)
+{
+    if (config._wordsize > 30 || (!force_scalar && !MultiLaneScanner::has_simd())) {
+        return false;
+    }
+    result._family = force_scalar ? SCANNER_SCALAR_NAME : SCANNER_AVX2_NAME;
+    KarpRabinHash hash(config._n, config._wordsize);
+    BitFilter filter(config._wordsize);
+    vector<size_t> offsets = choose_static_strings(config);
+    fill_filter(KarpRabinAdapter(config._n, config._wordsize), config, offsets, filter);
+    count_true_hits<KarpRabinAdapter>(config, offsets, filter, result);
+
+    MultiLaneScanner scanner;
+    scanner.add_window(hash, filter);
+    scanner.set_force_scalar(force_scalar);
+    // Measure the lanes even for the one window, which scan() would give to the scalar scanner
+    scanner.set_min_simd_windows(1);
+    const vector<chartype> &data = *config._data;
+    vector<ScanCandidate> candidates;
+    candidates.reserve((size_t)result._hits + 1);
+    vector<double> times, cycles;
+    for (int run = 0; run < config._runs; run++) {
+        candidates.clear();
+        timer_init();
+        unsigned long long start_cycles = get_cycle_count();
+        scanner.scan(&data[0], data.size(), 0, data.size(), candidates);
+        unsigned long long end_cycles = get_cycle_count();
+        times.push_back(get_elapsed_time());
+        cycles.push_back((double)(end_cycles - start_cycles));
+        if ((long long)candidates.size() != result._hits) {
+            fprintf(stderr, "%s: %d hits, expected %lld\n", result._family.c_str(), (int)candidates.size(), result._hits);
+            exit(2);
+        }
+    }
+    summarize(config, times, cycles, result);
+    return true;
+}
+
+/*
+ * Runs bench_hash() with a RollingHash specialized for the window length N and the wordsize,
+ *  if the wordsize is one that is compiled in
+ */
+struct BenchFixedHash
+{
+    const BenchConfig &_config;
+    BenchResult &_result;
+    bool _ran;
+
+    BenchFixedHash(const BenchConfig &config, BenchResult &result) : _config(config), _result(result), _ran(false) {}
+
+    template <int N> void run()
+    {
+        switch (_config._wordsize) {
+        case 12: _ran = bench_hash<FixedKarpRabinAdapter<N, 12> >(_config, _result); break;
+        case 16: _ran = bench_hash<FixedKarpRabinAdapter<N, 16> >(_config, _result); break;
+        case 19: _ran = bench_hash<FixedKarpRabinAdapter<N, 19> >(_config, _result); break;
+        case 24: _ran = bench_hash<FixedKarpRabinAdapter<N, 24> >(_config, _result); break;
+        }
+    }
+};
+
+/*
+ * Key of a family, input and setting in the baseline
+ */
+static string get_key(const string &family, const string &input, const string &n, const string &wordsize, const string &hit_fraction)
+{
+    return family + "," + input + "," + n + "," + wordsize + "," + hit_fraction;
+}
+
+static vector<string> split(const string &s, char sep)
+{
+    vector<string> fields;
+    stringstream ss(s);
+    string field;
+    while (getline(ss, field, sep)) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+/*
+ * Read the mbps_mean of each family, input and setting from a CSV written by this program
+ */
+static bool read_baseline(const char *path, map<string, double> &baseline)
+{
+    ifstream f(path);
+    string line;
+    if (!getline(f, line)) {
+        fprintf(stderr, "Could not read %s\n", path);
+        return false;
+    }
+    vector<string> header = split(line, ',');
+    map<string, int> columns;
+    for (int i = 0; i < (int)header.size(); i++) {
+        columns[header[i]] = i;
+    }
+    // The baseline columns may be empty, so a line only needs up to the last column used
+    const char *needed[] = {"family", "input", "n", "wordsize", "hit_fraction", "mbps_mean"};
+    size_t min_fields = 0;
+    for (int i = 0; i < (int)(sizeof(needed)/sizeof(needed[0])); i++) {
+        if (!columns.count(needed[i])) {
+            fprintf(stderr, "%s has no %s column\n", path, needed[i]);
+            return false;
+        }
+        min_fields = max(min_fields, (size_t)columns[needed[i]] + 1);
+    }
+    while (getline(f, line)) {
+        vector<string> fields = split(line, ',');
+        if (fields.size() < min_fields) {
+            continue;
+        }
+        string key = get_key(fields[columns["family"]], fields[columns["input"]], fields[columns["n"]],
+                             fields[columns["wordsize"]], fields[columns["hit_fraction"]]);
+        baseline[key] = atof(fields[columns["mbps_mean"]].c_str());
+    }
+    return true;
+}
+
+/*
+ * Write a result as a CSV line and compare it with the baseline
+ * Returns: false if it is more than threshold percent slower than the baseline
+ */
+static bool report(const BenchConfig &config, const BenchResult &result, const map<string, double> &baseline, double threshold)
+{
+    char n[16], wordsize[16], hit_fraction[32];
+    sprintf(n, "%d", config._n);
+    sprintf(wordsize, "%d", config._wordsize);
+    sprintf(hit_fraction, "%g", config._hit_fraction);
+    printf("%s,%s,%s,%s,%s,%d,%d,%.1f,%.2f,%.1f,%.1f,%.3f,%lld,%lld,%lld,",
+           result._family.c_str(), config._input_name.c_str(), n, wordsize, hit_fraction,
+           (int)config._data->size(), config._runs, result._mbps_mean, result._mbps_stddev,
+           result._mbps_min, result._mbps_max, result._cycles_per_byte,
+           result._hits, result._true_hits, result._hits - result._true_hits);
+
+    map<string, double>::const_iterator it = baseline.find(get_key(result._family, config._input_name, n, wordsize, hit_fraction));
+    if (it == baseline.end() || it->second <= 0.0) {
+        printf(",\n");
+        fflush(stdout);
+        return true;
+    }
+    double change = (result._mbps_mean - it->second) / it->second * 100.0;
+    printf("%.1f,%.1f\n", it->second, change);
+    fflush(stdout);
+    if (change < -threshold) {
+        fprintf(stderr, "REGRESSION %s %s n=%s wordsize=%s hit_fraction=%s: %.1f MB/s, was %.1f (%.1f%%)\n",
+                result._family.c_str(), config._input_name.c_str(), n, wordsize, hit_fraction,
+                result._mbps_mean, it->second, change);
+        return false;
+    }
+    return true;
+}
+
+// Number of families bench_config() runs
+static const int NUM_FAMILIES = 8;
+
+static const char *get_family_name(int family)
+{
+    switch (family) {
+    case 0: return KarpRabinAdapter::get_name();
+    case 1: return FixedKarpRabinAdapter<1, 12>::get_name();
+    case 2: return GeneralAdapter<NOPRECOMP>::get_name();
+    case 3: return GeneralAdapter<FULLPRECOMP>::get_name();
+    case 4: return MersenneAdapter::get_name();
+    case 5: return RabinAdapter::get_name();
+    case 6: return SCANNER_SCALAR_NAME;
+    case 7: return SCANNER_AVX2_NAME;
+    }
+    return "";
+}
+
+/*
+ * Run every family whose name contains family_filter on config
+ * Returns: false if any of them regressed
+ */
+static bool bench_config(const BenchConfig &config, const string &family_filter, const map<string, double> &baseline, double threshold)
+{
+    bool ok = true;
+    for (int family = 0; family < NUM_FAMILIES; family++) {
+        if (!family_filter.empty() && string(get_family_name(family)).find(family_filter) == string::npos) {
+            continue;
+        }
+        BenchResult result;
+        bool ran = false;
+        switch (family) {
+        case 0: ran = bench_hash<KarpRabinAdapter>(config, result); break;
+        case 1: {
+            BenchFixedHash fixed(config, result);
+            ran = dispatch_rolling_hash_len(config._n, fixed) && fixed._ran;
+            break;
+        }
+        case 2: ran = bench_hash<GeneralAdapter<NOPRECOMP> >(config, result); break;
+        case 3: ran = bench_hash<GeneralAdapter<FULLPRECOMP> >(config, result); break;
+        case 4: ran = bench_hash<MersenneAdapter>(config, result); break;
+        case 5: ran = bench_hash<RabinAdapter>(config, result); break;
+        case 6: ran = bench_scanner(config, true, result); break;
+        case 7: ran = bench_scanner(config, false, result); break;
+        }
+        if (ran) {
+            ok = report(config, result, baseline, threshold) && ok;
+        }
+    }
+    return ok;
+}
+
+static vector<int> parse_ints(const char *s)
+{
+    vector<int> values;
+    vector<string> fields = split(s, ',');
+    for (vector<string>::const_iterator it = fields.begin(); it != fields.end(); it++) {
+        values.push_back(atoi(it->c_str()));
+    }
+    return values;
+}
+
+static vector<double> parse_doubles(const char *s)
+{
+    vector<double> values;
+    vector<string> fields = split(s, ',');
+    for (vector<string>::const_iterator it = fields.begin(); it != fields.end(); it++) {
+        values.push_back(atof(it->c_str()));
+    }
+    return values;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<int> ns(DEFAULT_NS, DEFAULT_NS + sizeof(DEFAULT_NS)/sizeof(DEFAULT_NS[0]));
+    vector<int> wordsizes(DEFAULT_WORDSIZES, DEFAULT_WORDSIZES + sizeof(DEFAULT_WORDSIZES)/sizeof(DEFAULT_WORDSIZES[0]));
+    vector<double> hit_fractions(DEFAULT_HIT_FRACTIONS, DEFAULT_HIT_FRACTIONS + sizeof(DEFAULT_HIT_FRACTIONS)/sizeof(DEFAULT_HIT_FRACTIONS[0]));
+    int runs = DEFAULT_RUNS;
+    int mb = DEFAULT_MB;
+    double threshold = DEFAULT_THRESHOLD;
+    string family_filter;
+    map<string, double> baseline;
+    vector<const char *> input_paths;
+    for (int i = 1; i < argc; i++) {
+        bool has_arg = i + 1 < argc;
+        if (!strcmp(argv[i], "-n") && has_arg) {
+            ns = parse_ints(argv[++i]);
+        } else if (!strcmp(argv[i], "-w") && has_arg) {
+            wordsizes = parse_ints(argv[++i]);
+        } else if (!strcmp(argv[i], "-f") && has_arg) {
+            hit_fractions = parse_doubles(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && has_arg) {
+            runs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && has_arg) {
+            mb = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-h") && has_arg) {
+            family_filter = argv[++i];
+        } else if (!strcmp(argv[i], "-t") && has_arg) {
+            threshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-b") && has_arg) {
+            if (!read_baseline(argv[++i], baseline)) {
+                return 2;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: hash_bench [-n 5,16,32] [-w 12,19,24] [-f 0.001,0.01] [-r runs] [-s MB] [-h family] [-b baseline.csv] [-t percent] [file...]\n");
+            return 2;
+        } else {
+            input_paths.push_back(argv[i]);
+        }
+    }
+    if (runs < 1 || mb < 1) {
+        fprintf(stderr, "runs and MB must be at least 1\n");
+        return 2;
+    }
+    for (vector<int>::const_iterator it = wordsizes.begin(); it != wordsizes.end(); it++) {
+        if (*it < 8 || *it > 30) {
+            fprintf(stderr, "wordsize must be in [8, 30]\n");
+            return 2;
+        }
+    }
+
+    vector<pair<string, vector<chartype> > > inputs;
+    if (input_paths.empty()) {
+        inputs.push_back(make_pair(string("random"), make_random_bytes(mb << 20)));
+        inputs.push_back(make_pair(string("letters"), make_random_letters(mb << 20)));
+    }
+    for (vector<const char *>::const_iterator it = input_paths.begin(); it != input_paths.end(); it++) {
+        inputs.push_back(make_pair(string(*it), read_file(*it)));
+    }
+
+    printf("family,input,n,wordsize,hit_fraction,bytes,runs,mbps_mean,mbps_stddev,mbps_min,mbps_max,"
+           "cycles_per_byte,hits,true_hits,false_positives,baseline_mbps,change_pct\n");
+    bool ok = true;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        for (vector<int>::const_iterator n = ns.begin(); n != ns.end(); n++) {
+            if (*n < 1 || inputs[i].second.size() < (size_t)*n) {
+                continue;
+            }
+            for (vector<int>::const_iterator w = wordsizes.begin(); w != wordsizes.end(); w++) {
+                for (vector<double>::const_iterator f = hit_fractions.begin(); f != hit_fractions.end(); f++) {
+                    BenchConfig config = { inputs[i].first, &inputs[i].second, *n, *w, *f, runs };
+                    ok = bench_config(config, family_filter, baseline, threshold) && ok;
+                }
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+/*
+ * Hash quality tests for the rolling hashes used by fastregex.
+ *
+ * For each rolling hash and string length this measures, over every window of some test data
+ *  - bucket uniformity: chi-squared of the distinct n-grams over the 2^wordsize buckets
+ *      divided by its degrees of freedom. ~1.0 is uniform
+ *  - collisions: number of pairs of distinct n-grams with the same wordsize bit hash, as a
+ *      multiple of the number expected for a random function
+ *  - false hits: number of windows that hit a table of NUM_STATIC_STRINGS static strings
+ *      that do not occur in the data, as a multiple of the number expected. This is the rate
+ *      at which fastregex runs regexes for nothing. On repetitive data one unlucky collision
+ *      with a frequent n-gram dominates this, so it is also given for the distinct n-grams
+ *
+ * The test data is random bytes, random lower case letters and repetitive text like that
+ *  made by make_repeats/make_repeats.py. Files given on the command line, e.g.
+ *  make_repeats.py output, are tested too.
+ *
+ * Build: g++ -std=c++11 -O2 hash_quality_test.cpp -o hash_quality_test
+ * Run:   hash_quality_test [file...]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <fstream>
+#include <iterator>
+#include "rabinkarphash.h"
+#include "mersennehash.h"
+#include "rabinfingerprint.h"
+
+using namespace std;
+
+static const int WORDSIZE = 19;
+
+// Number of bytes of generated test data
+static const int NUM_TEST_CHARS = 1 << 20;
+
+// Number of static strings in the false hit table
+static const int NUM_STATIC_STRINGS = 1000;
+
+/*
+ * Wrap the rolling hashes so that the tests can be written once. get_hash() returns the
+ *  wordsize bit table index
+ */
+class KarpRabinAdapter
+{
+    KarpRabinHash _hash;
+public:
+    KarpRabinAdapter(int n) : _hash(n, WORDSIZE) {}
+    static const char *get_name() { return "KarpRabinHash B=37"; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return _hash._hashvalue; }
+    hashvaluetype get_hash(const chartype *data) const { return _hash.get_hash(data); }
+};
+
+class MersenneAdapter
+{
+    MersenneKarpRabinHash _hash;
+public:
+    MersenneAdapter(int n) : _hash(n, WORDSIZE) {}
+    static const char *get_name() { return "MersenneKarpRabinHash"; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return _hash.get_folded(); }
+    hashvaluetype get_hash(const chartype *data) const { return MersenneKarpRabinHash::fold(_hash.get_hash(data), WORDSIZE); }
+};
+
+class RabinAdapter
+{
+    RabinFingerprint _hash;
+public:
+    RabinAdapter(int n) : _hash(n, WORDSIZE) {}
+    static const char *get_name() { return "RabinFingerprint"; }
+    void eat(chartype c) { _hash.eat(c); }
+    void update(chartype out, chartype in) { _hash.update(out, in); }
+    hashvaluetype get_hash() const { return (hashvaluetype)_hash._hashvalue; }
+    hashvaluetype get_hash(const chartype *data) const { return (hashvaluetype)_hash.get_hash(data); }
+};
+
+static vector<chartype> make_random_bytes(int numchars)
+{
+    vector<chartype> data(numchars);
+    srand(1);
+    for (int k = 0; k < numchars; k++) {
+        data[k] = (chartype)rand();
+    }
+    return data;
+}
+
+static vector<chartype> make_random_letters(int numchars)
+{
+    vector<chartype> data(numchars);
+    srand(2);
+    for (int k = 0; k < numchars; k++) {
+        data[k] = (chartype)('a' + rand() % 26);
+    }
+    return data;
+}
+
+/*
+ * Repetitive text like make_repeats.py makes: random letters with a repeated string
+ *  written over them
+ */
+static vector<chartype> make_repeats(int numchars)
+{
+    const string repeated = "the long long long repeated string";
+    vector<chartype> data = make_random_letters(numchars);
+    srand(3);
+    for (int i = 0; i < numchars / 100; i++) {
+        int offset = rand() % (numchars - (int)repeated.size());
+        copy(repeated.begin(), repeated.end(), data.begin() + offset);
+    }
+    return data;
+}
+
+static vector<chartype> read_file(const char *path)
+{
+    ifstream f(path, ios::binary);
+    return vector<chartype>(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+}
+
+/*
+ * Return NUM_STATIC_STRINGS strings of length n that do not occur in data
+ */
+static vector<string> make_static_strings(const unordered_set<string> &ngrams, int n)
+{
+    vector<string> strings;
+    srand(4);
+    while ((int)strings.size() < NUM_STATIC_STRINGS) {
+        string s;
+        for (int k = 0; k < n; k++) {
+            s += (char)rand();
+        }
+        if (!ngrams.count(s)) {
+            strings.push_back(s);
+        }
+    }
+    return strings;
+}
+
+template <class Hash>
+static void test_hash(int n, const vector<chartype> &data)
+{
+    int numchars = (int)data.size();
+    if (numchars < n) {
+        return;
+    }
+    int table_size = 1 << WORDSIZE;
+    Hash hf(n);
+
+    // Bucket counts of the distinct n-grams
+    unordered_set<string> ngrams;
+    vector<int> counts(table_size, 0);
+    for (int k = 0; k + n <= numchars; k++) {
+        string s(data.begin() + k, data.begin() + k + n);
+        if (ngrams.insert(s).second) {
+            counts[hf.get_hash(&data[k])]++;
+        }
+    }
+    double num_distinct = (double)ngrams.size();
+    double expected = num_distinct / table_size;
+    double chi2 = 0.0;
+    double collisions = 0.0;
+    for (int i = 0; i < table_size; i++) {
+        chi2 += (counts[i] - expected) * (counts[i] - expected) / expected;
+        collisions += (double)counts[i] * (counts[i] - 1) / 2.0;
+    }
+    double expected_collisions = num_distinct * (num_distinct - 1) / 2.0 / table_size;
+
+    // False hits on static strings that are not in the data
+    vector<char> table(table_size, 0);
+    vector<string> strings = make_static_strings(ngrams, n);
+    int num_set = 0;
+    for (vector<string>::const_iterator it = strings.begin(); it != strings.end(); it++) {
+        hashvaluetype h = hf.get_hash((const chartype *)it->data());
+        if (!table[h]) {
+            table[h] = 1;
+            num_set++;
+        }
+    }
+    int num_distinct_hits = 0;
+    for (unordered_set<string>::const_iterator it = ngrams.begin(); it != ngrams.end(); it++) {
+        if (table[hf.get_hash((const chartype *)it->data())]) {
+            num_distinct_hits++;
+        }
+    }
+    int num_hits = 0;
+    for (int k = 0; k < n; k++) {
+        hf.eat(data[k]);
+    }
+    for (int k = 0; k + n <= numchars; k++) {
+        if (table[hf.get_hash()]) {
+            num_hits++;
+        }
+        if (k + n < numchars) {
+            hf.update(data[k], data[k + n]);
+        }
+    }
+    double expected_hits = (double)(numchars - n + 1) * num_set / table_size;
+    double expected_distinct_hits = num_distinct * num_set / table_size;
+
+    printf("  %-22s n=%2d distinct=%8.0f uniformity=%6.3f collisions=%6.3f false hits=%6.3f (distinct %6.3f) x expected\n",
+           Hash::get_name(), n, num_distinct, chi2 / (table_size - 1), collisions / expected_collisions,
+           num_hits / expected_hits, num_distinct_hits / expected_distinct_hits);
+}
+
+static void test_data(const string &name, const vector<chartype> &data)
+{
+    printf("%s (%d bytes)\n", name.c_str(), (int)data.size());
+    int n_vals[] = {5, 8, 16};
+    for (int i = 0; i < (int)(sizeof(n_vals)/sizeof(n_vals[0])); i++) {
+        test_hash<KarpRabinAdapter>(n_vals[i], data);
+        test_hash<MersenneAdapter>(n_vals[i], data);
+        test_hash<RabinAdapter>(n_vals[i], data);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    test_data("random bytes", make_random_bytes(NUM_TEST_CHARS));
+    test_data("random letters", make_random_letters(NUM_TEST_CHARS));
+    test_data("repeats", make_repeats(NUM_TEST_CHARS));
+    for (int i = 1; i < argc; i++) {
+        test_data(argv[i], read_file(argv[i]));
+    }
+    return 0;
+}
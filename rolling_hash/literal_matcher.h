@@ -0,0 +1,52 @@
+#ifndef _LITERAL_MATCHER_H_
+#define _LITERAL_MATCHER_H_
+
+/*
+ * Exact multi-literal matchers that can replace the rolling hash filter.
+ *
+ * The rolling hash finds offsets where a static string might be; a literal matcher finds the
+ *  offsets where one is. For rule sets that are all literals this saves both the hashing
+ *  and the false positive verifications.
+ *
+ *  AhoCorasickMatcher  a DFA over byte classes. For large sets
+ *  TeddyMatcher        SIMD nibble-shuffle filter with 8 buckets. For small sets
+ */
+#include <stddef.h>
+#include <vector>
+#include "byteview.h"
+
+/*
+ * A literal found in the input
+ */
+struct LiteralHit
+{
+    // Offset of the start of the literal in the input
+    size_t _offset;
+    // Index of the literal in the order they were added
+    int _literal;
+
+    LiteralHit(size_t offset, int literal) : _offset(offset), _literal(literal) {}
+};
+
+class LiteralMatcher
+{
+public:
+    virtual ~LiteralMatcher() {}
+
+    /*
+     * Add a literal. Literals are numbered in the order they are added. build() must be called
+     *  after the last add() and before scan()
+     */
+    virtual void add(const byte *literal, int len) = 0;
+    virtual void build() = 0;
+
+    /*
+     * Append all occurrences of the literals that start in [begin, end) of data[0..numchars)
+     *  and fit in data to hits, in increasing order of offset
+     */
+    virtual void scan(const byte *data, size_t numchars, size_t begin, size_t end, std::vector<LiteralHit> &hits) const = 0;
+
+    virtual const char *get_name() const = 0;
+};
+
+#endif // _LITERAL_MATCHER_H_
@@ -1,45 +1,65 @@
 #ifndef _LOOKAHEAD_H_
 #define _LOOKAHEAD_H_
 
+#include <vector>
+
 /*
  * The following is a very simple look ahead buffer
- * It should be efficient enough as 
- *      - contains() is called far more than push()
- *      - n > _highest + _max_lookahead far more often than it is not.
+ * It records which offsets in a sliding window of max_lookahead + 1 offsets are in the 
+ *  buffer with one bit per offset in a circular bitmap, so push(), remove() and contains() 
+ *  are all O(1) however dense the hits are.
  *
- * NOTE: It is assumed that push() is called with monotically increasing values.
+ * NOTE: It is assumed that all the offsets in the buffer at any time are within 
+ *  max_lookahead of each other.
  */
 class LookAheadBuffer {
-    const int _max_lookahead;
-    list<int> _lookahead_buffer;
-    int _highest;
+    std::vector<unsigned long long> _bits;
+    // Number of bits in _bits - 1. A power of 2 - 1
+    const long long _mask;
+    // Number of offsets in the buffer
+    int _count;
+
+    static long long get_mask(int max_lookahead)
+    {
+        long long size = 64;
+        while (size < (long long)max_lookahead + 1) {
+            size <<= 1;
+        }
+        return size - 1;
+    }
+
 public:
-    LookAheadBuffer(int max_lookahead) : _max_lookahead(max_lookahead) { _highest = 0; }
+    LookAheadBuffer(int max_lookahead) : 
+        _bits((get_mask(max_lookahead) + 1) / 64, 0),
+        _mask(get_mask(max_lookahead)),
+        _count(0)
+    {}
     
-    bool contains(int n) 
+    bool contains(long long n) const
     {
-        if (n > _highest + _max_lookahead) {
-            return false;
-        }
-        for (list<int>::iterator it = _lookahead_buffer.begin(); it != _lookahead_buffer.end(); it++) {
-            if (*it == n) {
-                return true;
-            }
-        }
-        return false;
+        long long i = n & _mask;
+        return ((_bits[i >> 6] >> (i & 63)) & 1) != 0;
     }
 
-    void push(int n)
+    void push(long long n)
     {
-        if ((int)_lookahead_buffer.size() > _max_lookahead) {
-           _lookahead_buffer.pop_front();
+        if (!contains(n)) {
+            long long i = n & _mask;
+            _bits[i >> 6] |= 1ULL << (i & 63);
+            _count++;
         }
-        _lookahead_buffer.push_back(n);
+    }
 
-        if (n > _highest) {
-            _highest = n;
+    void remove(long long n)
+    {
+        if (contains(n)) {
+            long long i = n & _mask;
+            _bits[i >> 6] &= ~(1ULL << (i & 63));
+            _count--;
         }
     }
+
+    bool empty() const { return _count == 0; }
 };
 
 
@@ -0,0 +1,134 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <iostream>
+#include "mapped_file.h"
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : _data(0), _len(0), _file(INVALID_HANDLE_VALUE), _mapping(0) {}
+
+bool MappedFile::open(const string &path)
+{
+    close();
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 
+                        FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (_file == INVALID_HANDLE_VALUE) {
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size)) {
+        cerr << "Could not get size of " << path << endl;
+        close();
+        return false;
+    }
+    _path = path;
+    _len = (size_t)size.QuadPart;
+    if (_len == 0) {
+        return true;
+    }
+    _mapping = CreateFileMapping(_file, 0, PAGE_READONLY, 0, 0, 0);
+    if (_mapping) {
+        _data = (const byte *)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!_data) {
+        cerr << "Could not map " << path << endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (_data) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping) {
+        CloseHandle(_mapping);
+    }
+    if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+    }
+    _data = 0;
+    _len = 0;
+    _mapping = 0;
+    _file = INVALID_HANDLE_VALUE;
+    _path.clear();
+}
+
+void MappedFile::release(size_t offset, size_t len)
+{
+    // Windows trims the pages of a mapped file from the working set under memory pressure and
+    //  has no cheap way to drop a range of them now
+}
+
+#else
+
+MappedFile::MappedFile() : _data(0), _len(0), _fd(-1) {}
+
+bool MappedFile::open(const string &path)
+{
+    close();
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(_fd, &st) < 0) {
+        cerr << "Could not stat " << path << endl;
+        close();
+        return false;
+    }
+    _path = path;
+    _len = (size_t)st.st_size;
+    if (_len == 0) {
+        return true;
+    }
+    void *p = mmap(0, _len, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (p == MAP_FAILED) {
+        cerr << "Could not map " << path << endl;
+        close();
+        return false;
+    }
+    madvise(p, _len, MADV_SEQUENTIAL);
+    _data = (const byte *)p;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (_data) {
+        munmap((void *)_data, _len);
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+    _data = 0;
+    _len = 0;
+    _fd = -1;
+    _path.clear();
+}
+
+void MappedFile::release(size_t offset, size_t len)
+{
+    if (!_data || offset >= _len) {
+        return;
+    }
+    // madvise() needs a page aligned start. The pages are clean so dropping them is cheap
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t end = offset + len < _len ? offset + len : _len;
+    size_t begin = offset / page_size * page_size;
+    madvise((void *)(_data + begin), end - begin, MADV_DONTNEED);
+}
+
+#endif
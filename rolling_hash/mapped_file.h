@@ -0,0 +1,56 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string>
+#include "byteview.h"
+
+/*
+ * A read-only memory mapped file.
+ *
+ * The file is mapped with a hint that it will be read sequentially, so the OS reads ahead 
+ *  and can drop pages that have been scanned. Scanning a mapped file therefore costs no 
+ *  copies and no resident duplicate of the file.
+ */
+class MappedFile
+{
+    std::string _path;
+    const byte *_data;
+    size_t _len;
+#ifdef _WIN32
+    void *_file;
+    void *_mapping;
+#else
+    int _fd;
+#endif
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+public:
+    MappedFile();
+    ~MappedFile() { close(); }
+
+    /*
+     * Map the file at path. Any previously mapped file is closed.
+     * Returns: true on success
+     */
+    bool open(const std::string &path);
+
+    /*
+     * Unmap the file
+     */
+    void close();
+
+    /*
+     * Tell the OS that the len bytes at offset won't be read again so their pages can be 
+     *  dropped. Bounds the resident memory of a large file that is scanned a chunk at a time.
+     *  The pages are read back in if they are read after all
+     */
+    void release(size_t offset, size_t len);
+
+    bool is_open() const { return !_path.empty(); }
+    const std::string &get_path() const { return _path; }
+    ByteView get_view() const { return ByteView(_data, _len); }
+};
+
+#endif // _MAPPED_FILE_H_
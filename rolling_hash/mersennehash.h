@@ -0,0 +1,152 @@
+#ifndef MERSENNEHASH
+#define MERSENNEHASH
+
+#include "characterhash.h"
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+/*
+ * Karp-Rabin rolling hash modulo the Mersenne prime 2^61 - 1.
+ *
+ * KarpRabinHash works modulo 2^wordsize so the low bits of its hash only depend on the low
+ *  bits of the character hashes and B=37 is a weak multiplier. Working modulo a prime with a
+ *  large random multiplier makes collisions between different strings close to 1 in 2^61.
+ *  get_folded() folds the 61 bit hash down to any table width.
+ *
+ * Same eat()/update()/hash() interface as KarpRabinHash.
+ */
+class MersenneKarpRabinHash
+{
+public:
+    static const uint64 P = (1ULL << 61) - 1;
+
+private:
+    // Character hashes in [0, P)
+    uint64 _char_hashes[256];
+    // Multiplier. Random in [2^32, P)
+    uint64 _B;
+    // _B^_n mod P
+    uint64 _BtoN;
+
+    static uint64 add_mod(uint64 a, uint64 b)
+    {
+        uint64 r = a + b;
+        return r >= P ? r - P : r;
+    }
+
+public:
+    const int _n, _wordsize;
+    uint64 _hashvalue;
+
+    /*
+     * a * b mod P for a, b < P
+     */
+    static uint64 mul_mod(uint64 a, uint64 b)
+    {
+        uint64 lo, hi;
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 p = (unsigned __int128)a * b;
+        lo = (uint64)p;
+        hi = (uint64)(p >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        lo = _umul128(a, b, &hi);
+#else
+        lo = mul_wide(a, b, &hi);
+#endif
+        // a*b = hi*2^64 + lo = (hi*8 + lo>>61)*2^61 + (lo & P) and 2^61 = 1 mod P
+        uint64 r = (lo & P) + ((lo >> 61) | (hi << 3));
+        r = (r & P) + (r >> 61);
+        return r >= P ? r - P : r;
+    }
+
+    /*
+     * 128 bit product of a and b from 32 x 32 bit partial products, for compilers without a
+     *  64 x 64 bit multiply. Returns the low 64 bits and sets *hi to the high 64 bits
+     */
+    static uint64 mul_wide(uint64 a, uint64 b, uint64 *hi)
+    {
+        uint64 a0 = a & 0xffffffff, a1 = a >> 32, b0 = b & 0xffffffff, b1 = b >> 32;
+        uint64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+        uint64 mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+        *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+        return (mid << 32) | (p00 & 0xffffffff);
+    }
+
+    /*
+     * Params:
+     *  n: length of the strings hashed
+     *  wordsize: number of bits returned by get_folded()
+     *  seed: seed for the random character hashes and multiplier
+     */
+    MersenneKarpRabinHash(int n, int wordsize = 19, uint32 seed = 25) :
+        _n(n),
+        _wordsize(wordsize),
+        _hashvalue(0)
+    {
+        MTRand rand(seed);
+        for (int k = 0; k < 256; k++) {
+            _char_hashes[k] = random61(rand);
+        }
+        do {
+            _B = random61(rand);
+        } while (_B < (1ULL << 32));
+        _BtoN = 1;
+        for (int i = 0; i < _n; i++) {
+            _BtoN = mul_mod(_BtoN, _B);
+        }
+    }
+
+    template<class container> uint64 hash(container &c) const
+    {
+        assert(c.size() == static_cast<uint>(_n));
+        uint64 answer = 0;
+        for (int k = 0; k < _n; k++) {
+            answer = add_mod(mul_mod(answer, _B), _char_hashes[c[k]]);
+        }
+        return answer;
+    }
+
+    uint64 get_hash(const chartype *data) const
+    {
+        uint64 answer = 0;
+        for (int k = 0; k < _n; k++) {
+            answer = add_mod(mul_mod(answer, _B), _char_hashes[data[k]]);
+        }
+        return answer;
+    }
+
+    void eat(chartype inchar)
+    {
+        _hashvalue = add_mod(mul_mod(_hashvalue, _B), _char_hashes[inchar]);
+    }
+
+    inline void update(chartype outchar, chartype inchar)
+    {
+        uint64 out = mul_mod(_BtoN, _char_hashes[outchar]);
+        _hashvalue = add_mod(add_mod(mul_mod(_hashvalue, _B), _char_hashes[inchar]), P - out);
+    }
+
+    /*
+     * Fold a 61 bit hash down to wordsize bits. A multiplicative hash so all of the bits of
+     *  h contribute to the result
+     */
+    static hashvaluetype fold(uint64 h, int wordsize)
+    {
+        return (hashvaluetype)((h * 0x9e3779b97f4a7c15ULL) >> (64 - wordsize));
+    }
+
+    hashvaluetype get_folded() const { return fold(_hashvalue, _wordsize); }
+
+private:
+    static uint64 random61(MTRand &rand)
+    {
+        uint64 x;
+        do {
+            x = (((uint64)rand.randInt() << 32) | rand.randInt()) & P;
+        } while (x >= P);
+        return x;
+    }
+};
+
+#endif
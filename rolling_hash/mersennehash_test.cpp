@@ -0,0 +1,111 @@
+/*
+ * Tests of MersenneKarpRabinHash: the modular multiply is checked against a reference and
+ *  rolling the hash over random data against hashing each window from scratch.
+ */
+#include <random>
+#include <string>
+#include <vector>
+#include "mersennehash.h"
+#include "unit_test.h"
+
+using namespace std;
+
+static const uint64 P = MersenneKarpRabinHash::P;
+
+// Bytes of random data that the hash is rolled over
+static const size_t NUM_TEST_CHARS = 20000;
+
+// Random products that are checked
+static const int NUM_PRODUCTS = 100000;
+
+/*
+ * a * b mod P by doubling and adding, which never needs more than 63 bits
+ */
+static uint64 reference_mul_mod(uint64 a, uint64 b)
+{
+    uint64 r = 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) % P;
+        if ((b >> i) & 1) {
+            r = (r + a) % P;
+        }
+    }
+    return r;
+}
+
+static void check_product(uint64 a, uint64 b, bool &same_mod, bool &same_wide)
+{
+    same_mod = same_mod && MersenneKarpRabinHash::mul_mod(a, b) == reference_mul_mod(a, b);
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128)a * b;
+    uint64 hi, lo = MersenneKarpRabinHash::mul_wide(a, b, &hi);
+    same_wide = same_wide && lo == (uint64)p && hi == (uint64)(p >> 64);
+    same_mod = same_mod && MersenneKarpRabinHash::mul_mod(a, b) == (uint64)(p % P);
+#else
+    (void)same_wide;
+#endif
+}
+
+static void test_mul_mod()
+{
+    unit_note("MersenneKarpRabinHash::mul_mod");
+    static const uint64 edges[] = {
+        0, 1, 2, 3, 0xffffffffULL, 0x100000000ULL, 0x100000001ULL, 1ULL << 60, P / 2, P - 2, P - 1,
+    };
+    static const int num_edges = (int)(sizeof(edges) / sizeof(edges[0]));
+    bool same_mod = true, same_wide = true;
+    for (int i = 0; i < num_edges; i++) {
+        for (int j = 0; j < num_edges; j++) {
+            check_product(edges[i], edges[j], same_mod, same_wide);
+        }
+    }
+    mt19937_64 rng(12);
+    for (int i = 0; i < NUM_PRODUCTS; i++) {
+        check_product(rng() % P, rng() % P, same_mod, same_wide);
+    }
+    CHECK(same_mod);
+    CHECK(same_wide);
+    // (P - 1)^2 = (-1)^2 = 1
+    CHECK(MersenneKarpRabinHash::mul_mod(P - 1, P - 1) == 1);
+}
+
+/*
+ * Rolling the hash over the data gives the hash of each window
+ */
+static void test_rolling()
+{
+    mt19937 rng(12);
+    vector<chartype> data(NUM_TEST_CHARS);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (chartype)rng();
+    }
+    static const int lens[] = { 1, 5, 32, 1000 };
+    static const int wordsizes[] = { 8, 19, 32 };
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        for (size_t w = 0; w < sizeof(wordsizes) / sizeof(wordsizes[0]); w++) {
+            int n = lens[l];
+            unit_note("MersenneKarpRabinHash n=" + to_string(n) + " wordsize=" + to_string(wordsizes[w]));
+            MersenneKarpRabinHash hash(n, wordsizes[w]);
+            for (int i = 0; i < n; i++) {
+                hash.eat(data[i]);
+            }
+            bool same = hash._hashvalue == hash.get_hash(&data[0]);
+            bool in_range = true;
+            for (size_t i = n; i < data.size(); i++) {
+                hash.update(data[i - n], data[i]);
+                same = same && hash._hashvalue == hash.get_hash(&data[i - n + 1]);
+                in_range = in_range && hash._hashvalue < P && (uint64)hash.get_folded() >> wordsizes[w] == 0;
+            }
+            CHECK(same);
+            CHECK(in_range);
+            vector<chartype> window(data.end() - n, data.end());
+            CHECK(hash.hash(window) == hash._hashvalue);
+        }
+    }
+}
+
+void test_mersennehash()
+{
+    test_mul_mod();
+    test_rolling();
+}
@@ -0,0 +1,203 @@
+#include <cassert>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "multilane_scanner.h"
+
+using namespace std;
+
+// Don't bother with the SIMD scanner for stripes shorter than this
+static const size_t MIN_STRIPE_LEN = 64;
+
+void MultiLaneScanner::add_window(const KarpRabinHash &hash, const BitFilter &filter)
+{
+    assert((int)_windows.size() < MAX_WINDOWS);
+    assert(hash._n >= _max_n);
+    Window window;
+    window._n = hash._n;
+    window._BtoN = hash.get_BtoN();
+    window._mask = hash.get_mask();
+    window._char_hashes = hash.get_char_hashes();
+    window._filter = &filter;
+    _windows.push_back(window);
+    _max_n = hash._n;
+}
+
+bool MultiLaneScanner::has_simd()
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Karp-Rabin hash of data[0..window._n)
+ */
+hashvaluetype MultiLaneScanner::get_hash(const Window &window, const byte *data) const
+{
+    const hashvaluetype B = KarpRabinHash::get_B();
+    hashvaluetype h = 0;
+    for (int k = 0; k < window._n; k++) {
+        h = (B*h + window._char_hashes[data[k]]) & window._mask;
+    }
+    return h;
+}
+
+/*
+ * Scan one window over [begin, end) starting from hash h. The window must fit in the data at
+ *  every offset scanned plus 1, so there are no bounds checks and everything the loop needs
+ *  is in locals that the compiler can keep in registers across the push_back().
+ * Returns: the hash at end
+ */
+static hashvaluetype scan_one_window(const byte *data, int n, hashvaluetype BtoN, hashvaluetype mask,
+                                     const hashvaluetype *char_hashes, const uint64 *words, hashvaluetype h,
+                                     size_t begin, size_t end, vector<ScanCandidate> &candidates)
+{
+    const hashvaluetype B = KarpRabinHash::get_B();
+    const byte *in = data + n;
+    for (size_t offset = begin; offset < end; offset++) {
+        if ((words[h >> 6] >> (h & 63)) & 1) {
+            candidates.push_back(ScanCandidate(offset, 0, h));
+        }
+        h = (B*h + char_hashes[in[offset]] - BtoN * char_hashes[data[offset]]) & mask;
+    }
+    return h;
+}
+
+void MultiLaneScanner::scan_scalar(const byte *data, size_t numchars, size_t begin, size_t end, vector<ScanCandidate> &candidates) const
+{
+    const hashvaluetype B = KarpRabinHash::get_B();
+    int num_windows = (int)_windows.size();
+    hashvaluetype h[MAX_WINDOWS];
+    for (int w = 0; w < num_windows && begin + _windows[w]._n <= numchars; w++) {
+        h[w] = get_hash(_windows[w], data + begin);
+    }
+
+    // Before fast_end every window fits and has a byte to roll into
+    size_t offset = begin;
+    size_t fast_end = numchars > (size_t)_max_n ? numchars - _max_n : 0;
+    fast_end = fast_end < end ? fast_end : end;
+    if (num_windows == 1 && fast_end > begin) {
+        const Window &window = _windows[0];
+        h[0] = scan_one_window(data, window._n, window._BtoN, window._mask, window._char_hashes,
+                               window._filter->get_words(), h[0], begin, fast_end, candidates);
+        offset = fast_end;
+    }
+
+    for (; offset < end; offset++) {
+        for (int w = 0; w < num_windows; w++) {
+            const Window &window = _windows[w];
+            if (offset + window._n > numchars) {
+                break;
+            }
+            if (window._filter->test(h[w])) {
+                candidates.push_back(ScanCandidate(offset, w, h[w]));
+            }
+            if (offset + window._n < numchars) {
+                h[w] = (B*h[w] + window._char_hashes[data[offset + window._n]]
+                       - window._BtoN * window._char_hashes[data[offset]]) & window._mask;
+            }
+        }
+    }
+}
+
+#if defined(__AVX2__)
+
+/*
+ * Scan NUM_LANES stripes of stripe_len offsets starting at begin. All windows must fit in
+ *  the data at every offset scanned plus 1.
+ */
+void MultiLaneScanner::scan_lanes(const byte *data, size_t begin, size_t stripe_len, vector<ScanCandidate> &candidates) const
+{
+    int num_windows = (int)_windows.size();
+    size_t lane_start[NUM_LANES];
+    for (int j = 0; j < NUM_LANES; j++) {
+        lane_start[j] = begin + j * stripe_len;
+    }
+
+    __m256i h[MAX_WINDOWS], BtoN[MAX_WINDOWS], mask[MAX_WINDOWS];
+    const __m256i B = _mm256_set1_epi32((int)KarpRabinHash::get_B());
+    const __m256i low5 = _mm256_set1_epi32(31);
+
+    // Prime the hashes for the start of each lane
+    for (int w = 0; w < num_windows; w++) {
+        hashvaluetype lane_hash[NUM_LANES];
+        for (int j = 0; j < NUM_LANES; j++) {
+            lane_hash[j] = get_hash(_windows[w], data + lane_start[j]);
+        }
+        h[w] = _mm256_loadu_si256((const __m256i *)lane_hash);
+        BtoN[w] = _mm256_set1_epi32((int)_windows[w]._BtoN);
+        mask[w] = _mm256_set1_epi32((int)_windows[w]._mask);
+    }
+
+    // Hits for each lane. They are concatenated at the end so that they are in offset order
+    vector<ScanCandidate> lane_candidates[NUM_LANES];
+
+    for (size_t t = 0; t < stripe_len; t++) {
+        // Check the filter for all the lanes of all the windows
+        for (int w = 0; w < num_windows; w++) {
+            const int *words = (const int *)_windows[w]._filter->get_words();
+            __m256i word = _mm256_i32gather_epi32(words, _mm256_srli_epi32(h[w], 5), 4);
+            __m256i bit = _mm256_srlv_epi32(word, _mm256_and_si256(h[w], low5));
+            int hits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(bit, 31)));
+            if (hits) {
+                hashvaluetype lane_hash[NUM_LANES];
+                _mm256_storeu_si256((__m256i *)lane_hash, h[w]);
+                for (int j = 0; j < NUM_LANES; j++) {
+                    if (hits & (1 << j)) {
+                        lane_candidates[j].push_back(ScanCandidate(lane_start[j] + t, w, lane_hash[j]));
+                    }
+                }
+            }
+        }
+        if (t + 1 == stripe_len) {
+            break;
+        }
+
+        // Roll the hashes forward one byte. Building the vectors from scalar loads is faster 
+        //  than gathering on the CPUs we have measured
+        const byte *p = data + t;
+        for (int w = 0; w < num_windows; w++) {
+            const Window &window = _windows[w];
+            const byte *q = p + window._n;
+            const hashvaluetype *T = window._char_hashes;
+            __m256i in = _mm256_setr_epi32(T[q[lane_start[0]]], T[q[lane_start[1]]], T[q[lane_start[2]]], T[q[lane_start[3]]],
+                                           T[q[lane_start[4]]], T[q[lane_start[5]]], T[q[lane_start[6]]], T[q[lane_start[7]]]);
+            __m256i out = _mm256_setr_epi32(T[p[lane_start[0]]], T[p[lane_start[1]]], T[p[lane_start[2]]], T[p[lane_start[3]]],
+                                            T[p[lane_start[4]]], T[p[lane_start[5]]], T[p[lane_start[6]]], T[p[lane_start[7]]]);
+            __m256i x = _mm256_add_epi32(_mm256_mullo_epi32(B, h[w]), in);
+            x = _mm256_sub_epi32(x, _mm256_mullo_epi32(BtoN[w], out));
+            h[w] = _mm256_and_si256(x, mask[w]);
+        }
+    }
+
+    for (int j = 0; j < NUM_LANES; j++) {
+        candidates.insert(candidates.end(), lane_candidates[j].begin(), lane_candidates[j].end());
+    }
+}
+
+#else
+
+void MultiLaneScanner::scan_lanes(const byte *data, size_t begin, size_t stripe_len, vector<ScanCandidate> &candidates) const
+{
+    assert(false);
+}
+
+#endif
+
+void MultiLaneScanner::scan(const byte *data, size_t numchars, size_t begin, size_t end, vector<ScanCandidate> &candidates) const
+{
+    if (has_simd() && !_force_scalar && (int)_windows.size() >= _min_simd_windows && numchars > (size_t)_max_n) {
+        // The lanes need every window to fit, plus 1 byte to roll into
+        size_t simd_end = end < numchars - _max_n ? end : numchars - _max_n;
+        size_t stripe_len = simd_end > begin ? (simd_end - begin) / NUM_LANES : 0;
+        if (stripe_len >= MIN_STRIPE_LEN) {
+            scan_lanes(data, begin, stripe_len, candidates);
+            begin += stripe_len * NUM_LANES;
+        }
+    }
+    scan_scalar(data, numchars, begin, end, candidates);
+}
@@ -0,0 +1,101 @@
+#ifndef _MULTILANE_SCANNER_H_
+#define _MULTILANE_SCANNER_H_
+
+/*
+ * Rolling hash scanner that finds the offsets where a KarpRabinHash hits a BitFilter.
+ *
+ * The scalar rolling hash is one dependent multiply-add per byte plus one table probe, so
+ *  it is latency bound. This scanner splits the input into 8 stripes and rolls 8
+ *  independent hashes at once with AVX2, checking the filter with gathers.
+ *
+ * Several hash windows of different lengths may be scanned in the same pass. Candidates are
+ *  reported in increasing order of offset and, for each offset, increasing order of window.
+ *
+ * If the code is not compiled with AVX2 support (e.g. -mavx2 or /arch:AVX2) then a scalar
+ *  scanner that gives identical results is used. It is also used for a single window, which
+ *  it rolls faster than the lanes do (see hash_bench).
+ */
+#include <vector>
+#include "rabinkarphash.h"
+#include "bitfilter.h"
+#include "byteview.h"
+
+/*
+ * A filter hit
+ */
+struct ScanCandidate
+{
+    // Offset of start of static string in input
+    size_t _offset;
+    // Index of hash window that hit
+    int _window;
+    // Hash value of the static string
+    hashvaluetype _hash;
+
+    ScanCandidate() : _offset(0), _window(0), _hash(0) {}
+    ScanCandidate(size_t offset, int window, hashvaluetype hash) : _offset(offset), _window(window), _hash(hash) {}
+};
+
+class MultiLaneScanner
+{
+public:
+    // Maximum number of windows that can be scanned in one pass
+    enum { MAX_WINDOWS = 8 };
+    // Number of stripes the input is split into
+    enum { NUM_LANES = 8 };
+    // Fewer windows than this are scanned with the scalar scanner by default
+    enum { DEFAULT_MIN_SIMD_WINDOWS = 2 };
+
+private:
+    struct Window
+    {
+        int _n;
+        hashvaluetype _BtoN;
+        hashvaluetype _mask;
+        const hashvaluetype *_char_hashes;
+        const BitFilter *_filter;
+    };
+    std::vector<Window> _windows;
+    // Length of the longest window
+    int _max_n;
+    // Use the scalar scanner even if AVX2 is available
+    bool _force_scalar;
+    // Use the AVX2 scanner only for at least this many windows
+    int _min_simd_windows;
+
+    hashvaluetype get_hash(const Window &window, const byte *data) const;
+    void scan_lanes(const byte *data, size_t begin, size_t stripe_len, std::vector<ScanCandidate> &candidates) const;
+
+public:
+    MultiLaneScanner() : _max_n(0), _force_scalar(false), _min_simd_windows(DEFAULT_MIN_SIMD_WINDOWS) {}
+
+    /*
+     * Add a window to scan. Windows must be added in increasing order of length.
+     *  hash and filter must outlive the scanner.
+     */
+    void add_window(const KarpRabinHash &hash, const BitFilter &filter);
+
+    int get_num_windows() const { return (int)_windows.size(); }
+    int get_max_n() const { return _max_n; }
+
+    void set_force_scalar(bool force_scalar) { _force_scalar = force_scalar; }
+    void set_min_simd_windows(int min_simd_windows) { _min_simd_windows = min_simd_windows; }
+
+    /*
+     * Is the AVX2 scanner compiled in?
+     */
+    static bool has_simd();
+
+    /*
+     * Append all filter hits for static strings that start in [begin, end) of data[0..numchars)
+     *  to candidates. Windows that do not fit in data at an offset are not checked there.
+     */
+    void scan(const byte *data, size_t numchars, size_t begin, size_t end, std::vector<ScanCandidate> &candidates) const;
+
+    /*
+     * Same as scan() but always uses the scalar scanner
+     */
+    void scan_scalar(const byte *data, size_t numchars, size_t begin, size_t end, std::vector<ScanCandidate> &candidates) const;
+};
+
+#endif // _MULTILANE_SCANNER_H_
@@ -0,0 +1,555 @@
+/*
+ * Tests that every way of running a FastRegex engine finds the same matches.
+ *
+ * process() is checked against running each regex at every offset of the input, and then
+ *  process_in_order(), process_pipelined(), process_parallel(), process_range(), the file
+ *  functions and streams fed in pieces of several sizes are checked against process(), for
+ *  each backend, filter and delivery mode. fastregex_tune() is checked to keep the caller's
+ *  settings.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "anchored_regex.h"
+#include "byte_model.h"
+#include "rough_plan.h"
+#include "unit_test.h"
+
+using namespace std;
+
+// Bytes of generated input. Big enough for process_parallel() to split it into chunks
+static const size_t NUM_TEST_CHARS = 3 << 20;
+
+// Bytes of the input that the regexes are run over at every offset, and that streams are
+//  fed a byte at a time
+static const size_t NUM_EXHAUSTIVE_CHARS = 1 << 18;
+
+static const char *PATTERNS[] = {
+    "hello world",
+    "order #[0-9]+",
+    "abc.{2}defgh",
+    "ERROR: [a-z]+",
+    "aaaaa",
+    "x(yz|zy)wvuts",
+    "status=(ok|fail)ed",
+    "abcde(?:|)fgh",
+};
+static const int NUM_PATTERNS = (int)(sizeof(PATTERNS) / sizeof(PATTERNS[0]));
+
+// Used with fastregex_get_case_fold_map()
+static const char *CASE_FOLD_PATTERNS[] = {
+    "(?i)hello world",
+    "(?i)error: [a-z]+",
+    "ORDER #[0-9]+",
+};
+static const int NUM_CASE_FOLD_PATTERNS = (int)(sizeof(CASE_FOLD_PATTERNS) / sizeof(CASE_FOLD_PATTERNS[0]));
+
+// Matches, near misses and overlaps that are sprinkled through the input
+static const char *SNIPPETS[] = {
+    "hello world", "hello worle", "HeLLo WoRLD", "order #12345", "order #x", "ORDER #9",
+    "abcXYdefgh", "abcXYdefgX", "ERROR: disk full", "error: Paper", "aaaaaaaaa", "xzywvuts",
+    "xyzwvuts", "xyywvuts", "status=failed", "status=oked", "status=ok", "abcdefgh",
+};
+static const int NUM_SNIPPETS = (int)(sizeof(SNIPPETS) / sizeof(SNIPPETS[0]));
+
+/*
+ * Random letters, digits and punctuation with the snippets in them
+ */
+static vector<byte> make_input(size_t len)
+{
+    static const char alphabet[] = "abcdefghorstwxyz #=:0123456789\n";
+    mt19937 rng(1);
+    vector<byte> input;
+    input.reserve(len + 64);
+    while (input.size() < len) {
+        if (rng() % 40 == 0) {
+            const char *snippet = SNIPPETS[rng() % NUM_SNIPPETS];
+            input.insert(input.end(), snippet, snippet + strlen(snippet));
+        } else {
+            input.push_back((byte)alphabet[rng() % (sizeof(alphabet) - 1)]);
+        }
+    }
+    input.resize(len);
+    return input;
+}
+
+static bool compare_matches(const FastRegexMatch &a, const FastRegexMatch &b)
+{
+    if (a._offset != b._offset) {
+        return a._offset < b._offset;
+    }
+    if (a._pattern != b._pattern) {
+        return a._pattern < b._pattern;
+    }
+    return a._len < b._len;
+}
+
+static bool equal_matches(const FastRegexMatch &a, const FastRegexMatch &b)
+{
+    return a._offset == b._offset && a._pattern == b._pattern && a._len == b._len;
+}
+
+/*
+ * Are a and b the same matches in any order?
+ */
+static bool same_matches(vector<FastRegexMatch> a, vector<FastRegexMatch> b)
+{
+    sort(a.begin(), a.end(), compare_matches);
+    sort(b.begin(), b.end(), compare_matches);
+    return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(), equal_matches);
+}
+
+/*
+ * Are matches in the order process_in_order() delivers them: by offset, then pattern?
+ */
+static bool is_in_order(const vector<FastRegexMatch> &matches)
+{
+    for (size_t i = 1; i < matches.size(); i++) {
+        if (compare_matches(matches[i], matches[i - 1]) && !equal_matches(matches[i], matches[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The matches of each regex at every offset of input
+ */
+static vector<FastRegexMatch> find_all_matches(const char *const *patterns, int num_patterns, ByteView input)
+{
+    vector<FastRegexMatch> matches;
+    for (int i = 0; i < num_patterns; i++) {
+        Regex *regex = Regex::compile((int)strlen(patterns[i]), (const byte *)patterns[i]);
+        RegexResults results;
+        for (size_t offset = 0; regex && offset < input.get_len(); offset++) {
+            if (regex->match_at(input.get_len(), input.get_data(), offset, &results)) {
+                FastRegexMatch match;
+                match._offset = (long long)offset;
+                match._len = results._len;
+                match._pattern = i;
+                matches.push_back(match);
+            }
+        }
+        delete regex;
+    }
+    return matches;
+}
+
+static bool collect_batch(ByteView, const FastRegexMatch *matches, size_t num_matches, void *context)
+{
+    vector<FastRegexMatch> *collected = (vector<FastRegexMatch> *)context;
+    collected->insert(collected->end(), matches, matches + num_matches);
+    return true;
+}
+
+static bool stop_batch(ByteView, const FastRegexMatch *, size_t, void *)
+{
+    return false;
+}
+
+// Matches delivered to the action functions, and the input they should be in
+static vector<FastRegexMatch> _action_matches;
+static ByteView _action_input;
+static bool _action_input_ok = true;
+
+template<int PATTERN> static bool collect_action(ByteView input, const RegexResults *results, size_t offset)
+{
+    FastRegexMatch match;
+    match._offset = results->_stream_offset;
+    match._len = results->_len;
+    match._pattern = PATTERN;
+    _action_matches.push_back(match);
+    // input and offset are where the match is, which for streams is a window of the stream
+    if (offset != results->_offset || offset + results->_len > input.get_len() ||
+        (size_t)results->_stream_offset + results->_len > _action_input.get_len() ||
+        memcmp(input.get_data() + offset, _action_input.get_data() + results->_stream_offset, results->_len)) {
+        _action_input_ok = false;
+    }
+    return true;
+}
+
+typedef bool (*ActionFn)(ByteView input, const RegexResults *results, size_t offset);
+static const ActionFn ACTION_FNS[] = {
+    collect_action<0>, collect_action<1>, collect_action<2>, collect_action<3>, collect_action<4>,
+    collect_action<5>, collect_action<6>, collect_action<7>,
+};
+
+/*
+ * Feed input to a stream in pieces of chunk_size bytes, or random sizes if it is 0
+ */
+static bool process_stream(const FastRegex &engine, ByteView input, size_t chunk_size)
+{
+    mt19937 rng(2);
+    FastRegexStream *stream = engine.begin_stream();
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < input.get_len(); ) {
+        size_t len = chunk_size ? chunk_size : 1 + rng() % 10000;
+        len = len < input.get_len() - pos ? len : input.get_len() - pos;
+        ok = fastregex_feed(stream, input.sub(pos, len));
+        pos += len;
+    }
+    return fastregex_finish(stream) && ok;
+}
+
+/*
+ * Run input through every mode of engine and check they find the same matches as process()
+ * Params:
+ *  matches: where engine's matches are collected
+ */
+static void check_modes(const FastRegex &engine, vector<FastRegexMatch> &matches, ByteView input, const string &name)
+{
+    matches.clear();
+    unit_note(name + ": process");
+    CHECK(engine.process(input));
+    vector<FastRegexMatch> expected = matches;
+    CHECK(!expected.empty());
+
+    matches.clear();
+    unit_note(name + ": process_in_order");
+    CHECK(engine.process_in_order(input));
+    CHECK(is_in_order(matches));
+    CHECK(same_matches(matches, expected));
+
+    matches.clear();
+    unit_note(name + ": process_pipelined");
+    CHECK(engine.process_pipelined(input));
+    CHECK(same_matches(matches, expected));
+
+    for (int num_threads = 1; num_threads <= 4; num_threads++) {
+        matches.clear();
+        unit_note(name + ": process_parallel with " + to_string(num_threads) + " threads");
+        CHECK(engine.process_parallel(input, num_threads));
+        CHECK(is_in_order(matches));
+        CHECK(same_matches(matches, expected));
+    }
+
+    // Uneven ranges whose ends fall inside matches
+    matches.clear();
+    unit_note(name + ": process_range");
+    mt19937 rng(3);
+    long long total = 0;
+    for (size_t begin = 0; begin < input.get_len(); ) {
+        size_t end = begin + 1 + rng() % (input.get_len() / 3);
+        end = end < input.get_len() ? end : input.get_len();
+        long long num_matches = -1;
+        size_t first = matches.size();
+        CHECK(engine.process_range(input, begin, end, &num_matches));
+        CHECK(num_matches == (long long)(matches.size() - first));
+        bool in_range = true;
+        for (size_t i = first; i < matches.size(); i++) {
+            in_range = in_range && matches[i]._offset >= (long long)begin && matches[i]._offset < (long long)end;
+        }
+        CHECK(in_range);
+        total += num_matches;
+        begin = end;
+    }
+    CHECK(total == (long long)expected.size());
+    CHECK(same_matches(matches, expected));
+
+    string path = unit_temp_path("process_modes");
+    CHECK(unit_write_file(path, input));
+    matches.clear();
+    unit_note(name + ": process_file");
+    CHECK(engine.process_file(path.c_str()));
+    CHECK(same_matches(matches, expected));
+    matches.clear();
+    unit_note(name + ": process_file_async");
+    CHECK(engine.process_file_async(path.c_str()));
+    CHECK(same_matches(matches, expected));
+    remove(path.c_str());
+
+    static const size_t chunk_sizes[] = { 4093, 65536, 0 };
+    for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+        matches.clear();
+        unit_note(name + ": stream in pieces of " + (chunk_sizes[i] ? to_string(chunk_sizes[i]) : string("random")) + " bytes");
+        CHECK(process_stream(engine, input, chunk_sizes[i]));
+        CHECK(same_matches(matches, expected));
+    }
+
+    // Tiny pieces on a prefix, as each feed() costs as much as a few KB of input
+    ByteView prefix = input.sub(0, NUM_EXHAUSTIVE_CHARS);
+    matches.clear();
+    CHECK(engine.process(prefix));
+    expected = matches;
+    static const size_t small_sizes[] = { 1, 2, 7 };
+    for (size_t i = 0; i < sizeof(small_sizes) / sizeof(small_sizes[0]); i++) {
+        matches.clear();
+        unit_note(name + ": stream in pieces of " + to_string(small_sizes[i]) + " bytes");
+        CHECK(process_stream(engine, prefix, small_sizes[i]));
+        CHECK(same_matches(matches, expected));
+    }
+}
+
+/*
+ * Make the params for patterns with action functions, or none for batch mode
+ */
+static vector<RegexActionParams> make_params(const char *const *patterns, int num_patterns, bool use_actions)
+{
+    vector<RegexActionParams> params;
+    for (int i = 0; i < num_patterns; i++) {
+        RegexActionParams p = { BinString((int)strlen(patterns[i]), (const byte *)patterns[i]), use_actions ? ACTION_FNS[i] : 0 };
+        params.push_back(p);
+    }
+    return params;
+}
+
+static vector<RegexActionParams *> get_pointers(vector<RegexActionParams> &params)
+{
+    vector<RegexActionParams *> params_list;
+    for (vector<RegexActionParams>::iterator it = params.begin(); it != params.end(); it++) {
+        params_list.push_back(&*it);
+    }
+    return params_list;
+}
+
+struct BatchConfig
+{
+    const char *_name;
+    FastRegexOptions::Backend _backend;
+    FastRegexOptions::FilterType _filter_type;
+    int _wordsize;
+    int _max_hash_windows;
+    int _batch_size;
+};
+
+static void test_batch_modes(ByteView input)
+{
+    static const BatchConfig configs[] = {
+        { "rolling hash", FastRegexOptions::BACKEND_ROLLING_HASH, FastRegexOptions::FILTER_AUTO,
+          FastRegexOptions::DEFAULT_WORDSIZE, FastRegexOptions::DEFAULT_MAX_HASH_WINDOWS, FastRegexOptions::DEFAULT_BATCH_SIZE },
+        // A small filter gives many false hits, one window hashes every static string on
+        //  the same length and tiny batches are flushed all the time
+        { "rolling hash, Bloom filter", FastRegexOptions::BACKEND_ROLLING_HASH, FastRegexOptions::FILTER_BLOOM, 12, 1, 3 },
+        { "aho-corasick", FastRegexOptions::BACKEND_AHO_CORASICK, FastRegexOptions::FILTER_AUTO,
+          FastRegexOptions::DEFAULT_WORDSIZE, FastRegexOptions::DEFAULT_MAX_HASH_WINDOWS, FastRegexOptions::DEFAULT_BATCH_SIZE },
+        { "teddy", FastRegexOptions::BACKEND_TEDDY, FastRegexOptions::FILTER_AUTO,
+          FastRegexOptions::DEFAULT_WORDSIZE, FastRegexOptions::DEFAULT_MAX_HASH_WINDOWS, FastRegexOptions::DEFAULT_BATCH_SIZE },
+    };
+    vector<RegexActionParams> params = make_params(PATTERNS, NUM_PATTERNS, false);
+    vector<FastRegexMatch> exhaustive = find_all_matches(PATTERNS, NUM_PATTERNS, input.sub(0, NUM_EXHAUSTIVE_CHARS));
+
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        const BatchConfig &config = configs[i];
+        vector<FastRegexMatch> matches;
+        FastRegexOptions options;
+        options._backend = config._backend;
+        options._filter_type = config._filter_type;
+        options._wordsize = config._wordsize;
+        options._max_hash_windows = config._max_hash_windows;
+        options._batch_size = config._batch_size;
+        options._batch_fn = collect_batch;
+        options._batch_context = &matches;
+        FastRegex engine;
+        unit_note(string(config._name) + ": init");
+        if (!CHECK(engine.init(get_pointers(params), options))) {
+            continue;
+        }
+
+        unit_note(string(config._name) + ": process against every offset");
+        CHECK(engine.process(input.sub(0, NUM_EXHAUSTIVE_CHARS)));
+        CHECK(same_matches(matches, exhaustive));
+
+        check_modes(engine, matches, input, config._name);
+    }
+}
+
+static void test_action_modes(ByteView input)
+{
+    vector<RegexActionParams> params = make_params(PATTERNS, NUM_PATTERNS, true);
+    FastRegexOptions options;
+    options._collect_stats = true;
+    FastRegex engine;
+    unit_note("action functions: init");
+    if (!CHECK(engine.init(get_pointers(params), options))) {
+        return;
+    }
+    _action_input = input;
+    _action_input_ok = true;
+    check_modes(engine, _action_matches, input, "action functions");
+    unit_note("action functions: input and offset");
+    CHECK(_action_input_ok);
+    CHECK(engine.get_stats()._num_matched > 0);
+}
+
+static void test_case_fold(ByteView input)
+{
+    vector<RegexActionParams> params = make_params(CASE_FOLD_PATTERNS, NUM_CASE_FOLD_PATTERNS, false);
+    vector<FastRegexMatch> matches;
+    FastRegexOptions options;
+    options._byte_map = fastregex_get_case_fold_map();
+    options._batch_fn = collect_batch;
+    options._batch_context = &matches;
+    FastRegex engine;
+    unit_note("case fold: init");
+    if (!CHECK(engine.init(get_pointers(params), options))) {
+        return;
+    }
+    unit_note("case fold: process against every offset");
+    CHECK(engine.process(input.sub(0, NUM_EXHAUSTIVE_CHARS)));
+    CHECK(same_matches(matches, find_all_matches(CASE_FOLD_PATTERNS, NUM_CASE_FOLD_PATTERNS, input.sub(0, NUM_EXHAUSTIVE_CHARS))));
+    check_modes(engine, matches, input, "case fold");
+}
+
+static void test_stop(ByteView input)
+{
+    vector<RegexActionParams> params = make_params(PATTERNS, NUM_PATTERNS, false);
+    FastRegexOptions options;
+    options._batch_fn = stop_batch;
+    FastRegex engine;
+    unit_note("stop: a batch function that returns false stops processing");
+    CHECK(engine.init(get_pointers(params), options));
+    CHECK(!engine.process(input));
+    CHECK(!engine.process_in_order(input));
+    CHECK(!engine.process_parallel(input, 2));
+    CHECK(!process_stream(engine, input, 4093));
+}
+
+/*
+ * A small filter over the whole input hits many offsets where the static string is not, and
+ *  those are rejected without running the regexes
+ */
+static void test_static_string_rejects(ByteView input)
+{
+    vector<RegexActionParams> params = make_params(PATTERNS, NUM_PATTERNS, false);
+    vector<FastRegexMatch> matches;
+    FastRegexOptions options;
+    options._filter_type = FastRegexOptions::FILTER_DIRECT;
+    options._wordsize = 12;
+    options._max_hash_windows = 1;
+    options._collect_stats = true;
+    options._batch_fn = collect_batch;
+    options._batch_context = &matches;
+    FastRegex engine;
+    unit_note("static string rejects");
+    if (!CHECK(engine.init(get_pointers(params), options))) {
+        return;
+    }
+    ByteView sample = input.sub(0, NUM_EXHAUSTIVE_CHARS);
+    CHECK(engine.process(sample));
+    CHECK(same_matches(matches, find_all_matches(PATTERNS, NUM_PATTERNS, sample)));
+    FastRegexStats stats = engine.get_stats();
+    CHECK(stats._static_string_rejects > 0);
+    CHECK(stats._num_matched == (long long)matches.size() && stats._num_verified >= stats._num_matched);
+}
+
+/*
+ * fastregex_tune() keeps the caller's settings, does not deliver matches and reports failure
+ */
+static void test_tune(ByteView input)
+{
+    ByteView sample = input.sub(0, NUM_EXHAUSTIVE_CHARS);
+    vector<RegexActionParams> params = make_params(CASE_FOLD_PATTERNS, NUM_CASE_FOLD_PATTERNS, false);
+    vector<FastRegexMatch> matches;
+    FastRegexOptions options;
+    options._byte_map = fastregex_get_case_fold_map();
+    options._filter_type = FastRegexOptions::FILTER_BLOOM;
+    options._batch_fn = collect_batch;
+    options._batch_context = &matches;
+    unit_note("tune: (?i) patterns with a byte map");
+    CHECK(fastregex_tune(get_pointers(params), sample, options));
+    CHECK(matches.empty());
+    CHECK(options._byte_map == fastregex_get_case_fold_map());
+    CHECK(options._filter_type == FastRegexOptions::FILTER_BLOOM);
+    CHECK(options._batch_fn == collect_batch && options._batch_context == &matches && !options._collect_stats);
+    CHECK(options._wordsize >= 14 && options._wordsize <= 24);
+    CHECK(options._max_hash_windows >= 1 && options._max_hash_windows <= FastRegexOptions::DEFAULT_MAX_HASH_WINDOWS);
+    FastRegex engine;
+    CHECK(engine.init(get_pointers(params), options));
+    CHECK(engine.process(sample));
+    CHECK(same_matches(matches, find_all_matches(CASE_FOLD_PATTERNS, NUM_CASE_FOLD_PATTERNS, sample)));
+
+    unit_note("tune: a literal backend");
+    params = make_params(PATTERNS, 2, false);
+    options = FastRegexOptions();
+    options._backend = FastRegexOptions::BACKEND_AHO_CORASICK;
+    CHECK(fastregex_tune(get_pointers(params), sample, options));
+    CHECK(options._backend == FastRegexOptions::BACKEND_AHO_CORASICK);
+
+    unit_note("tune: patterns that cannot be set up");
+    static const char *bad_pattern = "(";
+    params = make_params(&bad_pattern, 1, false);
+    options = FastRegexOptions();
+    options._wordsize = 17;
+    CHECK(!fastregex_tune(get_pointers(params), sample, options));
+    CHECK(options._wordsize == 17);
+}
+
+/*
+ * A zero width alternation between the bytes of a static string
+ */
+static void test_zero_width_alternation()
+{
+    static const char *pattern = "abcde(?:|)fgh";
+    vector<RegexActionParams> params = make_params(&pattern, 1, false);
+    vector<FastRegexMatch> matches;
+    FastRegexOptions options;
+    options._batch_fn = collect_batch;
+    options._batch_context = &matches;
+    FastRegex engine;
+    unit_note("zero width alternation");
+    CHECK(engine.init(get_pointers(params), options));
+    const char input[] = "xxabcdefghyyabcdefgh";
+    CHECK(engine.process(ByteView((const byte *)input, sizeof(input) - 1)));
+    CHECK(matches.size() == 2);
+    CHECK(matches.size() == 2 && matches[0]._offset == 2 && matches[1]._offset == 12 && matches[1]._len == 8);
+}
+
+/*
+ * Printer spool like records whose longest literal is in every record. A byte model of the
+ *  input moves the hash onto the rare bytes, which finds the same matches with fewer regex
+ *  runs
+ */
+static void test_byte_model_choice()
+{
+    static const char *pattern = "\x1b&l0Ohdr=[0-9]{3};id=qz";
+    static const char ids[] = "abqz";
+    mt19937 rng(4);
+    string records;
+    for (int i = 0; i < 20000; i++) {
+        records += "\x1b&l0Ohdr=" + to_string(100 + rng() % 900) + ";id=" + ids[rng() % 4] + ids[rng() % 4] + "\n";
+    }
+    ByteView input((const byte *)records.data(), records.size());
+    vector<RegexActionParams> params = make_params(&pattern, 1, false);
+    vector<FastRegexMatch> expected = find_all_matches(&pattern, 1, input);
+    ByteModel model;
+    model.add(input);
+
+    long long num_verified[2];
+    for (int use_model = 0; use_model < 2; use_model++) {
+        vector<FastRegexMatch> matches;
+        FastRegexOptions options;
+        options._byte_model = use_model ? &model : 0;
+        options._collect_stats = true;
+        options._batch_fn = collect_batch;
+        options._batch_context = &matches;
+        FastRegex engine;
+        unit_note(string("byte model: ") + (use_model ? "with" : "without") + " a model");
+        CHECK(engine.init(get_pointers(params), options));
+        CHECK(engine.process(input));
+        CHECK(!expected.empty() && same_matches(matches, expected));
+        matches.clear();
+        CHECK(engine.process_parallel(input, 2));
+        CHECK(same_matches(matches, expected));
+        num_verified[use_model] = engine.get_stats()._num_verified;
+    }
+    unit_note("byte model: regex runs");
+    CHECK(num_verified[1] * 4 < num_verified[0]);
+}
+
+void test_process_modes()
+{
+    test_zero_width_alternation();
+    test_byte_model_choice();
+
+    vector<byte> data = make_input(NUM_TEST_CHARS);
+    ByteView input(&data[0], data.size());
+    test_batch_modes(input);
+    test_action_modes(input);
+    test_case_fold(input);
+    test_stop(input);
+    test_static_string_rejects(input);
+    test_tune(input);
+}
@@ -0,0 +1,96 @@
+#ifndef RABINFINGERPRINT
+#define RABINFINGERPRINT
+
+#include "gf2poly.h"
+
+/*
+ * Rabin fingerprint rolling hash for word sizes from 8 to 64 bits.
+ *
+ * The hash of a window of n bytes is the window, read as a polynomial over GF(2) with 8n
+ *  coefficients, modulo a random irreducible polynomial P of degree wordsize. Two different
+ *  windows collide with probability about 8n / 2^wordsize over the choice of P, so long
+ *  windows with 32 to 64 bit words are very selective.
+ *
+ * Rolling a byte is O(1) for any window length
+ *      h = (h * x^8 mod P) ^ in ^ (out * x^(8n) mod P)
+ *  where h * x^8 mod P is a shift plus a lookup of its top byte in a 256 entry table and
+ *  out * x^(8n) mod P is a lookup in a 256 entry outgoing byte table. The tables are computed
+ *  with GF2Poly, which uses carry-less multiply when it is available.
+ *
+ * Same eat()/update()/hash() interface as KarpRabinHash.
+ */
+class RabinFingerprint
+{
+    // P without its x^wordsize term
+    uint64 _poly;
+    uint64 _mask;
+    // _shift_table[t] = t * x^wordsize mod P: the reduction of the byte shifted out of the top
+    uint64 _shift_table[256];
+    // _out_table[c] = c * x^(8n) mod P: the contribution of a byte leaving the window
+    uint64 _out_table[256];
+
+    uint64 shift_in(uint64 h, chartype c) const
+    {
+        uint64 top = h >> (_wordsize - 8);
+        return (((h << 8) & _mask) ^ _shift_table[top]) ^ c;
+    }
+
+public:
+    const int _n, _wordsize;
+    uint64 _hashvalue;
+
+    /*
+     * Params:
+     *  n: length of the strings hashed
+     *  wordsize: number of bits in the hash. 8 to 64
+     *  seed: seed for choosing P
+     */
+    RabinFingerprint(int n, int wordsize = 64, uint32 seed = 25) :
+        _n(n),
+        _wordsize(wordsize),
+        _hashvalue(0)
+    {
+        assert(wordsize >= 8 && wordsize <= 64);
+        _poly = GF2Poly::find_irreducible(wordsize, seed);
+        _mask = wordsize == 64 ? ~(uint64)0 : ((uint64)1 << wordsize) - 1;
+        uint64 xd = _poly;
+        uint64 x8n = GF2Poly::xpow(8 * (uint64)n, _poly, wordsize);
+        for (int c = 0; c < 256; c++) {
+            _shift_table[c] = GF2Poly::mulmod((uint64)c, xd, _poly, wordsize);
+            _out_table[c] = GF2Poly::mulmod((uint64)c, x8n, _poly, wordsize);
+        }
+    }
+
+    template<class container> uint64 hash(container &c) const
+    {
+        assert(c.size() == static_cast<uint>(_n));
+        uint64 answer = 0;
+        for (int k = 0; k < _n; k++) {
+            answer = shift_in(answer, c[k]);
+        }
+        return answer;
+    }
+
+    uint64 get_hash(const chartype *data) const
+    {
+        uint64 answer = 0;
+        for (int k = 0; k < _n; k++) {
+            answer = shift_in(answer, data[k]);
+        }
+        return answer;
+    }
+
+    void eat(chartype inchar)
+    {
+        _hashvalue = shift_in(_hashvalue, inchar);
+    }
+
+    inline void update(chartype outchar, chartype inchar)
+    {
+        _hashvalue = shift_in(_hashvalue, inchar) ^ _out_table[outchar];
+    }
+
+    uint64 get_poly() const { return _poly; }
+};
+
+#endif
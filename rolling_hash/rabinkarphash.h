@@ -14,10 +14,11 @@ public:
     const int _n, _wordsize;
     hashvaluetype _hashvalue;
 
-    KarpRabinHash(int n, int wordsize=19) :  
+    // byte_map: see CharacterHash
+    KarpRabinHash(int n, int wordsize=19, const chartype *byte_map=0) :  
         _n(n), 
         _wordsize(wordsize), 
-        _hasher((1 << wordsize ) - 1),
+        _hasher((1 << wordsize ) - 1, byte_map),
         _HASHMASK((0x1 << wordsize) - 1),
         _BtoN(1) 
     {
@@ -33,26 +34,17 @@ public:
         assert(c.size() == static_cast<uint>(_n));
     	hashvaluetype answer = 0;
     	for (int k = 0;  k < _n; k++) {
-    	    hashvaluetype x = 1;
-    	    for (int j = 0; j < _n-1-k; j++) {
-    	        x = (x * B) & _HASHMASK;
-    	    }
-    	    x = (x * _hasher.hashvalues[c[k]]) & _HASHMASK;
-    	    answer = (answer+x) & _HASHMASK;
+    	    answer = (B*answer + _hasher.hashvalues[c[k]]) & _HASHMASK;
     	}
     	return answer;
     }
 
-    hashvaluetype get_hash(const chartype *data) 
+    // Same as hash() for the _n bytes starting at data. O(_n) by Horner's rule
+    hashvaluetype get_hash(const chartype *data) const
     {
     	hashvaluetype answer = 0;
     	for (int k = 0;  k < _n; k++) {
-    	    hashvaluetype x = 1;
-    	    for (int j = 0; j < _n-1-k; j++) {
-    	        x = (x * B) & _HASHMASK;
-    	    }
-    	    x = (x * _hasher.hashvalues[data[k]]) & _HASHMASK;
-    	    answer = (answer+x) & _HASHMASK;
+    	    answer = (B*answer + _hasher.hashvalues[data[k]]) & _HASHMASK;
     	}
     	return answer;
     }
@@ -67,6 +59,12 @@ public:
     	_hashvalue = (B*_hashvalue +  _hasher.hashvalues[inchar] - _BtoN *  _hasher.hashvalues[outchar]) & _HASHMASK; 
     } 
 
+    // Accessors for code that rolls this hash itself, e.g. the SIMD scanner 
+    static hashvaluetype get_B() { return B; }
+    hashvaluetype get_BtoN() const { return _BtoN; }
+    hashvaluetype get_mask() const { return _HASHMASK; }
+    const hashvaluetype *get_char_hashes() const { return _hasher.hashvalues; }
+
 
 
 };
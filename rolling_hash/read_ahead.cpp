@@ -0,0 +1,259 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#include <iostream>
+#include "read_ahead.h"
+
+using namespace std;
+
+ReadAheadFile::ReadAheadFile(size_t buffer_size, int depth, int num_readers) :
+    _buffer_size(buffer_size > 0 ? buffer_size : READ_AHEAD_BUFFER_SIZE),
+    // Two buffers so that one can be read while the caller holds the other
+    _depth(depth >= 2 ? depth : 2),
+    _num_readers(num_readers >= 1 ? num_readers : 1),
+    _file_size(0),
+    _num_blocks(0),
+#ifdef _WIN32
+    _file(INVALID_HANDLE_VALUE),
+#else
+    _fd(-1),
+#endif
+    _next_read(0),
+    _next_block(0),
+    _holding(false),
+    _failed(false),
+    _stop(false)
+{
+}
+
+#ifdef _WIN32
+
+static bool open_file(const string &path, void **file, long long *size)
+{
+    // Reads at explicit offsets on a synchronous handle can be issued from several threads
+    *file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (*file == INVALID_HANDLE_VALUE) {
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+    LARGE_INTEGER li;
+    if (!GetFileSizeEx(*file, &li)) {
+        cerr << "Could not get size of " << path << endl;
+        return false;
+    }
+    *size = (long long)li.QuadPart;
+    return true;
+}
+
+static void close_file(void **file)
+{
+    if (*file != INVALID_HANDLE_VALUE) {
+        CloseHandle(*file);
+    }
+    *file = INVALID_HANDLE_VALUE;
+}
+
+/*
+ * Read up to len bytes at offset
+ * Returns: number of bytes read, or -1 on error
+ */
+static long long read_at(void *file, byte *data, size_t len, long long offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        OVERLAPPED ov = {0};
+        long long pos = offset + (long long)done;
+        ov.Offset = (DWORD)pos;
+        ov.OffsetHigh = (DWORD)(pos >> 32);
+        DWORD want = (DWORD)(len - done < (1u << 30) ? len - done : (1u << 30));
+        DWORD got = 0;
+        if (!ReadFile(file, data + done, want, &got, &ov)) {
+            return GetLastError() == ERROR_HANDLE_EOF ? (long long)done : -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        done += got;
+    }
+    return (long long)done;
+}
+
+#else
+
+static bool open_file(const string &path, int *fd, long long *size)
+{
+    *fd = ::open(path.c_str(), O_RDONLY);
+    if (*fd < 0) {
+        cerr << "Could not open " << path << endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(*fd, &st) < 0) {
+        cerr << "Could not stat " << path << endl;
+        return false;
+    }
+    *size = (long long)st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(*fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+static void close_file(int *fd)
+{
+    if (*fd >= 0) {
+        ::close(*fd);
+    }
+    *fd = -1;
+}
+
+static long long read_at(int fd, byte *data, size_t len, long long offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t got = pread(fd, data + done, len - done, (off_t)(offset + (long long)done));
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        done += (size_t)got;
+    }
+    return (long long)done;
+}
+
+#endif
+
+bool ReadAheadFile::open(const string &path)
+{
+    close();
+#ifdef _WIN32
+    bool ok = open_file(path, &_file, &_file_size);
+#else
+    bool ok = open_file(path, &_fd, &_file_size);
+#endif
+    if (!ok) {
+        close();
+        return false;
+    }
+    _path = path;
+    _num_blocks = (_file_size + (long long)_buffer_size - 1) / (long long)_buffer_size;
+    _buffers.resize((size_t)_depth);
+    for (vector<Buffer>::iterator it = _buffers.begin(); it != _buffers.end(); it++) {
+        it->_data.resize(_buffer_size);
+        it->_len = 0;
+        it->_block = -1;
+    }
+    _next_read = 0;
+    _next_block = 0;
+    _holding = false;
+    _failed = false;
+    _stop = false;
+    for (int i = 0; i < _num_readers && i < _num_blocks; i++) {
+        _readers.push_back(thread(reader_thread, this));
+    }
+    return true;
+}
+
+void ReadAheadFile::close()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+        _changed.notify_all();
+    }
+    for (vector<thread>::iterator it = _readers.begin(); it != _readers.end(); it++) {
+        it->join();
+    }
+    _readers.clear();
+#ifdef _WIN32
+    close_file(&_file);
+#else
+    close_file(&_fd);
+#endif
+    // Keep the buffers for the next open() as they are usually the same size
+    _path.clear();
+    _file_size = 0;
+    _num_blocks = 0;
+}
+
+bool ReadAheadFile::read_block(long long block, Buffer &buffer)
+{
+    long long offset = block * (long long)_buffer_size;
+    size_t want = (size_t)(_file_size - offset < (long long)_buffer_size ? _file_size - offset : (long long)_buffer_size);
+#ifdef _WIN32
+    long long got = read_at(_file, &buffer._data[0], want, offset);
+#else
+    long long got = read_at(_fd, &buffer._data[0], want, offset);
+#endif
+    if (got < 0) {
+        cerr << "Could not read " << _path << endl;
+        return false;
+    }
+    // A file that shrank while it was being read ends early
+    buffer._len = (size_t)got;
+    return true;
+}
+
+/*
+ * Each reader takes the next block and reads it into its buffer once the caller has
+ *  released the block that was there before
+ */
+void ReadAheadFile::read_blocks()
+{
+    unique_lock<mutex> lock(_mutex);
+    while (!_stop && !_failed && _next_read < _num_blocks) {
+        long long block = _next_read++;
+        // The buffer is free once the block depth before this one has been released
+        while (!_stop && !_failed && block - _depth >= _next_block - (_holding ? 1 : 0)) {
+            _changed.wait(lock);
+        }
+        if (_stop || _failed) {
+            break;
+        }
+        Buffer &buffer = _buffers[(size_t)(block % _depth)];
+        lock.unlock();
+        bool ok = read_block(block, buffer);
+        lock.lock();
+        if (ok) {
+            buffer._block = block;
+        } else {
+            _failed = true;
+        }
+        _changed.notify_all();
+    }
+}
+
+bool ReadAheadFile::next(ByteView *chunk)
+{
+    unique_lock<mutex> lock(_mutex);
+    if (_holding) {
+        _holding = false;
+        _changed.notify_all();
+    }
+    if (_next_block >= _num_blocks) {
+        return false;
+    }
+    long long block = _next_block;
+    Buffer &buffer = _buffers[(size_t)(block % _depth)];
+    while (buffer._block != block && !_failed && !_stop) {
+        _changed.wait(lock);
+    }
+    if (buffer._block != block) {
+        return false;
+    }
+    _next_block++;
+    _holding = true;
+    *chunk = ByteView(&buffer._data[0], buffer._len);
+    return true;
+}
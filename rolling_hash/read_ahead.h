@@ -0,0 +1,119 @@
+#ifndef _READ_AHEAD_H_
+#define _READ_AHEAD_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "byteview.h"
+
+// Defaults for ReadAheadFile
+static const size_t READ_AHEAD_BUFFER_SIZE = 1 << 20;
+static const int READ_AHEAD_DEPTH = 8;
+static const int READ_AHEAD_READERS = 4;
+
+/*
+ * Reads a file in order into a ring of buffers, keeping several reads in flight, so the
+ *  caller can scan one buffer while the next ones are being read.
+ *
+ * The buffers are allocated once in open(). Block k of the file is read into buffer
+ *  k % depth by one of the reader threads with a positioned read (pread() or ReadFile() at an
+ *  offset), so up to min(readers, depth - 1) reads are outstanding while the caller holds a
+ *  buffer. A block is not read until the caller has released the buffer it goes into, so
+ *  memory use is fixed at depth buffers however large the file is.
+ *
+ * Compared with MappedFile this works on files that can't be mapped, e.g. on network file
+ *  systems or bigger than the address space, and page faults on cold data don't stall the
+ *  scan. A disk bound scan then runs at the speed of the disk rather than at the sum of the
+ *  read and scan times.
+ *
+ *      ReadAheadFile file;
+ *      if (file.open(path)) {
+ *          ByteView chunk;
+ *          while (file.next(&chunk))
+ *              scan(chunk);
+ *          ok = !file.failed();
+ *      }
+ */
+class ReadAheadFile
+{
+    struct Buffer
+    {
+        std::vector<byte> _data;
+        // Bytes read into _data
+        size_t _len;
+        // Index of the block in _data, or -1 if none has been read yet
+        long long _block;
+    };
+
+    const size_t _buffer_size;
+    const int _depth;
+    const int _num_readers;
+
+    std::string _path;
+    long long _file_size;
+    long long _num_blocks;
+#ifdef _WIN32
+    void *_file;
+#else
+    int _fd;
+#endif
+
+    std::vector<Buffer> _buffers;
+    std::vector<std::thread> _readers;
+
+    // Protects the block counters, Buffer::_len, Buffer::_block and _failed
+    std::mutex _mutex;
+    // Signalled when a block has been read or a buffer released
+    std::condition_variable _changed;
+    // Next block for a reader to read
+    long long _next_read;
+    // Next block to return from next(). Blocks before it have been released
+    long long _next_block;
+    // Is the caller holding the buffer of block _next_block - 1?
+    bool _holding;
+    bool _failed;
+    bool _stop;
+
+    ReadAheadFile(const ReadAheadFile &);
+    ReadAheadFile &operator=(const ReadAheadFile &);
+
+    bool read_block(long long block, Buffer &buffer);
+    void read_blocks();
+    static void reader_thread(ReadAheadFile *file) { file->read_blocks(); }
+
+public:
+    ReadAheadFile(size_t buffer_size = READ_AHEAD_BUFFER_SIZE, int depth = READ_AHEAD_DEPTH,
+                  int num_readers = READ_AHEAD_READERS);
+    ~ReadAheadFile() { close(); }
+
+    /*
+     * Open the file at path and start reading it. Any previously opened file is closed.
+     * Returns: true on success
+     */
+    bool open(const std::string &path);
+
+    /*
+     * Stop the readers and close the file
+     */
+    void close();
+
+    /*
+     * Release the previous chunk and wait for the next one. The chunk is valid until the next
+     *  call to next() or close()
+     * Returns: false at the end of the file or if a read failed
+     */
+    bool next(ByteView *chunk);
+
+    /*
+     * Did a read fail? Only meaningful once next() has returned false
+     */
+    bool failed() const { return _failed; }
+
+    bool is_open() const { return !_path.empty(); }
+    const std::string &get_path() const { return _path; }
+    long long get_size() const { return _file_size; }
+};
+
+#endif // _READ_AHEAD_H_
@@ -0,0 +1,179 @@
+#ifndef ROLLINGHASH
+#define ROLLINGHASH
+
+/*
+ * Rolling hashes with the window length and word size fixed at compile time.
+ *
+ * KarpRabinHash and GeneralHash take n and wordsize at run time, so B^n, the masks and the
+ *  loop in hash() are run time values. RollingHash<Family, N, Bits> gives the same hash
+ *  values as the run time class for the same family, n and wordsize, but B^N and the masks
+ *  are compile time constants and hash() has a constant trip count that the compiler
+ *  unrolls.
+ *
+ *  Families
+ *      KarpRabinFamily     same values as KarpRabinHash(N, Bits)
+ *      GeneralHashFamily   same values as GeneralHash<FULLPRECOMP>(N, Bits)
+ *
+ * dispatch_rolling_hash_len() maps a run time window length onto the compile time lengths
+ *  that are instantiated.
+ */
+#include "characterhash.h"
+#include "gf2poly.h"
+
+struct KarpRabinFamily {};
+struct GeneralHashFamily {};
+
+template <class Family, int N, int Bits> class RollingHash;
+
+/*
+ * b^e mod 2^bits as a compile time constant
+ */
+static inline constexpr hashvaluetype rolling_hash_pow(hashvaluetype b, int e, hashvaluetype mask)
+{
+    return e == 0 ? 1 : (hashvaluetype)((b * rolling_hash_pow(b, e - 1, mask)) & mask);
+}
+
+template <int N, int Bits>
+class RollingHash<KarpRabinFamily, N, Bits>
+{
+    CharacterHash _hasher;
+
+public:
+    static const hashvaluetype B = 37;
+    static const hashvaluetype HASHMASK = (hashvaluetype)((1ULL << Bits) - 1);
+    static const hashvaluetype BTON = rolling_hash_pow(B, N, HASHMASK);
+    static const int _n = N;
+    static const int _wordsize = Bits;
+
+    hashvaluetype _hashvalue;
+
+    // byte_map: see CharacterHash
+    RollingHash(const chartype *byte_map = 0) : _hasher(HASHMASK, byte_map), _hashvalue(0) {}
+
+    template<class container> hashvaluetype hash(container &c) const
+    {
+        hashvaluetype answer = 0;
+        for (int k = 0; k < N; k++) {
+            answer = (B*answer + _hasher.hashvalues[c[k]]) & HASHMASK;
+        }
+        return answer;
+    }
+
+    hashvaluetype get_hash(const chartype *data) const
+    {
+        hashvaluetype answer = 0;
+        for (int k = 0; k < N; k++) {
+            answer = (B*answer + _hasher.hashvalues[data[k]]) & HASHMASK;
+        }
+        return answer;
+    }
+
+    void eat(chartype inchar)
+    {
+        _hashvalue = (B*_hashvalue + _hasher.hashvalues[inchar]) & HASHMASK;
+    }
+
+    inline void update(chartype outchar, chartype inchar)
+    {
+        _hashvalue = (B*_hashvalue + _hasher.hashvalues[inchar] - BTON*_hasher.hashvalues[outchar]) & HASHMASK;
+    }
+};
+
+template <int N, int Bits>
+class RollingHash<GeneralHashFamily, N, Bits>
+{
+    CharacterHash _hasher;
+    hashvaluetype _irreduciblepoly;
+    // _precomputedshift[c] is the hash of c shifted N times: its contribution when it leaves
+    //  the window
+    hashvaluetype _precomputedshift[256];
+
+    inline hashvaluetype shift1(hashvaluetype x) const
+    {
+        x <<= 1;
+        return (x & LASTBIT) ? x ^ _irreduciblepoly : x;
+    }
+
+public:
+    static const hashvaluetype LASTBIT = (hashvaluetype)1 << Bits;
+    static const int _n = N;
+    static const int _wordsize = Bits;
+
+    hashvaluetype _hashvalue;
+
+    RollingHash(const chartype *byte_map = 0) : _hasher(LASTBIT - 1, byte_map), _hashvalue(0)
+    {
+        // Must match GeneralHash's choice of polynomial
+        if (Bits == 9) {
+            _irreduciblepoly = 1+(1<<2)+(1<<3)+(1<<5)+(1<<9);
+        } else {
+            _irreduciblepoly = (hashvaluetype)GF2Poly::find_irreducible(Bits, 25) | LASTBIT;
+        }
+        for (int c = 0; c < 256; c++) {
+            hashvaluetype x = _hasher.hashvalues[c];
+            for (int i = 0; i < N; i++) {
+                x = shift1(x);
+            }
+            _precomputedshift[c] = x;
+        }
+    }
+
+    template<class container> hashvaluetype hash(container &c) const
+    {
+        hashvaluetype answer = 0;
+        for (int k = 0; k < N; k++) {
+            answer = shift1(answer) ^ _hasher.hashvalues[c[k]];
+        }
+        return answer;
+    }
+
+    hashvaluetype get_hash(const chartype *data) const
+    {
+        hashvaluetype answer = 0;
+        for (int k = 0; k < N; k++) {
+            answer = shift1(answer) ^ _hasher.hashvalues[data[k]];
+        }
+        return answer;
+    }
+
+    void eat(chartype inchar)
+    {
+        _hashvalue = shift1(_hashvalue) ^ _hasher.hashvalues[inchar];
+    }
+
+    inline void update(chartype outchar, chartype inchar)
+    {
+        _hashvalue = shift1(_hashvalue) ^ _precomputedshift[outchar] ^ _hasher.hashvalues[inchar];
+    }
+};
+
+/*
+ * Call fn.template run<N>() with N = n if n is one of the window lengths that are compiled
+ *  in, e.g.
+ *      struct Scan { template <int N> void run() { RollingHash<KarpRabinFamily, N, 19> hf; ... } };
+ *      Scan scan;
+ *      if (!dispatch_rolling_hash_len(n, scan)) { ... use KarpRabinHash(n) ... }
+ * Returns: false if n is not compiled in
+ */
+template <class Functor>
+bool dispatch_rolling_hash_len(int n, Functor &fn)
+{
+    switch (n) {
+    case 4:   fn.template run<4>();   return true;
+    case 5:   fn.template run<5>();   return true;
+    case 6:   fn.template run<6>();   return true;
+    case 8:   fn.template run<8>();   return true;
+    case 10:  fn.template run<10>();  return true;
+    case 12:  fn.template run<12>();  return true;
+    case 16:  fn.template run<16>();  return true;
+    case 20:  fn.template run<20>();  return true;
+    case 24:  fn.template run<24>();  return true;
+    case 32:  fn.template run<32>();  return true;
+    case 50:  fn.template run<50>();  return true;
+    case 64:  fn.template run<64>();  return true;
+    case 100: fn.template run<100>(); return true;
+    default:  return false;
+    }
+}
+
+#endif
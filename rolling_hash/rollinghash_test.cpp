@@ -0,0 +1,98 @@
+/*
+ * Tests of RollingHash: for every window length that dispatch_rolling_hash_len() compiles in,
+ *  the compile time hashes roll to the same values as the run time classes they stand in for.
+ */
+#include <random>
+#include <string>
+#include <vector>
+#include "generalhash.h"
+#include "rabinkarphash.h"
+#include "rollinghash.h"
+#include "unit_test.h"
+
+using namespace std;
+
+// Bytes of random data that the hashes are rolled over
+static const size_t NUM_TEST_CHARS = 20000;
+
+/*
+ * Roll expected and actual over data and check they agree at every window
+ */
+template <class Expected, class Actual>
+static void check_same_hashes(Expected &expected, Actual &actual, const vector<chartype> &data)
+{
+    int n = actual._n;
+    for (int i = 0; i < n; i++) {
+        expected.eat(data[i]);
+        actual.eat(data[i]);
+    }
+    bool same = expected._hashvalue == actual._hashvalue && actual.get_hash(&data[0]) == actual._hashvalue;
+    for (size_t i = n; i < data.size(); i++) {
+        expected.update(data[i - n], data[i]);
+        actual.update(data[i - n], data[i]);
+        same = same && expected._hashvalue == actual._hashvalue;
+    }
+    CHECK(same);
+    vector<chartype> window(data.end() - n, data.end());
+    CHECK(actual.hash(window) == expected.hash(window));
+}
+
+template <int Bits>
+struct CheckRollingHash
+{
+    const vector<chartype> &_data;
+    const chartype *_byte_map;
+    int _num_run;
+
+    CheckRollingHash(const vector<chartype> &data, const chartype *byte_map) :
+        _data(data),
+        _byte_map(byte_map),
+        _num_run(0)
+    {}
+
+    template <int N> void run()
+    {
+        unit_note("RollingHash n=" + to_string(N) + " wordsize=" + to_string(Bits) + (_byte_map ? " with a byte map" : ""));
+        KarpRabinHash karp_rabin(N, Bits, _byte_map);
+        RollingHash<KarpRabinFamily, N, Bits> fixed_karp_rabin(_byte_map);
+        check_same_hashes(karp_rabin, fixed_karp_rabin, _data);
+        if (!_byte_map) {
+            GeneralHash<FULLPRECOMP> general(N, Bits);
+            RollingHash<GeneralHashFamily, N, Bits> fixed_general;
+            check_same_hashes(general, fixed_general, _data);
+        }
+        _num_run++;
+    }
+};
+
+/*
+ * Check every compiled in length, and that the others are not dispatched
+ */
+template <int Bits>
+static void check_lengths(const vector<chartype> &data, const chartype *byte_map)
+{
+    CheckRollingHash<Bits> check(data, byte_map);
+    int num_lens = 0;
+    for (int n = 1; n <= 128; n++) {
+        num_lens += dispatch_rolling_hash_len(n, check);
+    }
+    CHECK(num_lens == 13 && check._num_run == num_lens);
+}
+
+void test_rollinghash()
+{
+    mt19937 rng(14);
+    vector<chartype> data(NUM_TEST_CHARS);
+    for (size_t i = 0; i < data.size(); i++) {
+        // A small alphabet so that the byte map folds some bytes together
+        data[i] = (chartype)('A' + rng() % 58);
+    }
+    vector<chartype> fold(256);
+    for (int c = 0; c < 256; c++) {
+        fold[c] = (chartype)(c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c);
+    }
+    check_lengths<19>(data, 0);
+    check_lengths<9>(data, 0);
+    check_lengths<24>(data, 0);
+    check_lengths<19>(data, &fold[0]);
+}
@@ -1,40 +1,65 @@
 #include <memory.h>
+#include <string.h>
 #include <list>
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 #include "rabinkarphash.h"
+#include "bitfilter.h"
+#include "blocked_bloom.h"
+#include "multilane_scanner.h"
+#include "aho_corasick.h"
+#include "teddy.h"
+#include "spsc_ring.h"
+#include "anchored_regex.h"
 #include "lookahead.h"
+#include "mapped_file.h"
+#include "read_ahead.h"
+#include "byte_model.h"
 #include "rough_plan.h"
 
 /*
  * Rough plan for faster than disk-speed regular expressions
  *
- *  1) Run a rolling hash over input stream.
+ *  1) Run a rolling hash over input stream. (multilane_scanner.cpp does this with SIMD)
+ *      For literal rule sets an exact literal matcher can be used instead (literal_matcher.h)
  *  2) Look up hash in "needs action" table
  *  3) If needs action then look up regex(es) and action functions(s) assocated with that hash
  *  4) For each match on regexes perform action
  *
  *  Setup is based on a set of regexes and action functions.
  *      Find longest static substring in all regexes 
- *      Compute hash h for each substring x
- *          Set needs_action[h] = 1
- *          Add regex, action, h to action table
+ *      Choose a few hash lengths that fit these substrings
+ *      Compute hash h for each substring x using the longest hash length that fits in x,
+ *          or the rarest window of the static substrings if there is a ByteModel of the input
+ *          Set needs_action[h] = 1 in the table for that hash length
+ *          Add regex, action, h to action table for that hash length
  *
  */
 using namespace std;
 
-static const int WORDSIZE = 19;
-static const int HASH_TABLE_SIZE = 1 << WORDSIZE;
+// Range of wordsizes accepted. The filter is 2^wordsize bits
+static const int MIN_WORDSIZE = 10;
+static const int MAX_WORDSIZE = 28;
 
-// The "needs action" hash table
-static byte *_potential_match_table = 0;
+// Shortest static string we will hash on.
+// Need this to be high as possible to reject as many non-matches as possible in rolling hash phase
+// 5 is a guess
+static const int MIN_HASH_LEN = 5;
 
-// Maximum number of bytes to look ahead
-int _max_lookahead;
-
-// A lookahead buffer
-LookAheadBuffer *_lookahead;
+// Longest static string we will hash on. The rolling hash costs the same for any length
+//  but there is little to be gained in selectivity beyond this.
+static const int MAX_HASH_LEN = 32;
 
 static const byte *dup_data(int len, const byte *data)
 {
@@ -48,6 +73,12 @@ BinString::BinString(int len, const byte *data):
 {   
 }
 
+BinString::BinString(const BinString &other):
+    _len(other._len),
+    _data(dup_data(other._len, other._data))
+{
+}
+
 const vector<byte> BinString::get_as_vector() const 
 {
     vector<byte> v = vector<byte>(_len);
@@ -57,29 +88,68 @@ const vector<byte> BinString::get_as_vector() const
     return v;
 }
 
-/*
- * Create  "needs action" hash table with no entries 
- */
-static byte *make_hash_table() 
+static bool is_match(const RegexResults *results)
 {
-    byte *table = new byte[HASH_TABLE_SIZE];
-    memset(table, 0, HASH_TABLE_SIZE*sizeof(byte));
-    return table;
+    return results->_matched;
 }
 
-static bool is_match(const RegexResults *results)
+/*
+ * Run regex anchored at regex_offset in input
+ */
+static void apply_regex(ByteView input, size_t regex_offset, const Regex *regex, RegexResults *results)
 {
-    return true;  // !@#$ stub
+    regex->match_at(input.get_len(), input.get_data(), regex_offset, results);
 }
 
-RegexResults *apply_regex(const BinString input, int regex_offset, const Regex *_regex)
+/*
+ * Compile a pattern with its literals mapped through byte_map if it is given. 
+ * Returns: 0 and writes a message to cerr if it is not valid
+ */
+static Regex *compile_regex(const BinString &pattern, const byte *byte_map)
 {
-    return 0; // !@#$ stub
+    string error;
+    Regex *regex = Regex::compile(pattern.get_len(), pattern.get_data(), &error, byte_map);
+    if (!regex) {
+        cerr << "Bad regex \"" << string((const char *)pattern.get_data(), pattern.get_len()) 
+             << "\": " << error << endl;
+    }
+    return regex;
 }
 
-static Regex *compile_regex(const BinString pattern)
+/*
+ * Are the len bytes at a and b the same? len is at most MAX_HASH_LEN. Static strings are
+ *  short so this is two overlapping loads from each side and a compare, with no loop
+ */
+static inline bool static_string_equal(const byte *a, const byte *b, int len)
 {
-    return 0; // !@#$ dummy value
+#if defined(__SSE2__) || defined(_M_X64)
+    if (len >= 16) {
+        __m128i head = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b));
+        __m128i tail = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + len - 16)), _mm_loadu_si128((const __m128i *)(b + len - 16)));
+        return _mm_movemask_epi8(_mm_and_si128(head, tail)) == 0xffff;
+    }
+#else
+    if (len > 16) {
+        return !memcmp(a, b, len);
+    }
+#endif
+    if (len >= 8) {
+        uint64 a0, b0, a1, b1;
+        memcpy(&a0, a, 8);
+        memcpy(&b0, b, 8);
+        memcpy(&a1, a + len - 8, 8);
+        memcpy(&b1, b + len - 8, 8);
+        return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+    }
+    if (len >= 4) {
+        uint32 a0, b0, a1, b1;
+        memcpy(&a0, a, 4);
+        memcpy(&b0, b, 4);
+        memcpy(&a1, a + len - 4, 4);
+        memcpy(&b1, b + len - 4, 4);
+        return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+    }
+    return !memcmp(a, b, len);
 }
 
 class RegexAction 
@@ -91,7 +161,7 @@ public:  // Hack !@#$ Make this private and write accessor functions
     // Static string to hash on
     const BinString _static_string;
 
-    // Offset of _static_string in _params._pattern
+    // Offset of _static_string in matches of _params._pattern
     const int _offset;
 
     // Hash value of the _static_string
@@ -100,222 +170,1895 @@ public:  // Hack !@#$ Make this private and write accessor functions
     // Compiled regex
     const Regex *_regex;
 
+    // Number of bytes from the start of a match needed to verify it in a stream
+    const int _span;
+
+    // Position of _params in the list passed to fastregex_init(). Breaks ties between 
+    //  matches at the same offset
+    const int _index;
+
+    // Number of times the regex was run and number of times it matched. Only counted if 
+    //  _collect_stats is set
+    mutable atomic<long long> _num_verified;
+    mutable atomic<long long> _num_matched;
+
 public:
-    RegexAction(const RegexActionParams params, const BinString static_string, int offset, hashvaluetype static_string_hash) :
+    RegexAction(const RegexActionParams &params, const Regex *regex, const BinString &static_string, int offset, hashvaluetype static_string_hash, int index) :
         _params(params),
         _static_string(static_string),
         _offset(offset),
         _static_string_hash(static_string_hash),
-        _regex(compile_regex(params._pattern)) 
+        _regex(regex),
+        _span(regex->get_max_width() >= 0 && regex->get_max_width() < MAX_STREAM_SPAN ? regex->get_max_width() : MAX_STREAM_SPAN),
+        _index(index),
+        _num_verified(0),
+        _num_matched(0)
         {}
+
+    ~RegexAction() { delete _regex; }
 };
 
 /*
- * Return longest static string in a regex pattern
+ * Return longest static string in a regex. This is the literal that occurs at a fixed offset 
+ *  in every match.
+ * Returns: 0 if the regex has no static string
  */
-static BinString get_largest_static_string(BinString pattern)
+static const RegexLiteral *get_largest_static_string(const Regex *regex)
 {
-    return BinString(5, (const byte*)"Do this later"); // !@#$ dummy value
+    const RegexLiteral *longest = 0;
+    const vector<RegexLiteral> &literals = regex->get_literals();
+    for (vector<RegexLiteral>::const_iterator it = literals.begin(); it != literals.end(); it++) {
+        if (!longest || it->get_len() > longest->get_len()) {
+            longest = &*it;
+        }
+    }
+    return longest;
 }
 
 /*
- * Return offset of static string in a regex pattern
+ * Return the length of the longest static string that regex can hash on. 0 if none
  */
-static int get_offset(BinString pattern, BinString static_string)
+static int get_static_string_len(const Regex *regex)
 {
-    return 3;   // !@#$ dummy value
+    const RegexLiteral *s = get_largest_static_string(regex);
+    if (!s) {
+        return 0;
+    }
+    return s->get_len() < MAX_HASH_LEN ? s->get_len() : MAX_HASH_LEN;
 }
 
-static int get_longest_string(const vector<RegexActionParams *> action_params_list)
+/*
+ * Return the length of the static string of regex that the hash windows should be chosen to
+ *  fit. Without a model this is get_static_string_len(). With one it is the length, up to 
+ *  MAX_HASH_LEN, of the static string with the rarest window of that length, which may be 
+ *  shorter than the largest if the largest is made of common bytes
+ */
+static int get_preferred_len(const Regex *regex, const ByteModel *model)
 {
-    int longest = 0;
-    for (vector<RegexActionParams *>::const_iterator it = action_params_list.begin(); it != action_params_list.end(); it++) {
-        BinString s = get_largest_static_string((*it)->_pattern);
-        if (s.get_len() > longest) {
-            longest = s.get_len();
+    int len = get_static_string_len(regex);
+    if (!model || model->is_empty()) {
+        return len;
+    }
+    double best = 0.0;
+    const vector<RegexLiteral> &literals = regex->get_literals();
+    for (vector<RegexLiteral>::const_iterator it = literals.begin(); it != literals.end(); it++) {
+        int n = it->get_len() < MAX_HASH_LEN ? it->get_len() : MAX_HASH_LEN;
+        if (n < MIN_HASH_LEN) {
+            continue;
+        }
+        for (int i = 0; i + n <= it->get_len(); i++) {
+            double log_prob = model->get_log_prob(&it->_bytes[i], n);
+            if (log_prob < best) {
+                best = log_prob;
+                len = n;
+            }
         }
     }
-    return longest;
+    return len;
+}
+
+/*
+ * Return the total number of bytes hashed on if each static string length in lens is 
+ *  hashed on the longest length in hash_lens that is not longer than it.
+ *  hash_lens is sorted in increasing order
+ */
+static int get_total_hashed(const vector<int> &lens, const vector<int> &hash_lens)
+{
+    int total = 0;
+    for (vector<int>::const_iterator it = lens.begin(); it != lens.end(); it++) {
+        int best = 0;
+        for (vector<int>::const_iterator jt = hash_lens.begin(); jt != hash_lens.end() && *jt <= *it; jt++) {
+            best = *jt;
+        }
+        total += best;
+    }
+    return total;
 }
 
+/*
+ * The "needs action" table and the actions for each hash value in it.
+ *
+ * This is on the hot path so it is laid out flat
+ *  _filter is a 1 bit per hash value "needs action" table. It is checked for every byte
+ *      of input so it is kept small enough to stay in cache
+ *  The actions are stored in compressed sparse row form, indexed by the rank of the hash 
+ *      value in _filter. The actions for the i'th hash value in _filter are
+ *      _actions[_bucket_starts[i].._bucket_starts[i+1])
+ *  So a filter hit costs a popcount and 2 or 3 cache lines, with no allocation.
+ */
+class ActionTable
+{
+    BitFilter _filter;
+    vector<uint32> _bucket_starts;
+    vector<const RegexAction *> _actions;
+    // Actions added since the last build()
+    vector<pair<hashvaluetype, const RegexAction *>> _pending;
+    // Second check on _filter hits for large rule sets. 0 if not used
+    BlockedBloomFilter *_bloom;
+
+public:
+    ActionTable(int wordsize) : _filter(wordsize), _bloom(0) {}
+
+    ~ActionTable()
+    {
+        for (vector<const RegexAction *>::iterator it = _actions.begin(); it != _actions.end(); it++) {
+            delete *it;
+        }
+        delete _bloom;
+    }
+
+    const BitFilter &get_filter() const { return _filter; }
+
+    /*
+     * Add action for hash value h. Takes ownership of action.
+     *  build() must be called before the table is used.
+     */
+    void add(hashvaluetype h, const RegexAction *action)
+    {
+        _pending.push_back(make_pair(h, action));
+        _filter.set(h);
+    }
+
+    /*
+     * Build the compressed sparse rows from the pending actions. Actions for each hash 
+     *  value are kept in the order they were added.
+     *  If use_bloom then also build a Bloom filter of the fingerprints of the static strings
+     *  for confirm()
+     */
+    void build(bool use_bloom)
+    {
+        if (use_bloom) {
+            delete _bloom;
+            _bloom = new BlockedBloomFilter(_actions.size() + _pending.size());
+            for (vector<const RegexAction *>::iterator it = _actions.begin(); it != _actions.end(); it++) {
+                _bloom->add(get_fingerprint((*it)->_static_string));
+            }
+            for (vector<pair<hashvaluetype, const RegexAction *>>::iterator it = _pending.begin(); it != _pending.end(); it++) {
+                _bloom->add(get_fingerprint(it->second->_static_string));
+            }
+        }
+        _filter.build_ranks();
+        for (vector<const RegexAction *>::iterator it = _actions.begin(); it != _actions.end(); it++) {
+            _pending.push_back(make_pair((*it)->_static_string_hash, *it));
+        }
+        stable_sort(_pending.begin(), _pending.end(), compare_hash);
+
+        uint32 num_buckets = _filter.count();
+        _bucket_starts.assign(num_buckets + 1, 0);
+        _actions.clear();
+        for (vector<pair<hashvaluetype, const RegexAction *>>::iterator it = _pending.begin(); it != _pending.end(); it++) {
+            _bucket_starts[_filter.rank(it->first) + 1]++;
+            _actions.push_back(it->second);
+        }
+        for (uint32 i = 0; i < num_buckets; i++) {
+            _bucket_starts[i + 1] += _bucket_starts[i];
+        }
+        _pending.clear();
+    }
+
+    bool test(hashvaluetype h) const { return _filter.test(h); }
+
+    /*
+     * Check a _filter hit on the len byte static string at data against the Bloom filter.
+     * Returns: false if the static string is definitely not in the table
+     */
+    bool confirm(const byte *data, int len) const
+    {
+        return !_bloom || _bloom->test(BlockedBloomFilter::fingerprint(data, len));
+    }
+
+    bool has_bloom() const { return _bloom != 0; }
+
+    /*
+     * Return the actions for hash value h which must be in the filter
+     *  The actions are [*begin, *end)
+     */
+    void get_actions(hashvaluetype h, const RegexAction *const **begin, const RegexAction *const **end) const
+    {
+        // This cannot happen by design
+        assert(_filter.test(h));
+        uint32 i = _filter.rank(h);
+        *begin = &_actions[0] + _bucket_starts[i];
+        *end = &_actions[0] + _bucket_starts[i + 1];
+    }
 
-static KarpRabinHash *_hash_central = 0;
+private:
+    static uint64 get_fingerprint(const BinString &static_string)
+    {
+        return BlockedBloomFilter::fingerprint(static_string.get_data(), static_string.get_len());
+    }
 
-// _action_map[static_string_hash] is a list of actions which match static_string_hash 
-static map<hashvaluetype, vector<const RegexAction *>> _action_map;
+    static bool compare_hash(const pair<hashvaluetype, const RegexAction *> &a, const pair<hashvaluetype, const RegexAction *> &b)
+    {
+        return a.first < b.first;
+    }
+};
 
 /*
- * Add a new action to _action_map
+ * A rolling hash of one length along with its action table.
+ *  All the HashWindows are run over the input in the same pass.
  */
-static void add_to_action_map(const RegexAction* action) 
+struct HashWindow
 {
-    hashvaluetype static_string_hash = action->_static_string_hash;
-    if (_action_map.find(static_string_hash) == _action_map.end()) {
-        _action_map[static_string_hash] = vector<const RegexAction *>();
-    }
-    _action_map[static_string_hash].push_back(action);
+    // The rolling hash. _hash->_n is the length of the static strings hashed
+    KarpRabinHash *_hash;
+
+    // The "needs action" table and the actions for each hash value in it
+    ActionTable _table;
+
+    HashWindow(int n, int wordsize, const byte *byte_map) : _hash(new KarpRabinHash(n, wordsize, byte_map)), _table(wordsize) {}
+    ~HashWindow() { delete _hash; }
+};
+
+// Number of offsets scanned for filter hits at a time by fastregex_process()
+static const size_t SCAN_BLOCK_SIZE = 1 << 16;
+
+static long long get_elapsed_ns(chrono::steady_clock::time_point start)
+{
+    return (long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
 }
 
+class MatchBatch;
+
 /*
- * Run through all the candidate regex's for a potential match and perform appropriate 
- *  actions on actual matches.
- * Params:
- *  input: Entire string being processed
- *  static_string_hash: rolling hash value
- *  static_string_offset: offset of start of static string in input
- * Returns: 
- *  true if all action functions that were run returned true
+ * The bytes of a regex's static strings that it is hashed on
  */
-static bool perform_actions(const BinString input, hashvaluetype static_string_hash, int static_string_offset)
+struct StaticStringChoice
 {
-     // This cannot happen by design
-    assert(_action_map.find(static_string_hash) != _action_map.end());
-    
-    vector<const RegexAction *> action_list = _action_map[static_string_hash];
+    // Index in FastRegexRules::_windows. The window's length is the number of bytes
+    int _window;
+    const byte *_bytes;
+    // Offset of _bytes in matches of the regex
+    int _offset;
+};
 
-    for (vector<const RegexAction *>::iterator it = action_list.begin(); it != action_list.end(); it++) {
-        const RegexAction* action = *it;
-        
-        // Offset of start of regex in input
-        int regex_offset = static_string_offset - action->_offset;
+/*
+ * The compiled tables for a rule set. This is what a FastRegex owns.
+ *
+ * Everything is set up by init() and not changed after that, so any number of threads can
+ *  scan with the same FastRegexRules at once. The only state that changes while scanning is
+ *  the counters, which are atomic, and the batches, which belong to the callers.
+ */
+class FastRegexRules
+{
+    // Number of bits in the rolling hash. Set from FastRegexOptions::_wordsize
+    int _wordsize;
 
-        // Run the full regex on the data
-        RegexResults *results = apply_regex(input, regex_offset, action->_regex);
-        
-        // If it is a match then perform the action function
-        if (is_match(results)) {
-            if (!action->_params._action_fn(input, results, regex_offset)) {
+    // Maximum number of different hash lengths that are run over the input in the same pass.
+    //  Each one costs a rolling hash update and a table lookup per byte.
+    //  Set from FastRegexOptions::_max_hash_windows
+    int _max_hash_windows;
+
+    // Are the action tables' Bloom filters being used?
+    bool _use_bloom;
+
+    // Byte normalization map from FastRegexOptions::_byte_map. Empty if there is none. The
+    //  static strings are of mapped bytes
+    vector<byte> _byte_map;
+
+    // Batch mode settings. Set from FastRegexOptions
+    FastRegexBatchFn _batch_fn;
+    void *_batch_context;
+    size_t _batch_size;
+
+    // The hash windows in increasing order of length
+    vector<HashWindow *> _windows;
+
+    // Scanner for all the hash windows
+    MultiLaneScanner _scanner;
+
+    // Exact matcher for the static strings when a literal backend is used, else 0.
+    //  Literal i is the static string of _literal_candidates[i]._window with hash value
+    //  _literal_candidates[i]._hash, so its hits go through the same action tables as filter hits
+    LiteralMatcher *_literal_matcher;
+    vector<ScanCandidate> _literal_candidates;
+
+    // All the actions in the order they were passed to init(). The HashWindows own them
+    vector<const RegexAction *> _all_actions;
+
+    // Maximum number of bytes to look ahead
+    int _max_lookahead;
+
+    // Maximum RegexAction::_span
+    int _max_span;
+
+    // Counters for get_stats(). They are only updated if _collect_stats is set so they cost
+    //  nothing otherwise. They are atomic as the parallel and pipelined modes and concurrent
+    //  scans update them from several threads
+    bool _collect_stats;
+    mutable atomic<long long> _bytes_scanned;
+    mutable atomic<long long> _filter_hits;
+    mutable atomic<long long> _bloom_rejects;
+    mutable atomic<long long> _static_string_rejects;
+    mutable atomic<long long> _verify_ns;
+    mutable atomic<long long> _action_ns;
+
+    FastRegexRules(const FastRegexRules &);
+    FastRegexRules &operator=(const FastRegexRules &);
+
+    void scan_literals(const byte *data, size_t numchars, size_t begin, size_t end, vector<ScanCandidate> &candidates) const;
+    vector<int> choose_hash_lens(const vector<int> &lens) const;
+    StaticStringChoice choose_static_string(const Regex *regex, int len, const ByteModel *model) const;
+
+public:
+    FastRegexRules();
+    ~FastRegexRules();
+
+    bool init(const vector<RegexActionParams *> &action_params_list, const FastRegexOptions &options);
+
+    const HashWindow *get_window(int w) const { return _windows[w]; }
+    const byte *get_byte_map() const { return _byte_map.empty() ? 0 : &_byte_map[0]; }
+    int get_max_n() const { return _windows.empty() ? 0 : _windows.back()->_hash->_n; }
+    int get_max_lookahead() const { return _max_lookahead; }
+    int get_max_span() const { return _max_span; }
+    bool is_batch_mode() const { return _batch_fn != 0; }
+    size_t get_batch_size() const { return _batch_size; }
+    const char *get_backend_name() const { return _literal_matcher ? _literal_matcher->get_name() : "rolling-hash"; }
+
+    void scan_block(const byte *data, size_t numchars, size_t begin, size_t end, vector<ScanCandidate> &candidates) const;
+    bool has_static_string(ByteView input, size_t regex_offset, const RegexAction *action) const;
+    bool verify_action(ByteView input, size_t regex_offset, const RegexAction *action, RegexResults *results) const;
+    bool run_action(ByteView input, const RegexResults *results, size_t regex_offset, const RegexAction *action, MatchBatch &batch) const;
+    bool deliver_batch(ByteView input, const FastRegexMatch *matches, size_t num_matches) const;
+    bool perform_actions(ByteView input, const HashWindow *window, hashvaluetype static_string_hash, size_t static_string_offset, MatchBatch &batch) const;
+
+    bool process(ByteView input) const;
+    bool process_range(ByteView input, size_t begin, size_t end, long long *num_matches) const;
+    bool process_in_order(ByteView input) const;
+    bool process_pipelined(ByteView input) const;
+    bool process_parallel(ByteView input, int num_threads) const;
+
+    FastRegexStats get_stats() const;
+    void reset_stats() const;
+};
+
+/*
+ * Matches waiting to be passed to the FastRegexBatchFn. A batch is delivered when it is
+ *  full, when the input changes and when the owner flushes it at the end of some input.
+ *  Each call that processes input has its own batch.
+ */
+class MatchBatch
+{
+    const FastRegexRules &_rules;
+    vector<FastRegexMatch> _matches;
+    ByteView _input;
+
+public:
+    MatchBatch(const FastRegexRules &rules) : _rules(rules) {}
+
+    /*
+     * Add a match of action in input
+     * Returns: false if a batch was delivered and the FastRegexBatchFn returned false
+     */
+    bool add(ByteView input, const RegexResults *results, const RegexAction *action)
+    {
+        if (!_matches.empty() && (input.get_data() != _input.get_data() || input.get_len() != _input.get_len())) {
+            if (!flush()) {
                 return false;
             }
         }
-    } 
-    return true;
+        _input = input;
+        FastRegexMatch match;
+        match._offset = results->_stream_offset;
+        match._len = results->_len;
+        match._pattern = action->_index;
+        _matches.push_back(match);
+        return _matches.size() < _rules.get_batch_size() || flush();
+    }
+
+    /*
+     * Deliver the matches collected so far
+     * Returns: the FastRegexBatchFn's return value
+     */
+    bool flush()
+    {
+        if (_matches.empty()) {
+            return true;
+        }
+        bool ok = _rules.deliver_batch(_input, &_matches[0], _matches.size());
+        _matches.clear();
+        return ok;
+    }
+};
+
+FastRegexRules::FastRegexRules() :
+    _wordsize(FastRegexOptions::DEFAULT_WORDSIZE),
+    _max_hash_windows(FastRegexOptions::DEFAULT_MAX_HASH_WINDOWS),
+    _use_bloom(false),
+    _batch_fn(0),
+    _batch_context(0),
+    _batch_size(FastRegexOptions::DEFAULT_BATCH_SIZE),
+    _literal_matcher(0),
+    _max_lookahead(0),
+    _max_span(0),
+    _collect_stats(false),
+    _bytes_scanned(0),
+    _filter_hits(0),
+    _bloom_rejects(0),
+    _static_string_rejects(0),
+    _verify_ns(0),
+    _action_ns(0)
+{
 }
 
 /*
- * Initialize the fast regex module.
- * Setup hash table and map of hash value to actions.
+ * Destroy all the data allocated in init()
  */
-bool fastregex_init(const vector<RegexActionParams *> action_params_list)
+FastRegexRules::~FastRegexRules()
 {
-    // Set up the hash table
-    _potential_match_table = make_hash_table();
-    int hash_len = get_longest_string(action_params_list); 
+    for (vector<HashWindow *>::iterator it = _windows.begin(); it != _windows.end(); it++) {
+        delete *it;
+    }
+    delete _literal_matcher;
+}
 
-    // Need this to be high as possible to reject as many non-matches as possible in rolling hash phase
-    // 5 is a guess
-    assert(hash_len >= 5);
-    
-    // Initialize the rolling hash
-    _hash_central = new KarpRabinHash(hash_len);
+/*
+ * Choose up to _max_hash_windows hash lengths for a set of static string lengths.
+ *  The shortest static string length must be included so that every regex can be hashed.
+ *  The remaining lengths are added greedily to maximize the total number of bytes hashed on
+ *  as longer hashes give fewer false hits.
+ * Returns: hash lengths in increasing order
+ */
+vector<int> FastRegexRules::choose_hash_lens(const vector<int> &lens) const
+{
+    vector<int> candidates(lens);
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
 
-     _max_lookahead = 0;
-    // Build the action map
-    for (int i = 0; i < (int)action_params_list.size(); i++) {
-        BinString static_string(hash_len, action_params_list[i]->_pattern.get_data());
-        int offset = get_offset(action_params_list[i]->_pattern, static_string);
-        hashvaluetype static_string_hash = _hash_central->hash(static_string.get_as_vector());
-        add_to_action_map(new RegexAction(*action_params_list[i], static_string, offset, static_string_hash));
-        if (offset >  _max_lookahead) {
-             _max_lookahead = offset;
+    vector<int> hash_lens;
+    hash_lens.push_back(candidates[0]);
+    while ((int)hash_lens.size() < _max_hash_windows) {
+        int best_len = 0;
+        int best_total = get_total_hashed(lens, hash_lens);
+        for (vector<int>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+            vector<int> trial(hash_lens);
+            trial.push_back(*it);
+            sort(trial.begin(), trial.end());
+            int total = get_total_hashed(lens, trial);
+            if (total > best_total) {
+                best_total = total;
+                best_len = *it;
+            }
         }
+        if (!best_len) {
+            break;
+        }
+        hash_lens.push_back(best_len);
+        sort(hash_lens.begin(), hash_lens.end());
     }
-
-    _lookahead = new LookAheadBuffer(_max_lookahead);
-    return true;
+    return hash_lens;
 }
 
-void fastregex_term()
+/*
+ * Choose the bytes of regex's static strings to hash on. len is get_preferred_len(regex).
+ *
+ * Without a model this is the first bytes of the largest static string in the longest window
+ *  that fits in it. With a model every window of every static string in every hash window
+ *  that fits is tried and the one the model estimates is rarest in the input is chosen, so 
+ *  common bytes such as escape sequences and padding are avoided
+ */
+StaticStringChoice FastRegexRules::choose_static_string(const Regex *regex, int len, const ByteModel *model) const
 {
-    // !@#$ Need to destroy all the tables created in fastregex_init()
+    StaticStringChoice choice;
+    choice._window = 0;
+    while (choice._window + 1 < (int)_windows.size() && _windows[choice._window + 1]->_hash->_n <= len) {
+        choice._window++;
+    }
+    const RegexLiteral *largest = get_largest_static_string(regex);
+    choice._bytes = &largest->_bytes[0];
+    choice._offset = largest->_offset;
+    if (!model || model->is_empty()) {
+        return choice;
+    }
 
+    double best = model->get_log_prob(choice._bytes, _windows[choice._window]->_hash->_n);
+    const vector<RegexLiteral> &literals = regex->get_literals();
+    for (int w = 0; w < (int)_windows.size(); w++) {
+        int n = _windows[w]->_hash->_n;
+        for (vector<RegexLiteral>::const_iterator it = literals.begin(); it != literals.end(); it++) {
+            for (int i = 0; i + n <= it->get_len(); i++) {
+                double log_prob = model->get_log_prob(&it->_bytes[i], n);
+                if (log_prob < best) {
+                    best = log_prob;
+                    choice._window = w;
+                    choice._bytes = &it->_bytes[i];
+                    choice._offset = it->_offset + i;
+                }
+            }
+        }
+    }
+    return choice;
 }
 
 /*
- * Process some data using fast regex's
- * 
- * Run through the data and compute a rolling hash for each byte
- *  If the rolling hash shows a potential match then call perform_actions()
- *      on the rolling hash value to find exact regex matches and run 
- *      appropriate functions on those exact matches.
+ * Append the static strings that _literal_matcher finds in [begin, end) of data[0..numchars)
+ *  to candidates
  */
-bool fastregex_process(const BinString input) 
+void FastRegexRules::scan_literals(const byte *data, size_t numchars, size_t begin, size_t end, vector<ScanCandidate> &candidates) const
 {
-    const byte *data = input.get_data();
-    int numchars = input.get_len();
-    int n = _hash_central->_n;
-    
-    // Prime the first n has values
-    for (int k = 0; k < n; k++) {
-        _hash_central->eat(data[k]);
-    }
-
-    // Compute the remaining hash values by the rolling hash method
-    for (int k = n; k < numchars; k++) {
-        _hash_central->update(data[k-n], data[k]);
-        // If there is a hit then do something
-        if (_potential_match_table[_hash_central->_hashvalue]) {
-            if (!perform_actions(input, _hash_central->_hashvalue, k)) {
-                return false;
+    vector<LiteralHit> hits;
+    _literal_matcher->scan(data, numchars, begin, end, hits);
+    for (vector<LiteralHit>::const_iterator it = hits.begin(); it != hits.end(); it++) {
+        ScanCandidate candidate = _literal_candidates[it->_literal];
+        candidate._offset = it->_offset;
+        candidates.push_back(candidate);
+    }
+}
+
+/*
+ * Append the filter hits for static strings that start in [begin, end) of data[0..numchars)
+ *  to candidates. All scanning goes through here so that it is counted.
+ *  If _use_bloom then the hits are checked against the Bloom filters and only the ones that
+ *  pass are kept.
+ */
+void FastRegexRules::scan_block(const byte *data, size_t numchars, size_t begin, size_t end, vector<ScanCandidate> &candidates) const
+{
+    size_t num_candidates = candidates.size();
+    if (_literal_matcher) {
+        scan_literals(data, numchars, begin, end, candidates);
+    } else {
+        _scanner.scan(data, numchars, begin, end, candidates);
+    }
+    size_t num_hits = candidates.size() - num_candidates;
+    if (_use_bloom) {
+        vector<ScanCandidate>::iterator out = candidates.begin() + num_candidates;
+        byte mapped[MAX_HASH_LEN];
+        for (vector<ScanCandidate>::iterator it = out; it != candidates.end(); it++) {
+            const HashWindow *window = _windows[it->_window];
+            const byte *static_string = data + it->_offset;
+            if (!_byte_map.empty()) {
+                for (int i = 0; i < window->_hash->_n; i++) {
+                    mapped[i] = _byte_map[static_string[i]];
+                }
+                static_string = mapped;
+            }
+            if (window->_table.confirm(static_string, window->_hash->_n)) {
+                *out++ = *it;
             }
         }
+        candidates.erase(out, candidates.end());
     }
+    if (_collect_stats) {
+        _bytes_scanned += (long long)(end - begin);
+        _filter_hits += (long long)num_hits;
+        _bloom_rejects += (long long)(num_candidates + num_hits - candidates.size());
+    }
+}
 
+/*
+ * Is action's static string in input where it would be if action's regex matched at 
+ *  regex_offset? A filter hit only says that some static string with the same hash value
+ *  may be there
+ */
+bool FastRegexRules::has_static_string(ByteView input, size_t regex_offset, const RegexAction *action) const
+{
+    size_t offset = regex_offset + action->_offset;
+    int len = action->_static_string.get_len();
+    if (offset + len > input.get_len()) {
+        return false;
+    }
+    const byte *data = input.get_data() + offset;
+    const byte *static_string = action->_static_string.get_data();
+    if (_byte_map.empty()) {
+        return static_string_equal(data, static_string, len);
+    }
+    for (int i = 0; i < len; i++) {
+        if (_byte_map[data[i]] != static_string[i]) {
+            return false;
+        }
+    }
     return true;
 }
 
 /*
- * Process some data using fast regex's.
- *
- * Like fastregex_process() except that it guarantees the order of processing is the 
- *  same as if the regex's where performed sequentially on every byte on the input data.
- *
- * This is achieved with a lookahead buffer that runs all the regex's that match the
- *  the static string.
- *
- * Run through the data and compute a rolling hash for each byte
- *  If the rolling hash shows a potential match then call perform_actions()
- *      on the rolling hash value to find exact regex matches and run 
- *      appropriate functions on those exact matches.
+ * Run action's regex anchored at regex_offset in input. Hash collisions are rejected by 
+ *  comparing the static string first, so most filter hits never run a regex
+ * Returns: true if it matched
+ */
+bool FastRegexRules::verify_action(ByteView input, size_t regex_offset, const RegexAction *action, RegexResults *results) const
+{
+    if (!has_static_string(input, regex_offset, action)) {
+        results->_matched = false;
+        if (_collect_stats) {
+            _static_string_rejects++;
+        }
+        return false;
+    }
+    if (!_collect_stats) {
+        apply_regex(input, regex_offset, action->_regex, results);
+        return is_match(results);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    apply_regex(input, regex_offset, action->_regex, results);
+    _verify_ns += get_elapsed_ns(start);
+    action->_num_verified++;
+    if (is_match(results)) {
+        action->_num_matched++;
+    }
+    return is_match(results);
+}
+
+/*
+ * Pass some matches to the FastRegexBatchFn
+ * Returns: its return value
  */
+bool FastRegexRules::deliver_batch(ByteView input, const FastRegexMatch *matches, size_t num_matches) const
+{
+    if (!_collect_stats) {
+        return _batch_fn(input, matches, num_matches, _batch_context);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool ok = _batch_fn(input, matches, num_matches, _batch_context);
+    _action_ns += get_elapsed_ns(start);
+    return ok;
+}
 
-bool fastregex_process_in_order(const BinString input) 
+/*
+ * Run action's action function on a match or add it to batch in batch mode
+ * Returns: the action function's return value
+ */
+bool FastRegexRules::run_action(ByteView input, const RegexResults *results, size_t regex_offset, const RegexAction *action, MatchBatch &batch) const
 {
-    const byte *data = input.get_data();
-    int numchars = input.get_len();
-    int n = _hash_central->_n;          // Hash length
-    
-    // Prime the first n has values
-    for (int offset = 0; offset < n; offset++) {
-        _hash_central->eat(data[offset]);
-    }
-
-    // Compute the remaining hash values by the rolling hash method
-    for (int offset = n; offset < numchars; offset++) {
-        _hash_central->update(data[offset-n], data[offset]);
-        if (_potential_match_table[_hash_central->_hashvalue]) {
-            // If there is a hit then look ahead for all potential matches around this offset
-            for (int i = 0; i < _max_lookahead; i++) {
-                // Careful here. offset + i is the offset we are looking ahead to
-                int lookahead_offset = offset + i;
-                // !@#$ This is slow. We could re-use the rolling hash here
-                hashvaluetype lookahead_hashvalue = _hash_central->get_hash(data + lookahead_offset);
-                // If we have not already processessed this offset in a previous lookahead
-                if (!_lookahead->contains(lookahead_offset)) {
-                    // Match anywere in the look ahead?
-                    if (_potential_match_table[lookahead_hashvalue]) {
-                        // Act 
-                        if (!perform_actions(input, lookahead_hashvalue, lookahead_offset)) {
-                            return false;
-                        }
-                        // Mark this offset as done so we don't hit it again
-                       _lookahead->push(lookahead_offset);
-                    }
-                }
+    if (_batch_fn) {
+        return batch.add(input, results, action);
+    }
+    if (!_collect_stats) {
+        return action->_params._action_fn(input, results, regex_offset);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool ok = action->_params._action_fn(input, results, regex_offset);
+    _action_ns += get_elapsed_ns(start);
+    return ok;
+}
+
+/*
+ * Run through all the candidate regex's for a potential match and perform appropriate
+ *  actions on actual matches.
+ * Params:
+ *  input: Entire string being processed
+ *  window: hash window that had the hit
+ *  static_string_hash: rolling hash value
+ *  static_string_offset: offset of start of static string in input
+ *  batch: where matches go in batch mode
+ * Returns:
+ *  true if all action functions that were run returned true
+ */
+bool FastRegexRules::perform_actions(ByteView input, const HashWindow *window, hashvaluetype static_string_hash, size_t static_string_offset, MatchBatch &batch) const
+{
+    const RegexAction *const *begin, *const *end;
+    window->_table.get_actions(static_string_hash, &begin, &end);
+    RegexResults results;
+
+    for (const RegexAction *const *it = begin; it != end; it++) {
+        const RegexAction* action = *it;
+
+        // Offset of start of regex in input
+        if (static_string_offset < (size_t)action->_offset) {
+            continue;
+        }
+        size_t regex_offset = static_string_offset - action->_offset;
+
+        // Run the full regex on the data, anchored at regex_offset. If it is a match then
+        //  perform the action function
+        if (verify_action(input, regex_offset, action, &results)) {
+            if (!run_action(input, &results, regex_offset, action, batch)) {
+                return false;
             }
         }
     }
-
     return true;
 }
 
+/*
+ * Does regex only match its largest static string?
+ */
+static bool is_plain_literal(const Regex *regex)
+{
+    const RegexLiteral *literal = get_largest_static_string(regex);
+    return literal && literal->_offset == 0 && literal->get_len() == regex->get_min_width() &&
+           regex->get_max_width() == regex->get_min_width();
+}
+
+/*
+ * Resolve FastRegexOptions::BACKEND_AUTO for regexes
+ */
+static FastRegexOptions::Backend choose_backend(FastRegexOptions::Backend backend, const vector<Regex *> &regexes, bool has_byte_map)
+{
+    if (backend != FastRegexOptions::BACKEND_AUTO) {
+        return backend;
+    }
+    // The literal matchers only find exact bytes
+    if (has_byte_map) {
+        return FastRegexOptions::BACKEND_ROLLING_HASH;
+    }
+    set<vector<byte> > literals;
+    for (vector<Regex *>::const_iterator it = regexes.begin(); it != regexes.end(); it++) {
+        if (!is_plain_literal(*it)) {
+            return FastRegexOptions::BACKEND_ROLLING_HASH;
+        }
+        literals.insert(get_largest_static_string(*it)->_bytes);
+    }
+    if ((int)literals.size() <= FastRegexOptions::AUTO_TEDDY_MAX_LITERALS) {
+        return FastRegexOptions::BACKEND_TEDDY;
+    }
+    if ((int)literals.size() <= FastRegexOptions::AUTO_AHO_CORASICK_MAX_LITERALS) {
+        return FastRegexOptions::BACKEND_AHO_CORASICK;
+    }
+    return FastRegexOptions::BACKEND_ROLLING_HASH;
+}
+
+/*
+ * Setup hash table and map of hash value to actions. Must only be called once.
+ *
+ * Static strings are bucketed by length and up to _max_hash_windows rolling hashes of
+ *  different lengths are used so that a few regexes with short static strings don't force
+ *  all the others onto a short, noisy hash.
+ */
+bool FastRegexRules::init(const vector<RegexActionParams *> &action_params_list, const FastRegexOptions &options)
+{
+    assert(_all_actions.empty());
+    if (options._wordsize < MIN_WORDSIZE || options._wordsize > MAX_WORDSIZE) {
+        cerr << "fastregex_init: wordsize must be in [" << MIN_WORDSIZE << ", " << MAX_WORDSIZE << "]" << endl;
+        return false;
+    }
+    if (options._max_hash_windows < 1 || options._max_hash_windows > MultiLaneScanner::MAX_WINDOWS) {
+        cerr << "fastregex_init: max_hash_windows must be in [1, " << MultiLaneScanner::MAX_WINDOWS << "]" << endl;
+        return false;
+    }
+    if (options._batch_fn && options._batch_size < 1) {
+        cerr << "fastregex_init: batch_size must be at least 1" << endl;
+        return false;
+    }
+    if (options._byte_map) {
+        for (int c = 0; c < 256; c++) {
+            if (options._byte_map[options._byte_map[c]] != options._byte_map[c]) {
+                cerr << "fastregex_init: byte_map must map each byte to a byte that maps to itself" << endl;
+                return false;
+            }
+        }
+        if (options._backend == FastRegexOptions::BACKEND_AHO_CORASICK || options._backend == FastRegexOptions::BACKEND_TEDDY) {
+            cerr << "fastregex_init: byte_map needs BACKEND_ROLLING_HASH" << endl;
+            return false;
+        }
+        _byte_map.assign(options._byte_map, options._byte_map + 256);
+    }
+    _wordsize = options._wordsize;
+    _max_hash_windows = options._max_hash_windows;
+    _use_bloom = options._filter_type == FastRegexOptions::FILTER_BLOOM ||
+                (options._filter_type == FastRegexOptions::FILTER_AUTO &&
+                 (int)action_params_list.size() >= FastRegexOptions::AUTO_BLOOM_MIN_PATTERNS);
+    _collect_stats = options._collect_stats;
+    _batch_fn = options._batch_fn;
+    _batch_context = options._batch_context;
+    _batch_size = (size_t)options._batch_size;
+
+    // Compile all the regexes
+    vector<Regex *> regexes;
+    vector<int> lens;
+    for (int i = 0; i < (int)action_params_list.size(); i++) {
+        Regex *regex = compile_regex(action_params_list[i]->_pattern, get_byte_map());
+        if (regex && get_static_string_len(regex) < MIN_HASH_LEN) {
+            cerr << "fastregex_init: static strings must be at least " << MIN_HASH_LEN << " bytes long" << endl;
+            delete regex;
+            regex = 0;
+        }
+        if (!regex) {
+            for (vector<Regex *>::iterator it = regexes.begin(); it != regexes.end(); it++) {
+                delete *it;
+            }
+            return false;
+        }
+        regexes.push_back(regex);
+        lens.push_back(get_preferred_len(regex, options._byte_model));
+    }
+    if (regexes.empty()) {
+        return true;
+    }
+
+    FastRegexOptions::Backend backend = choose_backend(options._backend, regexes, !_byte_map.empty());
+    if (backend == FastRegexOptions::BACKEND_AHO_CORASICK) {
+        _literal_matcher = new AhoCorasickMatcher;
+    } else if (backend == FastRegexOptions::BACKEND_TEDDY) {
+        _literal_matcher = new TeddyMatcher;
+    }
+    if (_literal_matcher) {
+        // The static strings are matched exactly
+        _use_bloom = false;
+    }
+
+    // Set up the hash windows
+    vector<int> hash_lens = choose_hash_lens(lens);
+    for (vector<int>::const_iterator it = hash_lens.begin(); it != hash_lens.end(); it++) {
+        _windows.push_back(new HashWindow(*it, _wordsize, get_byte_map()));
+    }
+
+    // Build the action maps
+    // Index of each distinct static string and window in _literal_matcher
+    map<pair<int, vector<byte> >, int> literal_indexes;
+    for (int i = 0; i < (int)action_params_list.size(); i++) {
+        StaticStringChoice choice = choose_static_string(regexes[i], lens[i], options._byte_model);
+        int w = choice._window;
+        HashWindow *window = _windows[w];
+        int hash_len = window->_hash->_n;
+        BinString static_string(hash_len, choice._bytes);
+        int offset = choice._offset;
+        hashvaluetype static_string_hash = window->_hash->hash(static_string.get_as_vector());
+        RegexAction *action = new RegexAction(*action_params_list[i], regexes[i], static_string, offset, static_string_hash, i);
+        window->_table.add(static_string_hash, action);
+        _all_actions.push_back(action);
+        if (_literal_matcher) {
+            pair<int, vector<byte> > key(w, static_string.get_as_vector());
+            if (literal_indexes.find(key) == literal_indexes.end()) {
+                literal_indexes[key] = (int)_literal_candidates.size();
+                _literal_matcher->add(static_string.get_data(), hash_len);
+                _literal_candidates.push_back(ScanCandidate(0, w, static_string_hash));
+            }
+        }
+        if (offset >  _max_lookahead) {
+             _max_lookahead = offset;
+        }
+        if (action->_span > _max_span) {
+            _max_span = action->_span;
+        }
+    }
+    for (vector<HashWindow *>::iterator it = _windows.begin(); it != _windows.end(); it++) {
+        (*it)->_table.build(_use_bloom);
+        _scanner.add_window(*(*it)->_hash, (*it)->_table.get_filter());
+    }
+    if (_literal_matcher) {
+        _literal_matcher->build();
+    }
+
+    return true;
+}
+
+FastRegexStats FastRegexRules::get_stats() const
+{
+    FastRegexStats stats;
+    stats._bytes_scanned = _bytes_scanned;
+    stats._filter_hits = _filter_hits;
+    stats._bloom_rejects = _bloom_rejects;
+    stats._static_string_rejects = _static_string_rejects;
+    stats._verify_time = (double)_verify_ns * 1.0e-9;
+    stats._action_time = (double)_action_ns * 1.0e-9;
+    for (vector<const RegexAction *>::const_iterator it = _all_actions.begin(); it != _all_actions.end(); it++) {
+        FastRegexPatternStats pattern;
+        pattern._num_verified = (*it)->_num_verified;
+        pattern._num_matched = (*it)->_num_matched;
+        stats._num_verified += pattern._num_verified;
+        stats._num_matched += pattern._num_matched;
+        stats._patterns.push_back(pattern);
+    }
+    return stats;
+}
+
+void FastRegexRules::reset_stats() const
+{
+    _bytes_scanned = 0;
+    _filter_hits = 0;
+    _bloom_rejects = 0;
+    _static_string_rejects = 0;
+    _verify_ns = 0;
+    _action_ns = 0;
+    for (vector<const RegexAction *>::const_iterator it = _all_actions.begin(); it != _all_actions.end(); it++) {
+        (*it)->_num_verified = 0;
+        (*it)->_num_matched = 0;
+    }
+}
+
+struct CaseFoldMap
+{
+    byte _map[256];
+
+    CaseFoldMap()
+    {
+        for (int c = 0; c < 256; c++) {
+            _map[c] = (byte)(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        }
+    }
+};
+
+const byte *fastregex_get_case_fold_map()
+{
+    static const CaseFoldMap case_fold_map;
+    return case_fold_map._map;
+}
+
+/*
+ * Action function used while tuning so that running the sample has no side effects
+ */
+static bool tune_action(ByteView, const RegexResults *, size_t)
+{
+    return true;
+}
+
+// Wordsizes tried by fastregex_tune()
+static const int MIN_TUNE_WORDSIZE = 14;
+static const int MAX_TUNE_WORDSIZE = 24;
+
+// Number of times fastregex_tune() runs each setting. The fastest scan is used
+static const int NUM_TUNE_RUNS = 2;
+
+// A setting with a bigger filter or more windows must be estimated to be at least this
+//  fraction faster than the best smaller one to be chosen, so that timing noise does not
+//  pick a setting that uses more cache for nothing
+static const double TUNE_MIN_GAIN = 0.05;
+
+/*
+ * One setting tried by FastRegex::tune()
+ */
+struct TuneTrial
+{
+    int _wordsize;
+    int _max_hash_windows;
+    // Seconds spent outside the regexes and action functions in the fastest run
+    double _scan_time;
+    // Counters of the last run. They are the same for every run
+    FastRegexStats _stats;
+};
+
+/*
+ * Pick the wordsize and number of hash windows by running every combination over sample
+ *  with _collect_stats set. The cost of a setting is the time spent rolling the hashes and
+ *  checking the filters plus the regex runs it needs times the average cost of a regex run.
+ *  The regex runs are counted rather than timed per setting and their cost is averaged over
+ *  all the settings, so only the scan time is subject to timing noise, and a setting only
+ *  beats a smaller one by a clear margin.
+ */
+bool FastRegex::tune(const vector<RegexActionParams *> &action_params_list, ByteView sample, FastRegexOptions &options)
+{
+    vector<RegexActionParams> tune_params;
+    tune_params.reserve(action_params_list.size());
+    for (vector<RegexActionParams *>::const_iterator it = action_params_list.begin(); it != action_params_list.end(); it++) {
+        RegexActionParams params = { (*it)->_pattern, tune_action };
+        tune_params.push_back(params);
+    }
+    vector<RegexActionParams *> tune_params_list;
+    for (vector<RegexActionParams>::iterator it = tune_params.begin(); it != tune_params.end(); it++) {
+        tune_params_list.push_back(&*it);
+    }
+
+    FastRegexOptions trial_options = options;
+    trial_options._collect_stats = true;
+    trial_options._batch_fn = 0;
+    trial_options._batch_context = 0;
+
+    vector<TuneTrial> trials;
+    long long total_verified = 0;
+    double total_verify_time = 0.0;
+    // The literal backends do not use the wordsize or the hash windows so one trial will do
+    bool literal = false;
+    for (int max_hash_windows = 1; max_hash_windows <= FastRegexOptions::DEFAULT_MAX_HASH_WINDOWS && !literal; max_hash_windows++) {
+        for (int wordsize = MIN_TUNE_WORDSIZE; wordsize <= MAX_TUNE_WORDSIZE && !literal; wordsize++) {
+            trial_options._wordsize = wordsize;
+            trial_options._max_hash_windows = max_hash_windows;
+            FastRegex engine;
+            if (!engine.init(tune_params_list, trial_options)) {
+                cerr << "fastregex_tune: the patterns could not be set up with wordsize " << wordsize
+                     << " and " << max_hash_windows << " hash windows" << endl;
+                return false;
+            }
+            TuneTrial trial = { wordsize, max_hash_windows, -1.0, FastRegexStats() };
+            for (int run = 0; run < NUM_TUNE_RUNS; run++) {
+                engine.reset_stats();
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                engine.process(sample);
+                double run_time = (double)get_elapsed_ns(start) * 1.0e-9;
+                trial._stats = engine.get_stats();
+                double scan_time = run_time - trial._stats._verify_time - trial._stats._action_time;
+                scan_time = scan_time > 0.0 ? scan_time : 0.0;
+                if (trial._scan_time < 0.0 || scan_time < trial._scan_time) {
+                    trial._scan_time = scan_time;
+                }
+                total_verified += trial._stats._num_verified;
+                total_verify_time += trial._stats._verify_time;
+            }
+            trials.push_back(trial);
+            literal = strcmp(engine.get_backend_name(), "rolling-hash") != 0;
+        }
+    }
+
+    double verify_cost = total_verified > 0 ? total_verify_time / (double)total_verified : 0.0;
+    const TuneTrial *best = 0;
+    double best_cost = 0.0;
+    for (vector<TuneTrial>::const_iterator it = trials.begin(); it != trials.end(); it++) {
+        double cost = it->_scan_time + verify_cost * (double)it->_stats._num_verified;
+        if (!best || cost < best_cost * (1.0 - TUNE_MIN_GAIN)) {
+            best = &*it;
+            best_cost = cost;
+        }
+    }
+    options._wordsize = best->_wordsize;
+    options._max_hash_windows = best->_max_hash_windows;
+    return true;
+}
+
+/*
+ * Actions waiting to be run by fastregex_process_in_order(), keyed by the offset of the 
+ *  start of the regex they will be applied at.
+ *
+ * The rolling hash runs up to _max_lookahead bytes ahead of the offset being acted on. A hit
+ *  at static string offset k queues its actions at k - RegexAction::_offset which is never 
+ *  more than _max_lookahead behind k. So by the time the rolling hash has passed 
+ *  offset + _max_lookahead every action for offset is queued and they can be run.
+ */
+class PendingActions
+{
+    const FastRegexRules &_rules;
+    MatchBatch &_batch;
+    // _slots[offset & _mask] are the actions queued for offset 
+    vector<vector<const RegexAction *> > _slots;
+    const size_t _mask;
+    // Offsets with queued actions
+    LookAheadBuffer _pending;
+    // Next offset to act on
+    size_t _next;
+
+    static size_t get_num_slots(int max_lookahead)
+    {
+        size_t n = 1;
+        while (n < (size_t)max_lookahead + 1) {
+            n <<= 1;
+        }
+        return n;
+    }
+
+    static bool compare_index(const RegexAction *a, const RegexAction *b)
+    {
+        return a->_index < b->_index;
+    }
+
+public:
+    PendingActions(const FastRegexRules &rules, MatchBatch &batch) :
+        _rules(rules),
+        _batch(batch),
+        _slots(get_num_slots(rules.get_max_lookahead())),
+        _mask(get_num_slots(rules.get_max_lookahead()) - 1),
+        _pending(rules.get_max_lookahead()),
+        _next(0)
+    {}
+
+    void push(size_t offset, const RegexAction *action)
+    {
+        _slots[offset & _mask].push_back(action);
+        _pending.push(offset);
+    }
+
+    /*
+     * Run the queued actions for all offsets before end in order of offset, and in the order
+     *  the regexes were passed to fastregex_init() for each offset
+     * Returns: false if an action function returned false
+     */
+    bool run_until(ByteView input, size_t end)
+    {
+        RegexResults results;
+        for (; _next < end; _next++) {
+            if (_pending.empty()) {
+                _next = end;
+                break;
+            }
+            if (!_pending.contains(_next)) {
+                continue;
+            }
+            vector<const RegexAction *> &slot = _slots[_next & _mask];
+            stable_sort(slot.begin(), slot.end(), compare_index);
+            for (vector<const RegexAction *>::const_iterator it = slot.begin(); it != slot.end(); it++) {
+                if (_rules.verify_action(input, _next, *it, &results) && !_rules.run_action(input, &results, _next, *it, _batch)) {
+                    return false;
+                }
+            }
+            slot.clear();
+            _pending.remove(_next);
+        }
+        return true;
+    }
+};
+
+/*
+ * Process some data using fast regex's
+ * 
+ * Run through the data and compute a rolling hash for each byte
+ *  If the rolling hash shows a potential match then call perform_actions()
+ *      on the rolling hash value to find exact regex matches and run 
+ *      appropriate functions on those exact matches.
+ */
+bool FastRegexRules::process(ByteView input) const
+{
+    const byte *data = input.get_data();
+    size_t numchars = input.get_len();
+    vector<ScanCandidate> candidates;
+    MatchBatch batch(*this);
+
+    // Find the hash hits a block at a time and act on them
+    for (size_t begin = 0; begin < numchars; begin += SCAN_BLOCK_SIZE) {
+        size_t end = begin + SCAN_BLOCK_SIZE < numchars ? begin + SCAN_BLOCK_SIZE : numchars;
+        candidates.clear();
+        scan_block(data, numchars, begin, end, candidates);
+        for (vector<ScanCandidate>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+            if (!perform_actions(input, _windows[it->_window], it->_hash, it->_offset, batch)) {
+                return false;
+            }
+        }
+    }
+
+    return batch.flush();
+}
+
+/*
+ * Like process() but only for the matches that start in [begin, end) of input. The rolling
+ *  hash runs on to end + _max_lookahead so that matches whose static string is after end are
+ *  found, and the regexes can match past end. Several threads can process disjoint ranges of
+ *  the same input to get the same matches as process()
+ */
+bool FastRegexRules::process_range(ByteView input, size_t begin, size_t end, long long *num_matches) const
+{
+    const byte *data = input.get_data();
+    size_t numchars = input.get_len();
+    size_t scan_end = end + (size_t)_max_lookahead < numchars ? end + (size_t)_max_lookahead : numchars;
+    vector<ScanCandidate> candidates;
+    MatchBatch batch(*this);
+    RegexResults results;
+    long long matches = 0;
+    bool ok = true;
+
+    for (size_t block = begin; block < scan_end && ok; block += SCAN_BLOCK_SIZE) {
+        size_t block_end = block + SCAN_BLOCK_SIZE < scan_end ? block + SCAN_BLOCK_SIZE : scan_end;
+        candidates.clear();
+        scan_block(data, numchars, block, block_end, candidates);
+        for (vector<ScanCandidate>::const_iterator it = candidates.begin(); it != candidates.end() && ok; it++) {
+            const RegexAction *const *abegin, *const *aend;
+            _windows[it->_window]->_table.get_actions(it->_hash, &abegin, &aend);
+            for (const RegexAction *const *at = abegin; at != aend; at++) {
+                if (it->_offset < (size_t)(*at)->_offset) {
+                    continue;
+                }
+                size_t regex_offset = it->_offset - (*at)->_offset;
+                if (regex_offset < begin || regex_offset >= end) {
+                    continue;
+                }
+                if (verify_action(input, regex_offset, *at, &results)) {
+                    matches++;
+                    if (!run_action(input, &results, regex_offset, *at, batch)) {
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (num_matches) {
+        *num_matches = matches;
+    }
+    return ok && batch.flush();
+}
+
+/*
+ * Process some data using fast regex's.
+ *
+ * Like fastregex_process() except that it guarantees the order of processing is the 
+ *  same as if the regex's where performed sequentially on every byte on the input data.
+ *
+ * This is achieved by running the rolling hash _max_lookahead bytes ahead of the offset
+ *  being acted on and queueing the actions for each hit in PendingActions until the 
+ *  offset they apply at is reached.
+ */
+bool FastRegexRules::process_in_order(ByteView input) const
+{
+    const byte *data = input.get_data();
+    size_t numchars = input.get_len();
+    vector<ScanCandidate> candidates;
+    MatchBatch batch(*this);
+    PendingActions pending(*this, batch);
+
+    for (size_t begin = 0; begin < numchars; begin += SCAN_BLOCK_SIZE) {
+        size_t end = begin + SCAN_BLOCK_SIZE < numchars ? begin + SCAN_BLOCK_SIZE : numchars;
+        candidates.clear();
+        scan_block(data, numchars, begin, end, candidates);
+        for (vector<ScanCandidate>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+            // Every action for the offsets more than _max_lookahead behind this hit is queued
+            if (it->_offset > (size_t)_max_lookahead && !pending.run_until(input, it->_offset - _max_lookahead)) {
+                return false;
+            }
+            const RegexAction *const *abegin, *const *aend;
+            _windows[it->_window]->_table.get_actions(it->_hash, &abegin, &aend);
+            for (const RegexAction *const *at = abegin; at != aend; at++) {
+                if (it->_offset >= (size_t)(*at)->_offset) {
+                    pending.push(it->_offset - (*at)->_offset, *at);
+                }
+            }
+        }
+    }
+
+    return pending.run_until(input, numchars) && batch.flush();
+}
+
+/*
+ * The pipeline for fastregex_process_pipelined()
+ *
+ *  scan thread     -> ScanCandidate ->  verify thread  -> VerifiedMatch -> calling thread
+ *  (rolling hash)                      (regex evaluator)                  (action functions)
+ *
+ * Each stage sends an end marker when it is done. Any stage can stop the pipeline by 
+ *  setting _stop.
+ */
+
+// Number of items in each of the rings between pipeline stages
+static const size_t PIPELINE_RING_SIZE = 1 << 12;
+
+// A regex match waiting for its action function to be run
+struct VerifiedMatch
+{
+    const RegexAction *_action;
+    size_t _regex_offset;
+    RegexResults _results;
+};
+
+class Pipeline
+{
+    const FastRegexRules &_rules;
+    const ByteView _input;
+    SpscRing<ScanCandidate> _candidates;
+    SpscRing<VerifiedMatch> _matches;
+    atomic<bool> _stop;
+
+    // Marks the end of the candidates
+    static ScanCandidate end_candidate() { return ScanCandidate(0, -1, 0); }
+
+    void scan()
+    {
+        const byte *data = _input.get_data();
+        size_t numchars = _input.get_len();
+        vector<ScanCandidate> candidates;
+        for (size_t begin = 0; begin < numchars; begin += SCAN_BLOCK_SIZE) {
+            size_t end = begin + SCAN_BLOCK_SIZE < numchars ? begin + SCAN_BLOCK_SIZE : numchars;
+            candidates.clear();
+            _rules.scan_block(data, numchars, begin, end, candidates);
+            for (vector<ScanCandidate>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+                if (!_candidates.push(*it, &_stop)) {
+                    return;
+                }
+            }
+        }
+        _candidates.push(end_candidate(), &_stop);
+    }
+
+    void verify()
+    {
+        ScanCandidate candidate;
+        VerifiedMatch match;
+        while (_candidates.pop(candidate, &_stop) && candidate._window >= 0) {
+            const RegexAction *const *begin, *const *end;
+            _rules.get_window(candidate._window)->_table.get_actions(candidate._hash, &begin, &end);
+            for (const RegexAction *const *it = begin; it != end; it++) {
+                if (candidate._offset < (size_t)(*it)->_offset) {
+                    continue;
+                }
+                match._action = *it;
+                match._regex_offset = candidate._offset - (*it)->_offset;
+                if (_rules.verify_action(_input, match._regex_offset, match._action, &match._results) && !_matches.push(match, &_stop)) {
+                    return;
+                }
+            }
+        }
+        match._action = 0;
+        _matches.push(match, &_stop);
+    }
+
+    static void scan_thread(Pipeline *pipeline)   { pipeline->scan(); }
+    static void verify_thread(Pipeline *pipeline) { pipeline->verify(); }
+
+public:
+    Pipeline(const FastRegexRules &rules, ByteView input) : 
+        _rules(rules),
+        _input(input),
+        _candidates(PIPELINE_RING_SIZE),
+        _matches(PIPELINE_RING_SIZE),
+        _stop(false)
+    {}
+
+    bool run()
+    {
+        thread scanner(scan_thread, this);
+        thread verifier(verify_thread, this);
+
+        bool ok = true;
+        VerifiedMatch match;
+        MatchBatch batch(_rules);
+        while (_matches.pop(match, &_stop) && match._action) {
+            if (!_rules.run_action(_input, &match._results, match._regex_offset, match._action, batch)) {
+                ok = false;
+                break;
+            }
+        }
+
+        // Shut down the other stages if we stopped early
+        _stop = true;
+        scanner.join();
+        verifier.join();
+        return ok && batch.flush();
+    }
+};
+
+bool FastRegexRules::process_pipelined(ByteView input) const
+{
+    Pipeline pipeline(*this, input);
+    return pipeline.run();
+}
+
+/*
+ * Parallel scanning for fastregex_process_parallel()
+ *
+ * The input is split into chunks by the offset of the start of the regex matches. Each worker
+ *  thread takes the next unscanned chunk, finds all the matches that start in it and sorts 
+ *  them. The calling thread is the sequencer: it waits for the chunks in order and runs the 
+ *  action functions on their matches.
+ *
+ * A match that starts in a chunk can have its static string up to _max_lookahead bytes after
+ *  the end of the chunk so the chunks are scanned with that much overlap. Matches found in 
+ *  the overlap that start in the next chunk are dropped as the next chunk's worker will find
+ *  them too.
+ */
+
+// Smallest chunk worth handing to a worker
+static const size_t MIN_PARALLEL_CHUNK = 1 << 20;
+
+// Number of chunks per thread. More chunks balance the load better and let the sequencer 
+//  start sooner
+static const int PARALLEL_CHUNKS_PER_THREAD = 4;
+
+/*
+ * Order that fastregex_process_in_order() runs actions in
+ */
+static bool compare_match_order(const VerifiedMatch &a, const VerifiedMatch &b)
+{
+    if (a._regex_offset != b._regex_offset) {
+        return a._regex_offset < b._regex_offset;
+    }
+    return a._action->_index < b._action->_index;
+}
+
+class ParallelScan
+{
+    struct Chunk
+    {
+        size_t _begin, _end;
+        vector<VerifiedMatch> _matches;
+        bool _done;
+    };
+
+    const FastRegexRules &_rules;
+    const ByteView _input;
+    vector<Chunk> _chunks;
+    // Next chunk for a worker to take
+    atomic<size_t> _next_chunk;
+    atomic<bool> _stop;
+    // Protects Chunk::_done
+    mutex _mutex;
+    condition_variable _chunk_done;
+
+    void scan_chunk(Chunk &chunk)
+    {
+        const byte *data = _input.get_data();
+        size_t numchars = _input.get_len();
+        size_t max_lookahead = (size_t)_rules.get_max_lookahead();
+        size_t overlap_end = chunk._end + max_lookahead < numchars ? chunk._end + max_lookahead : numchars;
+        vector<ScanCandidate> candidates;
+        VerifiedMatch match;
+
+        for (size_t begin = chunk._begin; begin < overlap_end && !_stop; begin += SCAN_BLOCK_SIZE) {
+            size_t end = begin + SCAN_BLOCK_SIZE < overlap_end ? begin + SCAN_BLOCK_SIZE : overlap_end;
+            candidates.clear();
+            _rules.scan_block(data, numchars, begin, end, candidates);
+            for (vector<ScanCandidate>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+                const RegexAction *const *abegin, *const *aend;
+                _rules.get_window(it->_window)->_table.get_actions(it->_hash, &abegin, &aend);
+                for (const RegexAction *const *at = abegin; at != aend; at++) {
+                    if (it->_offset < (size_t)(*at)->_offset) {
+                        continue;
+                    }
+                    match._action = *at;
+                    match._regex_offset = it->_offset - (*at)->_offset;
+                    // Matches that start outside the chunk belong to another chunk
+                    if (match._regex_offset < chunk._begin || match._regex_offset >= chunk._end) {
+                        continue;
+                    }
+                    if (_rules.verify_action(_input, match._regex_offset, match._action, &match._results)) {
+                        chunk._matches.push_back(match);
+                    }
+                }
+            }
+        }
+        stable_sort(chunk._matches.begin(), chunk._matches.end(), compare_match_order);
+    }
+
+    void work()
+    {
+        for (size_t i = _next_chunk++; i < _chunks.size() && !_stop; i = _next_chunk++) {
+            scan_chunk(_chunks[i]);
+            lock_guard<mutex> lock(_mutex);
+            _chunks[i]._done = true;
+            _chunk_done.notify_one();
+        }
+    }
+
+    static void work_thread(ParallelScan *scan) { scan->work(); }
+
+public:
+    ParallelScan(const FastRegexRules &rules, ByteView input, int num_threads) : 
+        _rules(rules),
+        _input(input),
+        _next_chunk(0),
+        _stop(false)
+    {
+        size_t numchars = input.get_len();
+        size_t chunk_size = numchars / (num_threads * PARALLEL_CHUNKS_PER_THREAD) + 1;
+        if (chunk_size < MIN_PARALLEL_CHUNK) {
+            chunk_size = MIN_PARALLEL_CHUNK;
+        }
+        for (size_t begin = 0; begin < numchars; begin += chunk_size) {
+            Chunk chunk;
+            chunk._begin = begin;
+            chunk._end = begin + chunk_size < numchars ? begin + chunk_size : numchars;
+            chunk._done = false;
+            _chunks.push_back(chunk);
+        }
+    }
+
+    bool run(int num_threads)
+    {
+        vector<thread> workers;
+        for (int i = 0; i < num_threads && i < (int)_chunks.size(); i++) {
+            workers.push_back(thread(work_thread, this));
+        }
+
+        bool ok = true;
+        MatchBatch batch(_rules);
+        for (size_t i = 0; i < _chunks.size() && ok; i++) {
+            Chunk &chunk = _chunks[i];
+            {
+                unique_lock<mutex> lock(_mutex);
+                while (!chunk._done) {
+                    _chunk_done.wait(lock);
+                }
+            }
+            for (vector<VerifiedMatch>::const_iterator it = chunk._matches.begin(); it != chunk._matches.end(); it++) {
+                if (!_rules.run_action(_input, &it->_results, it->_regex_offset, it->_action, batch)) {
+                    ok = false;
+                    break;
+                }
+            }
+            // Free the memory as we go
+            vector<VerifiedMatch>().swap(chunk._matches);
+        }
+
+        _stop = true;
+        for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++) {
+            it->join();
+        }
+        return ok && batch.flush();
+    }
+};
+
+bool FastRegexRules::process_parallel(ByteView input, int num_threads) const
+{
+    ParallelScan scan(*this, input, num_threads);
+    return scan.run(num_threads);
+}
+
+/*
+ * A regex that must be verified at a stream offset once enough of the stream has arrived
+ */
+struct PendingMatch
+{
+    long long _regex_offset;
+    const RegexAction *_action;
+
+    PendingMatch(long long regex_offset, const RegexAction *action) : _regex_offset(regex_offset), _action(action) {}
+};
+
+/*
+ * State carried between the chunks of a stream.
+ *
+ * Stream offsets are 64 bit. The current chunk covers [_base, _end) of the stream.
+ *  _tail holds the bytes of the stream just before _base. This is enough to hash static 
+ *      strings that straddle _base and to verify matches that start before it
+ *  _stitch is _tail followed by the start of the current chunk. It is only built when 
+ *      something straddles _base
+ *  _pending are regexes that start near the end of the stream so far and can't be verified
+ *      until more of the stream arrives
+ */
+class FastRegexStream
+{
+    const FastRegexRules &_rules;
+    long long _base, _end;
+    const byte *_chunk;
+    vector<byte> _tail;
+    vector<byte> _stitch;
+    vector<PendingMatch> _pending;
+    // Matches waiting for _batch_fn in batch mode
+    MatchBatch _batch;
+
+    long long get_tail_start() const { return _base - (long long)_tail.size(); }
+
+    /*
+     * Build _stitch if it has not been built for this chunk
+     */
+    void make_stitch()
+    {
+        if (!_stitch.empty()) {
+            return;
+        }
+        long long max_ahead = _rules.get_max_span() + _rules.get_max_n();
+        long long ahead = _end - _base < max_ahead ? _end - _base : max_ahead;
+        _stitch.reserve(_tail.size() + (size_t)ahead);
+        _stitch.insert(_stitch.end(), _tail.begin(), _tail.end());
+        _stitch.insert(_stitch.end(), _chunk, _chunk + ahead);
+    }
+
+    /*
+     * Verify a regex at stream offset regex_offset and perform its action if it matches
+     */
+    bool verify(long long regex_offset, const RegexAction *action)
+    {
+        long long match_end = regex_offset + action->_span < _end ? regex_offset + action->_span : _end;
+        const byte *data;
+        if (regex_offset >= _base) {
+            data = _chunk + (regex_offset - _base);
+        } else {
+            make_stitch();
+            assert(regex_offset >= get_tail_start());
+            assert(match_end <= get_tail_start() + (long long)_stitch.size());
+            data = &_stitch[0] + (regex_offset - get_tail_start());
+        }
+
+        ByteView input(data, (size_t)(match_end - regex_offset));
+        RegexResults results;
+        if (_rules.verify_action(input, 0, action, &results)) {
+            results._stream_offset = regex_offset;
+            // The batch is delivered per chunk and the matches can be anywhere in the tail
+            //  or the chunk, so they are reported by stream offset only
+            bool ok = _rules.is_batch_mode() ? _batch.add(ByteView(), &results, action) : _rules.run_action(input, &results, 0, action, _batch);
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Verify all the regexes for a filter hit at stream offset static_string_offset, or 
+     *  defer them if the stream does not yet hold their longest possible match
+     */
+    bool perform_actions(const HashWindow *window, hashvaluetype static_string_hash, long long static_string_offset, bool at_end)
+    {
+        const RegexAction *const *begin, *const *end;
+        window->_table.get_actions(static_string_hash, &begin, &end);
+
+        for (const RegexAction *const *it = begin; it != end; it++) {
+            long long regex_offset = static_string_offset - (*it)->_offset;
+            if (regex_offset < 0) {
+                continue;
+            }
+            if (!at_end && regex_offset + (*it)->_span > _end) {
+                _pending.push_back(PendingMatch(regex_offset, *it));
+            } else if (!verify(regex_offset, *it)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Verify the pending matches that now can be
+     */
+    bool process_pending(bool at_end)
+    {
+        vector<PendingMatch> pending;
+        pending.swap(_pending);
+        for (vector<PendingMatch>::const_iterator it = pending.begin(); it != pending.end(); it++) {
+            if (!at_end && it->_regex_offset + it->_action->_span > _end) {
+                _pending.push_back(*it);
+            } else if (!verify(it->_regex_offset, it->_action)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Scan the static strings that start in the tail and end in the current chunk. Those 
+     *  that ended in the tail were scanned with the previous chunk.
+     */
+    bool scan_boundary()
+    {
+        int max_n = _rules.get_max_n();
+        if (_tail.empty() || max_n <= 1) {
+            return true;
+        }
+        make_stitch();
+        long long first = _base - (max_n - 1) > get_tail_start() ? _base - (max_n - 1) : get_tail_start();
+        vector<ScanCandidate> candidates;
+        _rules.scan_block(&_stitch[0], _stitch.size(), (size_t)(first - get_tail_start()), _tail.size(), candidates);
+        for (vector<ScanCandidate>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+            long long offset = get_tail_start() + (long long)it->_offset;
+            if (offset + _rules.get_window(it->_window)->_hash->_n <= _base) {
+                continue;
+            }
+            if (!perform_actions(_rules.get_window(it->_window), it->_hash, offset, false)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Keep the last bytes of the stream so far in _tail
+     */
+    void update_tail()
+    {
+        int max_span = _rules.get_max_span();
+        int max_ahead = _rules.get_max_n() + _rules.get_max_lookahead();
+        size_t keep = (size_t)(max_span > max_ahead ? max_span : max_ahead);
+        size_t len = (size_t)(_end - _base);
+        if (len >= keep) {
+            _tail.assign(_chunk + len - keep, _chunk + len);
+        } else {
+            size_t old_keep = keep - len < _tail.size() ? keep - len : _tail.size();
+            _tail.erase(_tail.begin(), _tail.end() - old_keep);
+            _tail.insert(_tail.end(), _chunk, _chunk + len);
+        }
+    }
+
+public:
+    FastRegexStream(const FastRegexRules &rules) : _rules(rules), _base(0), _end(0), _chunk(0), _batch(rules) {}
+
+    bool feed(ByteView chunk)
+    {
+        const byte *data = chunk.get_data();
+        size_t len = chunk.get_len();
+        _chunk = data;
+        _end = _base + len;
+        _stitch.clear();
+
+        if (!process_pending(false) || !scan_boundary()) {
+            return false;
+        }
+
+        // Find the hash hits in the chunk a block at a time and act on them
+        vector<ScanCandidate> candidates;
+        for (size_t begin = 0; begin < len; begin += SCAN_BLOCK_SIZE) {
+            size_t end = begin + SCAN_BLOCK_SIZE < len ? begin + SCAN_BLOCK_SIZE : len;
+            candidates.clear();
+            _rules.scan_block(data, len, begin, end, candidates);
+            for (vector<ScanCandidate>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+                if (!perform_actions(_rules.get_window(it->_window), it->_hash, _base + (long long)it->_offset, false)) {
+                    return false;
+                }
+            }
+        }
+
+        update_tail();
+        _base = _end;
+        _chunk = 0;
+        return _batch.flush();
+    }
+
+    bool finish()
+    {
+        // Verify the remaining matches against the tail
+        _chunk = 0;
+        _stitch.clear();
+        _base = _end;
+        return process_pending(true) && _batch.flush();
+    }
+};
+
+/*
+ * FastRegex engines. _rules is never null: an engine that has not been initialized, or
+ *  whose init() failed, has empty rules that match nothing
+ */
+FastRegex::FastRegex() : _rules(new FastRegexRules())
+{
+}
+
+FastRegex::~FastRegex()
+{
+    delete _rules;
+}
+
+bool FastRegex::init(const vector<RegexActionParams *> &action_params_list, const FastRegexOptions &options)
+{
+    term();
+    if (!_rules->init(action_params_list, options)) {
+        term();
+        return false;
+    }
+    return true;
+}
+
+void FastRegex::term()
+{
+    delete _rules;
+    _rules = new FastRegexRules();
+}
+
+bool FastRegex::process(ByteView input) const
+{
+    return _rules->process(input);
+}
+
+bool FastRegex::process_range(ByteView input, size_t begin, size_t end, long long *num_matches) const
+{
+    return _rules->process_range(input, begin, end, num_matches);
+}
+
+bool FastRegex::process_in_order(ByteView input) const
+{
+    return _rules->process_in_order(input);
+}
+
+bool FastRegex::process_pipelined(ByteView input) const
+{
+    return _rules->process_pipelined(input);
+}
+
+bool FastRegex::process_parallel(ByteView input, int num_threads) const
+{
+    if (num_threads <= 0) {
+        num_threads = (int)thread::hardware_concurrency();
+        if (num_threads <= 0) {
+            num_threads = 1;
+        }
+    }
+    return _rules->process_parallel(input, num_threads);
+}
+
+bool FastRegex::process_file(const char *path) const
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    return process(file.get_view());
+}
+
+bool FastRegex::process_file_async(const char *path) const
+{
+    ReadAheadFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    FastRegexStream stream(*_rules);
+    bool ok = true;
+    ByteView chunk;
+    while (ok && file.next(&chunk)) {
+        ok = stream.feed(chunk);
+    }
+    if (!ok || file.failed()) {
+        return false;
+    }
+    return stream.finish();
+}
+
+FastRegexStream *FastRegex::begin_stream() const
+{
+    return new FastRegexStream(*_rules);
+}
+
+FastRegexStats FastRegex::get_stats() const
+{
+    return _rules->get_stats();
+}
+
+void FastRegex::reset_stats()
+{
+    _rules->reset_stats();
+}
+
+const char *FastRegex::get_backend_name() const
+{
+    return _rules->get_backend_name();
+}
+
+/*
+ * The engine behind the fastregex_*() functions
+ */
+static FastRegex _default_engine;
+
+bool fastregex_init(const vector<RegexActionParams *> action_params_list, const FastRegexOptions &options)
+{
+    return _default_engine.init(action_params_list, options);
+}
+
+void fastregex_term()
+{
+    _default_engine.term();
+}
+
+FastRegexStats fastregex_get_stats()
+{
+    return _default_engine.get_stats();
+}
+
+void fastregex_reset_stats()
+{
+    _default_engine.reset_stats();
+}
+
+const char *fastregex_get_backend_name()
+{
+    return _default_engine.get_backend_name();
+}
+
+bool fastregex_tune(const vector<RegexActionParams *> action_params_list, ByteView sample, FastRegexOptions &options)
+{
+    return FastRegex::tune(action_params_list, sample, options);
+}
+
+bool fastregex_process(ByteView input)
+{
+    return _default_engine.process(input);
+}
+
+bool fastregex_process_in_order(ByteView input)
+{
+    return _default_engine.process_in_order(input);
+}
+
+bool fastregex_process_pipelined(ByteView input)
+{
+    return _default_engine.process_pipelined(input);
+}
+
+bool fastregex_process_parallel(ByteView input, int num_threads)
+{
+    return _default_engine.process_parallel(input, num_threads);
+}
+
+bool fastregex_process_file(const char *path)
+{
+    return _default_engine.process_file(path);
+}
+
+bool fastregex_process_file_async(const char *path)
+{
+    return _default_engine.process_file_async(path);
+}
+
+FastRegexStream *fastregex_begin()
+{
+    return _default_engine.begin_stream();
+}
+
+bool fastregex_feed(FastRegexStream *stream, ByteView chunk)
+{
+    return stream->feed(chunk);
+}
+
+bool fastregex_finish(FastRegexStream *stream)
+{
+    bool ok = stream->finish();
+    delete stream;
+    return ok;
+}
@@ -17,51 +17,331 @@
  *
  */
 #include <vector>
-
-typedef unsigned char byte;
+#include "byteview.h"
 
 class Regex;
 class RegexResults;
+class FastRegexStream;
+class FastRegexRules;
+class ByteModel;
 
-// Binary data will be processed.
+// Binary data will be processed. 
+// BinString owns a copy of its data. It is used for patterns. Input is passed as ByteViews 
+//  so it is never copied.
 class BinString
 {
     const int _len;
     const byte *_data;
 public:
     BinString(int len, const byte *data);
+    BinString(const BinString &other);
     ~BinString()  { delete[] _data; }
     int get_len() const  { return _len; }
     const byte *get_data() const { return _data; }
     const std::vector<byte> get_as_vector() const;
+    ByteView get_view() const { return ByteView(_data, _len); }
+private:
+    BinString &operator=(const BinString &);
 };
 
 struct RegexActionParams
 {
-    // Regular expression pattern
+    // Regular expression pattern. See anchored_regex.h for the syntax.
+    //  Every pattern must contain a static string of at least 5 bytes at a
+    //  fixed offset from the start of the match
     BinString _pattern;
 
     /* 
-     * Action function that is called after a regex match. 
+     * Action function that is called after a regex match. Not used and may be 0 if 
+     *  FastRegexOptions::_batch_fn is set
      * Params
      *  input is the entire string being processes
      *  results are regex results, 
      *  offset is offset of the start of the regex match into input.
      * Returns true on success.
      */
-    bool (*_action_fn)(const BinString input, const RegexResults *results, int offset);
+    bool (*_action_fn)(ByteView input, const RegexResults *results, size_t offset);
+};
+
+/*
+ * A match passed to a FastRegexBatchFn
+ */
+struct FastRegexMatch
+{
+    // Offset of the start of the match in the input, or in the stream for fastregex_feed()
+    long long _offset;
+    // Length of the match
+    size_t _len;
+    // Index of the pattern in the list passed to fastregex_init()
+    int _pattern;
+};
+
+/*
+ * Batch action function. See FastRegexOptions::_batch_fn
+ * Params
+ *  input is the entire string being processed. It is empty for streams as the matches can
+ *      straddle the chunks fed
+ *  matches are the matches in the order the action functions would have been called
+ *  num_matches is the number of matches. At least 1
+ *  context is FastRegexOptions::_batch_context
+ * Returns true on success.
+ */
+typedef bool (*FastRegexBatchFn)(ByteView input, const FastRegexMatch *matches, size_t num_matches, void *context);
+
+/*
+ * Settings for fastregex_init(). The defaults suit ~100 regexes. Use fastregex_tune() to
+ *  find better ones for a particular corpus.
+ */
+struct FastRegexOptions
+{
+    enum { DEFAULT_WORDSIZE = 19 };
+    enum { DEFAULT_MAX_HASH_WINDOWS = 4 };
+    enum { DEFAULT_BATCH_SIZE = 256 };
+
+    // How filter hits are checked before the regexes are run
+    enum FilterType 
+    {
+        // FILTER_BLOOM if there are at least AUTO_BLOOM_MIN_PATTERNS regexes, else FILTER_DIRECT
+        FILTER_AUTO,
+        // Only the 1 bit per hash value filter. Fastest for small rule sets
+        FILTER_DIRECT,
+        // Also check a Bloom filter of 64 bit fingerprints of the static strings. For large 
+        //  rule sets where the 1 bit per hash value filter is too full to reject much
+        FILTER_BLOOM
+    };
+    enum { AUTO_BLOOM_MIN_PATTERNS = 1000 };
+
+    // What finds the offsets where the regexes' static strings are
+    enum Backend
+    {
+        // A literal matcher if every regex is a plain literal string and there are not too 
+        //  many of them, else BACKEND_ROLLING_HASH
+        BACKEND_AUTO,
+        // Rolling hashes and "needs action" filters. Works for any rule set
+        BACKEND_ROLLING_HASH,
+        // Exact matching with an Aho-Corasick DFA. For large literal sets
+        BACKEND_AHO_CORASICK,
+        // Exact matching with a SIMD nibble-shuffle filter. For small literal sets
+        BACKEND_TEDDY
+    };
+    // BACKEND_AUTO uses BACKEND_TEDDY for literal sets with up to AUTO_TEDDY_MAX_LITERALS 
+    //  distinct static strings and BACKEND_AHO_CORASICK for up to AUTO_AHO_CORASICK_MAX_LITERALS.
+    //  Beyond that the DFA no longer fits in cache and the rolling hash is faster. 
+    //  fastregex_bench shows where the crossovers are for a rule set
+    enum { AUTO_TEDDY_MAX_LITERALS = 16 };
+    enum { AUTO_AHO_CORASICK_MAX_LITERALS = 2000 };
+
+    // Number of bits in the rolling hash. The "needs action" filter is 2^_wordsize bits so
+    //  a bigger wordsize gives fewer false hits but uses more cache
+    int _wordsize;
+    // Maximum number of different hash lengths run over the input in the same pass
+    int _max_hash_windows;
+    // Collect the counters returned by fastregex_get_stats(). Off by default as timing
+    //  each verification and action costs a little
+    bool _collect_stats;
+    FilterType _filter_type;
+    // The literal backends find the static strings exactly so _filter_type is ignored with
+    //  them. They can be used with any rule set, not just literals, but the rolling hash is
+    //  usually faster for rule sets that are mostly regexes
+    Backend _backend;
+    // Batch mode. If _batch_fn is set then it is called instead of the patterns' action 
+    //  functions with the matches in batches of up to _batch_size, so the per-match cost is an
+    //  append to an array. A batch is also delivered at the end of each fastregex_process*() 
+    //  and fastregex_feed() call, so all the matches have been delivered when they return. 
+    //  Capture groups are not reported. If _batch_fn returns false then processing stops, 
+    //  which may be up to _batch_size matches after the one that made it decide to stop
+    FastRegexBatchFn _batch_fn;
+    void *_batch_context;
+    int _batch_size;
+    // Byte frequencies of the input (byte_model.h). If set each regex is hashed on the window
+    //  of its static strings that is rarest in the input, which gives fewer filter hits and 
+    //  regex runs than the first bytes of its longest static string. Only used during init
+    const ByteModel *_byte_model;
+    // Byte normalization map of 256 entries or 0. Bytes that map to the same byte hash the
+    //  same, so a case-insensitive pattern or a class like [Aa] that is exactly the bytes 
+    //  that map to one byte is found with one filter entry instead of one per variant. The
+    //  regexes still decide which variants match. Each byte must map to a byte that maps to
+    //  itself, e.g. fastregex_get_case_fold_map(). Needs the rolling hash backend
+    const byte *_byte_map;
+
+    FastRegexOptions() : 
+        _wordsize(DEFAULT_WORDSIZE), 
+        _max_hash_windows(DEFAULT_MAX_HASH_WINDOWS), 
+        _collect_stats(false),
+        _filter_type(FILTER_AUTO),
+        _backend(BACKEND_AUTO),
+        _batch_fn(0),
+        _batch_context(0),
+        _batch_size(DEFAULT_BATCH_SIZE),
+        _byte_model(0),
+        _byte_map(0)
+    {}
+};
+
+/*
+ * A FastRegexOptions::_byte_map that maps ASCII upper case letters to lower case and every 
+ *  other byte to itself. Use it with (?i) patterns
+ */
+const byte *fastregex_get_case_fold_map();
+
+/*
+ * Counters for one regex
+ */
+struct FastRegexPatternStats
+{
+    // Number of times the regex was run because its static string's hash was hit
+    long long _num_verified;
+    // Number of those that matched
+    long long _num_matched;
+
+    FastRegexPatternStats() : _num_verified(0), _num_matched(0) {}
+    long long get_num_false_positives() const { return _num_verified - _num_matched; }
+};
+
+/*
+ * Counters collected since fastregex_init() or fastregex_reset_stats() when 
+ *  FastRegexOptions::_collect_stats is set
+ */
+struct FastRegexStats
+{
+    // Number of input offsets run through the rolling hash
+    long long _bytes_scanned;
+    // Number of rolling hash values that were in the "needs action" filter, or static
+    //  strings found by a literal backend
+    long long _filter_hits;
+    // Number of those rejected by the Bloom filter (FastRegexOptions::FILTER_BLOOM)
+    long long _bloom_rejects;
+    // Number of regexes not run because their static string was not at the filter hit, i.e. 
+    //  hash collisions. These are not counted in _num_verified
+    long long _static_string_rejects;
+    // Totals of the FastRegexPatternStats
+    long long _num_verified;
+    long long _num_matched;
+    // Seconds spent running regexes and running action functions
+    double _verify_time;
+    double _action_time;
+    // Counters for each regex in the order they were passed to fastregex_init()
+    std::vector<FastRegexPatternStats> _patterns;
+
+    FastRegexStats() : 
+        _bytes_scanned(0), _filter_hits(0), _bloom_rejects(0), _static_string_rejects(0), _num_verified(0), _num_matched(0), 
+        _verify_time(0.0), _action_time(0.0) 
+    {}
+};
+
+/*
+ * A compiled set of regexes and the tables that scan for them.
+ *
+ * Each engine owns its rules so several rule sets can be used at once, e.g. one per tenant or
+ *  per file type. After init() the tables are only read, so any number of threads may call
+ *  the process*() functions and begin_stream() on the same engine at the same time. init(),
+ *  term() and reset_stats() must not run while the engine is in use, and streams must be
+ *  finished before the engine is re-initialized or destroyed.
+ *
+ * The process*() functions are the same as the fastregex_process*() functions below.
+ */
+class FastRegex
+{
+    FastRegexRules *_rules;
+
+    FastRegex(const FastRegex &);
+    FastRegex &operator=(const FastRegex &);
+
+public:
+    FastRegex();
+    ~FastRegex();
+
+    /*
+     * Compile action_params_list, replacing any rules from a previous init()
+     * Returns: false if any pattern is not a valid regex or has no usable static string, or 
+     *  the options are out of range. The engine then matches nothing
+     */
+    bool init(const std::vector<RegexActionParams *> &action_params_list, 
+              const FastRegexOptions &options = FastRegexOptions());
+    void term();
+
+    bool process(ByteView input) const;
+    bool process_in_order(ByteView input) const;
+    bool process_pipelined(ByteView input) const;
+    bool process_parallel(ByteView input, int num_threads = 0) const;
+    bool process_file(const char *path) const;
+    bool process_file_async(const char *path) const;
+
+    /*
+     * Process only the matches that start in [begin, end) of input. input is the whole 
+     *  buffer so that static strings and matches that run past end are found. Threads that
+     *  process disjoint ranges covering input together get the same matches as process(), 
+     *  in offset order within each range. This is how CorpusScanner (corpus_scan.h) splits
+     *  large files.
+     * Params:
+     *  num_matches: if not 0, set to the number of matches found
+     */
+    bool process_range(ByteView input, size_t begin, size_t end, long long *num_matches = 0) const;
+
+    /*
+     * Start a stream that uses this engine's rules. Pass it to fastregex_feed() and
+     *  fastregex_finish()
+     */
+    FastRegexStream *begin_stream() const;
+
+    /*
+     * Counters summed over all the threads that used this engine
+     */
+    FastRegexStats get_stats() const;
+    void reset_stats();
+    const char *get_backend_name() const;
+
+    /*
+     * See fastregex_tune()
+     */
+    static bool tune(const std::vector<RegexActionParams *> &action_params_list, ByteView sample, FastRegexOptions &options);
 };
 
+/*
+ * The fastregex_*() functions use a single engine for the whole program.
+ */
+
 /*
  * Initialize the fast regex module.
  * Setup hash table and map of hash value to actions.
+ * Returns: false if any pattern is not a valid regex or has no usable static string, or 
+ *  the options are out of range
  */
-bool fastregex_init(const std::vector<RegexActionParams *> action_params_list);
+bool fastregex_init(const std::vector<RegexActionParams *> action_params_list, 
+                    const FastRegexOptions &options = FastRegexOptions());
 /*
  * Destroy all the data allocated in fastregex_init()
  */
 void  fastregex_term();
 
+/*
+ * Return the counters collected so far. All zero unless FastRegexOptions::_collect_stats
+ *  was set
+ */
+FastRegexStats fastregex_get_stats();
+void fastregex_reset_stats();
+
+/*
+ * Return the name of the backend chosen by fastregex_init(), e.g. "rolling-hash"
+ */
+const char *fastregex_get_backend_name();
+
+/*
+ * Choose the wordsize and number of hash windows for action_params_list by trying a range of
+ *  them on a sample of the input. Each setting's cost is its scan time plus the number of
+ *  regex runs it needs, from the FastRegexStats counters, times the average time of a regex
+ *  run. The action functions and _batch_fn are not called.
+ * Params:
+ *  action_params_list: regexes that will be passed to fastregex_init()
+ *  sample: representative sample of the input, e.g. a few MB of a spool file
+ *  options: the options that will be passed to fastregex_init(). Its other settings, e.g.
+ *      _byte_map, _backend and _filter_type, are used while tuning. _wordsize and
+ *      _max_hash_windows are set to the best found
+ * Returns: false and writes a message to cerr if the patterns cannot be set up with options.
+ *  options is then unchanged
+ */
+bool fastregex_tune(const std::vector<RegexActionParams *> action_params_list, ByteView sample, FastRegexOptions &options);
+
 /*
  * Process some data using fast regex's
  * 
@@ -70,7 +350,7 @@ void  fastregex_term();
  *      on the rolling hash value to find exact regex matches and run 
  *      appropriate functions on those exact matches.
  */
-bool fastregex_process(const BinString input); 
+bool fastregex_process(ByteView input); 
 
 /*
  * Process some data using fast regex's.
@@ -87,4 +367,93 @@ bool fastregex_process(const BinString input);
  *      appropriate functions on those exact matches.
  */
 
-bool fastregex_process_in_order(const BinString input); 
\ No newline at end of file
+bool fastregex_process_in_order(ByteView input);
+
+/*
+ * Process some data using fast regex's in a pipeline.
+ *
+ * Like fastregex_process() except that the work is split into 3 stages that run on 
+ *  different threads
+ *      rolling hash -> regex evaluator -> action function
+ *  connected by lock-free ring buffers. The action functions are called on the calling 
+ *  thread, in the same order as fastregex_process(), so slow action functions do not stall 
+ *  the rolling hash. If a stage falls behind the stages before it wait for it.
+ */
+bool fastregex_process_pipelined(ByteView input);
+
+/*
+ * Process some data using fast regex's on several threads.
+ *
+ * The input is split into chunks that are scanned by num_threads worker threads. The action
+ *  functions are called on the calling thread in the same order as 
+ *  fastregex_process_in_order(): increasing offset of the start of the match and, for matches
+ *  that start at the same offset, the order the regex's were passed to fastregex_init().
+ * Params:
+ *  input: data to process
+ *  num_threads: number of worker threads. <= 0 means one per core
+ * Returns: false if an action function returned false
+ */
+bool fastregex_process_parallel(ByteView input, int num_threads = 0);
+
+/*
+ * Process a file using fast regex's. 
+ *
+ * The file is memory mapped and processed with fastregex_process() so it is not copied.
+ * Returns: false if the file could not be mapped or an action function returned false
+ */
+bool fastregex_process_file(const char *path);
+
+/*
+ * Process a file that is read ahead asynchronously.
+ *
+ * The file is read into a ring of READ_AHEAD_DEPTH buffers of READ_AHEAD_BUFFER_SIZE bytes
+ *  (read_ahead.h) with several reads in flight, and each buffer is fed to a stream as it
+ *  arrives, so reading the file overlaps with scanning it. Use this for files that are not in
+ *  the page cache, are on network file systems or are too big to map. Matches are the same as
+ *  for fastregex_process_file() except that, as for any stream, regexes with unbounded
+ *  repetitions are only matched over MAX_STREAM_SPAN bytes.
+ * Returns: false if the file could not be read or an action function returned false
+ */
+bool fastregex_process_file_async(const char *path);
+
+/*
+ * Streaming interface. Process input that arrives in chunks, e.g. fixed-size reads from a
+ *  multi-GB spool file, without holding it all in memory.
+ *
+ *      FastRegexStream *stream = fastregex_begin();
+ *      while (read chunk)
+ *          fastregex_feed(stream, chunk);
+ *      fastregex_finish(stream);
+ *
+ * The stream keeps a small tail of the previous chunks so that static strings and matches 
+ *  that straddle chunk boundaries are found. Matches are verified once enough input has 
+ *  arrived to contain the longest possible match, so action functions may be called on a 
+ *  later fastregex_feed() or on fastregex_finish(). 
+ *
+ * Action functions are called with input set to the bytes of the stream that the regex was
+ *  run over and offset set to the offset of the match in input. results->_stream_offset is 
+ *  the offset of the match in the whole stream.
+ *
+ * Regexes with unbounded repetitions are only matched over MAX_STREAM_SPAN bytes.
+ */
+static const int MAX_STREAM_SPAN = 1 << 14;
+
+/*
+ * Start processing a new stream. 
+ * Returns: a stream to pass to fastregex_feed() and fastregex_finish()
+ */
+FastRegexStream *fastregex_begin();
+
+/*
+ * Process the next chunk of a stream. chunk only needs to stay valid for the duration of 
+ *  the call.
+ * Returns: false if an action function returned false, in which case the stream should be
+ *  finished
+ */
+bool fastregex_feed(FastRegexStream *stream, ByteView chunk);
+
+/*
+ * Process any matches that are still pending at the end of the stream and destroy the stream
+ * Returns: false if an action function returned false
+ */
+bool fastregex_finish(FastRegexStream *stream);
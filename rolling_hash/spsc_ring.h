@@ -0,0 +1,100 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+/*
+ * Lock-free single producer, single consumer ring buffer for passing work between the
+ *  stages of a pipeline running on different threads.
+ *
+ * push() blocks while the ring is full so a slow consumer applies back-pressure to the
+ *  producer instead of letting the queue grow without bound. Both push() and pop() give up
+ *  if *stop becomes true so a pipeline can be shut down from any stage.
+ */
+template <class T>
+class SpscRing
+{
+    std::vector<T> _items;
+    const size_t _mask;
+    // Next slot to pop. Only written by the consumer
+    std::atomic<size_t> _head;
+    // Next slot to push. Only written by the producer
+    std::atomic<size_t> _tail;
+
+    SpscRing(const SpscRing &);
+    SpscRing &operator=(const SpscRing &);
+
+    static size_t round_up_pow2(size_t n)
+    {
+        size_t p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+public:
+    SpscRing(size_t capacity) :
+        _items(round_up_pow2(capacity)),
+        _mask(round_up_pow2(capacity) - 1),
+        _head(0),
+        _tail(0)
+    {}
+
+    bool try_push(const T &item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) > _mask) {
+            return false;
+        }
+        _items[tail & _mask] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _items[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Push item, waiting for space if the ring is full.
+     * Returns: false if *stop became true before there was space
+     */
+    bool push(const T &item, const std::atomic<bool> *stop)
+    {
+        while (!try_push(item)) {
+            if (stop->load(std::memory_order_relaxed)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    /*
+     * Pop an item, waiting for one if the ring is empty.
+     * Returns: false if *stop became true before there was an item
+     */
+    bool pop(T &item, const std::atomic<bool> *stop)
+    {
+        while (!try_pop(item)) {
+            if (stop->load(std::memory_order_relaxed)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+};
+
+#endif // _SPSC_RING_H_
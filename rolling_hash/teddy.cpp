@@ -0,0 +1,169 @@
+#include <cassert>
+#include <memory.h>
+#include <vector>
+#include <algorithm>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#include "teddy.h"
+
+using namespace std;
+
+void TeddyMatcher::add(const byte *literal, int len)
+{
+    assert(len > 0);
+    _literals.push_back(vector<byte>(literal, literal + len));
+}
+
+bool TeddyMatcher::has_simd()
+{
+#if defined(__SSSE3__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+struct CompareLiterals
+{
+    const vector<vector<byte> > &_literals;
+    CompareLiterals(const vector<vector<byte> > &literals) : _literals(literals) {}
+    bool operator()(int a, int b) const { return _literals[a] < _literals[b]; }
+};
+
+/*
+ * Literals are bucketed in sorted order so that literals with the same leading bytes share
+ *  buckets and a hit on one bucket rarely has to check literals that start differently
+ */
+void TeddyMatcher::build()
+{
+    int num_literals = (int)_literals.size();
+    _mask_len = MAX_MASK_LEN;
+    for (vector<vector<byte> >::const_iterator it = _literals.begin(); it != _literals.end(); it++) {
+        if ((int)it->size() < _mask_len) {
+            _mask_len = (int)it->size();
+        }
+    }
+
+    vector<int> order(num_literals);
+    for (int i = 0; i < num_literals; i++) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), CompareLiterals(_literals));
+
+    memset(_lo_masks, 0, sizeof(_lo_masks));
+    memset(_hi_masks, 0, sizeof(_hi_masks));
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        _buckets[b].clear();
+    }
+    for (int r = 0; r < num_literals; r++) {
+        int b = r * NUM_BUCKETS / num_literals;
+        const vector<byte> &literal = _literals[order[r]];
+        _buckets[b].push_back(order[r]);
+        for (int k = 0; k < _mask_len; k++) {
+            _lo_masks[k][literal[k] & 0xf] |= (byte)(1 << b);
+            _hi_masks[k][literal[k] >> 4] |= (byte)(1 << b);
+        }
+    }
+    // Keep each bucket's literals in the order they were added
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        sort(_buckets[b].begin(), _buckets[b].end());
+    }
+}
+
+/*
+ * Buckets that may have a literal starting at p. p[0.._mask_len) must be in the data
+ */
+byte TeddyMatcher::get_bucket_bits(const byte *p) const
+{
+    byte bits = 0xff;
+    for (int k = 0; k < _mask_len; k++) {
+        bits &= _lo_masks[k][p[k] & 0xf] & _hi_masks[k][p[k] >> 4];
+    }
+    return bits;
+}
+
+/*
+ * Check the literals in the buckets in bucket_bits against data at offset
+ */
+void TeddyMatcher::check_buckets(const byte *data, size_t numchars, size_t offset, unsigned int bucket_bits, vector<LiteralHit> &hits) const
+{
+    for (int b = 0; bucket_bits; b++, bucket_bits >>= 1) {
+        if (!(bucket_bits & 1)) {
+            continue;
+        }
+        for (vector<int>::const_iterator it = _buckets[b].begin(); it != _buckets[b].end(); it++) {
+            const vector<byte> &literal = _literals[*it];
+            if (offset + literal.size() <= numchars && !memcmp(data + offset, &literal[0], literal.size())) {
+                hits.push_back(LiteralHit(offset, *it));
+            }
+        }
+    }
+}
+
+#if defined(__SSSE3__)
+
+/*
+ * Check 16 offsets at a time from begin while the M bytes at each of them are in the data.
+ * Returns: the offset to continue from
+ */
+template <int M>
+size_t TeddyMatcher::scan_simd(const byte *data, size_t numchars, size_t begin, size_t end, vector<LiteralHit> &hits) const
+{
+    __m128i lo[M], hi[M];
+    for (int k = 0; k < M; k++) {
+        lo[k] = _mm_loadu_si128((const __m128i *)_lo_masks[k]);
+        hi[k] = _mm_loadu_si128((const __m128i *)_hi_masks[k]);
+    }
+    const __m128i low4 = _mm_set1_epi8(0xf);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t offset = begin;
+    for (; offset < end && offset + 16 + M - 1 <= numchars; offset += 16) {
+        __m128i bits = _mm_set1_epi8((char)0xff);
+        for (int k = 0; k < M; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(data + offset + k));
+            __m128i l = _mm_shuffle_epi8(lo[k], _mm_and_si128(v, low4));
+            __m128i h = _mm_shuffle_epi8(hi[k], _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+            bits = _mm_and_si128(bits, _mm_and_si128(l, h));
+        }
+        unsigned int found = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero)) & 0xffff;
+        if (!found) {
+            continue;
+        }
+        byte bucket_bits[16];
+        _mm_storeu_si128((__m128i *)bucket_bits, bits);
+        for (int j = 0; found; j++, found >>= 1) {
+            if ((found & 1) && offset + j < end) {
+                check_buckets(data, numchars, offset + j, bucket_bits[j], hits);
+            }
+        }
+    }
+    return offset < end ? offset : end;
+}
+
+#else
+
+template <int M>
+size_t TeddyMatcher::scan_simd(const byte *data, size_t numchars, size_t begin, size_t end, vector<LiteralHit> &hits) const
+{
+    return begin;
+}
+
+#endif
+
+void TeddyMatcher::scan(const byte *data, size_t numchars, size_t begin, size_t end, vector<LiteralHit> &hits) const
+{
+    switch (_mask_len) {
+    case 1: begin = scan_simd<1>(data, numchars, begin, end, hits); break;
+    case 2: begin = scan_simd<2>(data, numchars, begin, end, hits); break;
+    case 3: begin = scan_simd<3>(data, numchars, begin, end, hits); break;
+    default: return;
+    }
+    for (size_t offset = begin; offset < end && offset + _mask_len <= numchars; offset++) {
+        byte bits = get_bucket_bits(data + offset);
+        if (bits) {
+            check_buckets(data, numchars, offset, bits, hits);
+        }
+    }
+}
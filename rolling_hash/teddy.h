@@ -0,0 +1,59 @@
+#ifndef _TEDDY_H_
+#define _TEDDY_H_
+
+#include <vector>
+#include "literal_matcher.h"
+
+/*
+ * Teddy-style SIMD multi-literal matcher for small sets of literals.
+ *
+ * The literals are split into 8 buckets. For each of the first _mask_len (up to 3) bytes of
+ *  the literals there is a pair of 16 entry tables indexed by the low and high nibbles of an
+ *  input byte that give the buckets with a literal that has that nibble at that position.
+ *  With SSSE3, 16 input offsets are checked at once by looking up the nibbles of 16 bytes
+ *  with PSHUFB and ANDing the bucket masks for the _mask_len positions. The literals in the
+ *  buckets that survive are checked with memcmp.
+ *
+ * Works best when there are few enough literals that each bucket has only a few of them.
+ *  Without SSSE3 (-mssse3 or /arch:AVX) the same tables are looked up a byte at a time.
+ */
+class TeddyMatcher : public LiteralMatcher
+{
+public:
+    // With more literals than this the buckets are too full to reject much. BACKEND_AUTO
+    //  stops well before this
+    enum { MAX_LITERALS = 64 };
+    enum { NUM_BUCKETS = 8 };
+    enum { MAX_MASK_LEN = 3 };
+
+private:
+    std::vector<std::vector<byte> > _literals;
+    // Number of leading bytes of the literals in the masks. The length of the shortest
+    //  literal up to MAX_MASK_LEN
+    int _mask_len;
+    // Bit b of _lo_masks[k][c & 0xf] & _hi_masks[k][c >> 4] is set if a literal in bucket b may
+    //  have byte c at position k
+    byte _lo_masks[MAX_MASK_LEN][16];
+    byte _hi_masks[MAX_MASK_LEN][16];
+    // Indexes of the literals in each bucket
+    std::vector<int> _buckets[NUM_BUCKETS];
+
+    byte get_bucket_bits(const byte *p) const;
+    void check_buckets(const byte *data, size_t numchars, size_t offset, unsigned int bucket_bits, std::vector<LiteralHit> &hits) const;
+    template <int M> size_t scan_simd(const byte *data, size_t numchars, size_t begin, size_t end, std::vector<LiteralHit> &hits) const;
+
+public:
+    TeddyMatcher() : _mask_len(0) {}
+
+    virtual void add(const byte *literal, int len);
+    virtual void build();
+    virtual void scan(const byte *data, size_t numchars, size_t begin, size_t end, std::vector<LiteralHit> &hits) const;
+    virtual const char *get_name() const { return "teddy"; }
+
+    /*
+     * Is the SSSE3 matcher compiled in?
+     */
+    static bool has_simd();
+};
+
+#endif // _TEDDY_H_
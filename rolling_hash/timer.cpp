@@ -1,9 +1,19 @@
+#ifdef _WIN32
 #include <windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 #include "timer.h"
 
 static double _freq;
 static double _time0;
 
+#ifdef _WIN32
+
 static double _get_absolute_time()
 {
     LARGE_INTEGER time;
@@ -19,8 +29,38 @@ void timer_init()
     _time0 = _get_absolute_time();
 }
 
+unsigned long long get_cycle_count()
+{
+    return __rdtsc();
+}
+
+#else
+
+static double _get_absolute_time()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * _freq;
+}
+
+void timer_init()
+{
+    _freq = 1.0e-9;
+    _time0 = _get_absolute_time();
+}
+
+unsigned long long get_cycle_count()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+#endif
+
 double get_elapsed_time()
 {
     return _get_absolute_time() - _time0;
 }
-
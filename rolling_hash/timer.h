@@ -1,7 +1,21 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
+/*
+ * Wall clock and cycle counter for the benchmarks. Uses QueryPerformanceCounter on Windows and
+ *  clock_gettime(CLOCK_MONOTONIC) elsewhere.
+ */
 void timer_init();
+
+/*
+ * Seconds since timer_init()
+ */
 double get_elapsed_time();
 
+/*
+ * Time stamp counter ticks (rdtsc) on x86, for cycles per byte. Only differences between two
+ *  calls mean anything. Returns 0 on other processors
+ */
+unsigned long long get_cycle_count();
+
 #endif  // _TIMER_H_
@@ -0,0 +1,94 @@
+/*
+ * Runs the unit tests of the fastregex modules. See unit_test.h
+ *
+ * Exits with status 1 if any check failed.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include "unit_test.h"
+
+using namespace std;
+
+struct UnitTest
+{
+    const char *_name;
+    void (*_fn)();
+};
+
+static const UnitTest TESTS[] = {
+    { "anchored_regex", test_anchored_regex },
+    { "process_modes", test_process_modes },
+    { "mersennehash", test_mersennehash },
+    { "gf2poly", test_gf2poly },
+    { "rollinghash", test_rollinghash },
+    { "byte_model", test_byte_model },
+    { "corpus_scan", test_corpus_scan },
+    { "content_chunker", test_content_chunker },
+    { "file_sketch", test_file_sketch },
+};
+
+static int _num_checks = 0;
+static int _num_failures = 0;
+static string _note;
+
+bool unit_check(bool ok, const char *expr, const char *file, int line)
+{
+    _num_checks++;
+    if (!ok) {
+        _num_failures++;
+        if (!_note.empty()) {
+            cout << "  " << _note << endl;
+            _note.clear();
+        }
+        cout << "  FAILED " << file << ":" << line << ": " << expr << endl;
+    }
+    return ok;
+}
+
+void unit_note(const string &note)
+{
+    _note = note;
+}
+
+string unit_temp_path(const string &name)
+{
+    return "unit_test_" + name + ".tmp";
+}
+
+bool unit_write_file(const string &path, ByteView data)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = data.get_len() == 0 || fwrite(data.get_data(), 1, data.get_len(), f) == data.get_len();
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int num_tests = (int)(sizeof(TESTS) / sizeof(TESTS[0]));
+    int num_run = 0;
+    for (int i = 0; i < num_tests; i++) {
+        bool selected = argc < 2;
+        for (int j = 1; j < argc; j++) {
+            selected = selected || !strcmp(argv[j], TESTS[i]._name);
+        }
+        if (!selected) {
+            continue;
+        }
+        int failures = _num_failures;
+        cout << TESTS[i]._name << endl;
+        _note.clear();
+        TESTS[i]._fn();
+        cout << "  " << (_num_failures == failures ? "ok" : "FAILED") << endl;
+        num_run++;
+    }
+    if (num_run == 0) {
+        cerr << "No test called " << argv[1] << endl;
+        return 1;
+    }
+    cout << num_run << " tests, " << _num_checks << " checks, " << _num_failures << " failed" << endl;
+    return _num_failures ? 1 : 0;
+}
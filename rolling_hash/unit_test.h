@@ -0,0 +1,53 @@
+#ifndef _UNIT_TEST_H_
+#define _UNIT_TEST_H_
+
+/*
+ * A minimal harness for the unit tests of the fastregex modules. Each module's tests are a
+ *  function in <module>_test.cpp that is listed in unit_test.cpp. A failed CHECK() prints
+ *  where it was and the test carries on, so one run shows every failure.
+ *
+ * Build: make unit_test
+ * Run:   unit_test [test name...]
+ */
+#include <string>
+#include <vector>
+#include "byteview.h"
+
+/*
+ * Record the outcome of a check and print it if it failed
+ * Returns: ok
+ */
+bool unit_check(bool ok, const char *expr, const char *file, int line);
+
+#define CHECK(cond) unit_check((cond), #cond, __FILE__, __LINE__)
+
+/*
+ * Print a note that explains the failures that follow it, e.g. which pattern was tested
+ */
+void unit_note(const std::string &note);
+
+/*
+ * Path of a scratch file or directory called name in the directory the tests are run from
+ */
+std::string unit_temp_path(const std::string &name);
+
+/*
+ * Write data to the file at path, replacing it
+ * Returns: false if it could not be written
+ */
+bool unit_write_file(const std::string &path, ByteView data);
+
+/*
+ * The tests
+ */
+void test_anchored_regex();
+void test_process_modes();
+void test_mersennehash();
+void test_gf2poly();
+void test_rollinghash();
+void test_byte_model();
+void test_corpus_scan();
+void test_content_chunker();
+void test_file_sketch();
+
+#endif // _UNIT_TEST_H_